@@ -48,7 +48,7 @@ llist_ts_t alist_p;
 
 void apoint_free(struct apoint *apt)
 {
-	mem_free(apt->mesg);
+	io_data_str_free(apt->mesg);
 	erase_note(&apt->note);
 	mem_free(apt);
 }
@@ -62,8 +62,10 @@ struct apoint *apoint_dup(struct apoint *in)
 	apt->dur = in->dur;
 	apt->state = in->state;
 	apt->mesg = mem_strdup(in->mesg);
-	if (in->note)
+	if (in->note) {
 		apt->note = mem_strdup(in->note);
+		note_ref(apt->note);
+	}
 	else
 		apt->note = NULL;
 
@@ -106,8 +108,9 @@ struct apoint *apoint_new(char *mesg, char *note, time_t start, long dur,
 	struct apoint *apt;
 
 	apt = mem_malloc(sizeof(struct apoint));
-	apt->mesg = mem_strdup(mesg);
-	apt->note = (note != NULL) ? mem_strdup(note) : NULL;
+	apt->mesg = io_data_str(mesg);
+	apt->note = (note != NULL) ? io_data_str(note) : NULL;
+	note_ref(apt->note);
 	apt->state = state;
 	apt->start = start;
 	apt->dur = dur;
@@ -147,33 +150,45 @@ void apoint_sec2str(struct apoint *o, time_t day, char *start, char *end)
 	}
 }
 
-char *apoint_tostr(struct apoint *o)
+/* Append the serialized form of an appointment to a string. */
+void apoint_serialize(struct apoint *o, struct string *s)
 {
-	struct string s;
+	size_t note_len = o->note ? strlen(o->note) : 0;
+	size_t mesg_len = strlen(o->mesg);
 	struct tm lt;
 	time_t t;
+	char *p;
 
-	string_init(&s);
+	p = string_reserve(s, 2 * FMT_DATETIME_MAX + 4 + note_len + 2 + 1 +
+			   mesg_len);
 
 	t = o->start;
 	localtime_r(&t, &lt);
-	string_catf(&s, "%02u/%02u/%04u @ %02u:%02u", lt.tm_mon + 1,
-		lt.tm_mday, 1900 + lt.tm_year, lt.tm_hour, lt.tm_min);
+	p = fmt_datetime(p, &lt);
 
 	t = o->start + o->dur;
 	localtime_r(&t, &lt);
-	string_catf(&s, " -> %02u/%02u/%04u @ %02u:%02u", lt.tm_mon + 1,
-		lt.tm_mday, 1900 + lt.tm_year, lt.tm_hour, lt.tm_min);
+	p = fmt_str(p, " -> ", 4);
+	p = fmt_datetime(p, &lt);
 
-	if (o->note)
-		string_catf(&s, ">%s ", o->note);
+	if (o->note) {
+		*p++ = '>';
+		p = fmt_str(p, o->note, note_len);
+		*p++ = ' ';
+	}
 
-	if (o->state & APOINT_NOTIFY)
-		string_catf(&s, "%c", '!');
-	else
-		string_catf(&s, "%c", '|');
+	*p++ = (o->state & APOINT_NOTIFY) ? '!' : '|';
+	p = fmt_str(p, o->mesg, mesg_len);
+
+	string_commit(s, p);
+}
+
+char *apoint_tostr(struct apoint *o)
+{
+	struct string s;
 
-	string_catf(&s, "%s", o->mesg);
+	string_init(&s);
+	apoint_serialize(o, &s);
 
 	return string_buf(&s);
 }
@@ -190,15 +205,18 @@ char *apoint_hash(struct apoint *apt)
 
 void apoint_write(struct apoint *o, FILE * f)
 {
-	char *str = apoint_tostr(o);
-	fprintf(f, "%s\n", str);
-	mem_free(str);
+	struct string s;
+
+	string_init(&s);
+	apoint_serialize(o, &s);
+	fwrite(string_buf(&s), 1, s.len, f);
+	fputc('\n', f);
+	mem_free(string_buf(&s));
 }
 
-char *apoint_scan(FILE * f, struct tm start, struct tm end,
+char *apoint_scan(char *mesg, struct tm start, struct tm end,
 			   char state, char *note, struct item_filter *filter)
 {
-	char buf[BUFSIZ], *newline;
 	time_t tstart, tend;
 	struct apoint *apt = NULL;
 	int cond;
@@ -209,14 +227,6 @@ char *apoint_scan(FILE * f, struct tm start, struct tm end,
 	    !check_time(end.tm_hour, end.tm_min))
 		return _("illegal date in appointment");
 
-	/* Read the appointment description */
-	if (!fgets(buf, sizeof buf, f))
-		return _("error in appointment description");
-
-	newline = strchr(buf, '\n');
-	if (newline)
-		*newline = '\0';
-
 	start.tm_sec = end.tm_sec = 0;
 	start.tm_isdst = end.tm_isdst = -1;
 	start.tm_year -= 1900;
@@ -233,7 +243,7 @@ char *apoint_scan(FILE * f, struct tm start, struct tm end,
 	if (filter) {
 		cond = (
 		    !(filter->type_mask & TYPE_MASK_APPT) ||
-		    (filter->regex && regexec(filter->regex, buf, 0, 0, 0)) ||
+		    (filter->regex && regexec(filter->regex, mesg, 0, 0, 0)) ||
 		    (filter->start_from != -1 && tstart < filter->start_from) ||
 		    (filter->start_to != -1 && tstart > filter->start_to) ||
 		    (filter->end_from != -1 && tend < filter->end_from) ||
@@ -241,7 +251,7 @@ char *apoint_scan(FILE * f, struct tm start, struct tm end,
 		);
 		if (filter->hash) {
 			apt = apoint_new(
-				buf, note, tstart, tend - tstart, state);
+				mesg, note, tstart, tend - tstart, state);
 			char *hash = apoint_hash(apt);
 			cond = cond || !hash_matches(filter->hash, hash);
 			mem_free(hash);
@@ -254,7 +264,7 @@ char *apoint_scan(FILE * f, struct tm start, struct tm end,
 		}
 	}
 	if (!apt)
-		apt = apoint_new(buf, note, tstart, tend - tstart, state);
+		apt = apoint_new(mesg, note, tstart, tend - tstart, state);
 	return NULL;
 }
 
@@ -0,0 +1,883 @@
+/*
+ * Calcurse - text-based organizer
+ *
+ * Copyright (c) 2004-2022 calcurse Development Team <misc@calcurse.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the
+ *        following disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the
+ *        following disclaimer in the documentation and/or other
+ *        materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Send your feedback or comments to : misc@calcurse.org
+ * Calcurse home page : http://calcurse.org
+ *
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "calcurse.h"
+#include "sha1.h"
+
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+#endif
+
+/*
+ * Archive of past items.
+ *
+ * Appointments and events that ended before a cutoff day are not kept in the
+ * appointment file but in an archive next to it (path_archive), so that the
+ * appointment file does not grow with the years. When the data files are
+ * saved and the general.archivehorizon option is set, the cutoff moves forward
+ * and items that ended more than that many days ago move into the archive.
+ *
+ * The archive starts with an index, followed by blocks of archived items in
+ * appointment file format, one per month the items start in:
+ *
+ *   calcurse-archive 1 <cutoff> <blocks>
+ *   <month> <first> <last> <offset> <size> <len> <method> <notes> <note>...
+ *
+ * with one line per block, sorted by month (year * 12 + month - 1). Days are
+ * day numbers (see date2daynum()): first and last bound the days the items of
+ * a block occur on, and all of them end before the cutoff. The offset of a
+ * block is relative to the end of the index. Blocks are compressed with zlib
+ * (method z) when calcurse is built with it, or stored as is (method r); size
+ * is the number of bytes stored and len the length of the contents. The notes
+ * attached to the items of a block are listed in its index line, so that the
+ * garbage collector keeps them while the block is not loaded.
+ *
+ * Blocks are loaded on demand, when a range of days reaching back before the
+ * cutoff is displayed or queried (see archive_load()). When saving, only the
+ * blocks whose items changed are rewritten; the others are copied as they are.
+ *
+ * The archive goes along with the appointment file it was loaded with: the
+ * file the index was read from is kept open, and blocks are only ever read
+ * from it. If another program replaces the archive, its blocks may hold items
+ * that are still in the appointment lists; they are only used once the data
+ * files are loaded again.
+ */
+
+#define ARCHIVE_MAGIC	"calcurse-archive 1"
+#define ARCHIVE_RAW	'r'
+#define ARCHIVE_ZLIB	'z'
+
+#define ARCHIVE_DIGESTLEN	(SHA1_DIGESTLEN * 2)
+
+struct archive_block {
+	long month;
+	long first, last;
+	off_t offset;
+	unsigned long size, len;
+	char method;
+	char **notes;
+	unsigned nnotes;
+	int loaded;
+	int wanted;
+	char digest[ARCHIVE_DIGESTLEN + 1];	/* of the contents, if loaded */
+};
+
+struct archive_index {
+	int exists;
+	FILE *fp;		/* the file the index was read from */
+	struct stat st;		/* its status when the index was read */
+	long cutoff;
+	off_t data;		/* position of the first block */
+	struct archive_block *blocks;
+	unsigned nblocks;
+};
+
+/* An item moving into (or staying in) the archive while saving. */
+struct archive_item {
+	long month, first, last;
+	unsigned seq;
+	enum day_item_type type;
+	union aptev_ptr p;
+	char *note;
+};
+
+struct archive_collect {
+	struct archive_item *items;
+	unsigned n, size;
+	long cutoff;
+	int noload;		/* leave out items of blocks not loaded */
+	int missing;
+};
+
+/* The rendered items of a month. */
+struct archive_group {
+	long month, first, last;
+	char *buf;
+	size_t len;
+	char **notes;
+	unsigned nnotes;
+	char digest[ARCHIVE_DIGESTLEN + 1];
+};
+
+static struct archive_index archive = { 0 };
+
+static struct {
+	int active;
+	long cutoff;
+	struct archive_group *groups;
+	unsigned ngroups;
+	struct archive_index next;
+} archive_save = { 0 };
+
+static pthread_mutex_t archive_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t archive_saved = PTHREAD_COND_INITIALIZER;
+
+/*
+ * Report an error found in the archive, which is read with the lock held.
+ * While loading during startup, the error ends the loading thread.
+ */
+static void archive_error(const char *mesg)
+{
+	pthread_mutex_unlock(&archive_mutex);
+	io_load_error(path_archive, 0, mesg);
+}
+
+static void archive_digest(const char *buf, size_t len, char *digest)
+{
+	sha1_ctx_t ctx;
+	uint8_t data[BUFSIZ], md[SHA1_DIGESTLEN];
+	size_t n;
+	int i;
+
+	/* sha1_update() scrambles its input, hash a copy of the buffer. */
+	sha1_init(&ctx);
+	for (; len > 0; buf += n, len -= n) {
+		n = MIN(len, BUFSIZ);
+		memcpy(data, buf, n);
+		sha1_update(&ctx, data, n);
+	}
+	sha1_final(&ctx, md);
+	for (i = 0; i < SHA1_DIGESTLEN; i++)
+		snprintf(digest + 2 * i, 3, "%02x", md[i]);
+}
+
+static void archive_add_note(char ***notes, unsigned *n, const char *note)
+{
+	unsigned i;
+
+	for (i = 0; i < *n; i++) {
+		if (!strcmp((*notes)[i], note))
+			return;
+	}
+	*notes = mem_realloc(*notes, *n + 1, sizeof(char *));
+	(*notes)[(*n)++] = mem_strdup(note);
+}
+
+static void archive_free_notes(char **notes, unsigned n)
+{
+	unsigned i;
+
+	if (!notes)
+		return;
+	for (i = 0; i < n; i++)
+		mem_free(notes[i]);
+	mem_free(notes);
+}
+
+/* Account for the notes of the archived items, see note_ref(). */
+static void archive_ref_notes(struct archive_index *idx)
+{
+	unsigned i, j;
+
+	for (i = 0; i < idx->nblocks; i++) {
+		for (j = 0; j < idx->blocks[i].nnotes; j++)
+			note_ref(idx->blocks[i].notes[j]);
+	}
+}
+
+static void archive_free_index(struct archive_index *idx)
+{
+	struct archive_block *b;
+	unsigned i, j;
+
+	for (i = 0; i < idx->nblocks; i++) {
+		b = &idx->blocks[i];
+		for (j = 0; j < b->nnotes; j++)
+			note_unref(b->notes[j]);
+		archive_free_notes(b->notes, b->nnotes);
+	}
+	if (idx->blocks)
+		mem_free(idx->blocks);
+	if (idx->fp)
+		fclose(idx->fp);
+	idx->fp = NULL;
+	idx->blocks = NULL;
+	idx->nblocks = 0;
+	idx->exists = 0;
+	idx->cutoff = LONG_MIN;
+}
+
+/*
+ * Read the index of the archive from the start of a file, which is kept by
+ * the index. An index without any blocks is used if there is no archive.
+ */
+static void archive_read_index(FILE *fp, struct archive_index *idx)
+{
+	struct archive_block *b;
+	char *line = NULL, *p, *note, *last;
+	size_t size = 0;
+	long long offset;
+	unsigned i, j;
+	int n;
+
+	idx->exists = 0;
+	idx->fp = fp;
+	idx->cutoff = LONG_MIN;
+	idx->data = 0;
+	idx->blocks = NULL;
+	idx->nblocks = 0;
+	if (!fp)
+		return;
+
+	if (fstat(fileno(fp), &idx->st) != 0 ||
+	    getline(&line, &size, fp) < 0 ||
+	    sscanf(line, ARCHIVE_MAGIC " %ld %u", &idx->cutoff,
+		   &idx->nblocks) != 2 || idx->nblocks > INT_MAX / 2)
+		archive_error(_("malformed archive"));
+	idx->blocks = mem_calloc(idx->nblocks + 1,
+				 sizeof(struct archive_block));
+
+	for (i = 0; i < idx->nblocks; i++) {
+		b = &idx->blocks[i];
+		if (getline(&line, &size, fp) < 0 ||
+		    sscanf(line, "%ld %ld %ld %lld %lu %lu %c %u%n",
+			   &b->month, &b->first, &b->last, &offset,
+			   &b->size, &b->len, &b->method, &b->nnotes,
+			   &n) != 8 || b->nnotes > size / 2)
+			archive_error(_("malformed archive"));
+		b->offset = offset;
+		if (b->nnotes > 0)
+			b->notes = mem_calloc(b->nnotes, sizeof(char *));
+		for (j = 0, p = line + n; j < b->nnotes; j++, p = NULL) {
+			if (!(note = strtok_r(p, " \n", &last)))
+				archive_error(_("malformed archive"));
+			b->notes[j] = mem_strdup(note);
+		}
+		if ((i > 0 && b->month <= b[-1].month) ||
+		    b->last >= idx->cutoff || b->offset < 0)
+			archive_error(_("malformed archive"));
+	}
+	free(line);
+
+	idx->data = ftello(fp);
+	for (i = 0; i < idx->nblocks; i++) {
+		b = &idx->blocks[i];
+		if (b->offset + b->size > idx->st.st_size - idx->data)
+			archive_error(_("malformed archive"));
+	}
+	idx->exists = 1;
+	archive_ref_notes(idx);
+}
+
+/* Check whether a file still is the one the index was read from. */
+static int archive_same_file(FILE *fp)
+{
+	struct stat st;
+
+	if (!fp || fstat(fileno(fp), &st) != 0)
+		return !archive.exists;
+	return archive.exists && st.st_dev == archive.st.st_dev &&
+	       st.st_ino == archive.st.st_ino &&
+	       st.st_size == archive.st.st_size &&
+	       st.st_mtime == archive.st.st_mtime;
+}
+
+/* Read a block and load its items. */
+static void archive_load_block(struct archive_block *b,
+			       struct item_filter *filter)
+{
+	char *buf, *data;
+
+	buf = mem_malloc(b->len + 1);
+	data = b->method == ARCHIVE_RAW ? buf : mem_malloc(b->size + 1);
+	if ((b->method == ARCHIVE_RAW && b->size != b->len) ||
+	    fseeko(archive.fp, archive.data + b->offset, SEEK_SET) != 0 ||
+	    fread(data, 1, b->size, archive.fp) != b->size)
+		archive_error(_("malformed archive"));
+
+	if (b->method == ARCHIVE_ZLIB) {
+#ifdef HAVE_LIBZ
+		uLongf len = b->len;
+
+		if (uncompress((Bytef *)buf, &len, (Bytef *)data,
+			       b->size) != Z_OK || len != b->len)
+			archive_error(_("malformed archive"));
+#else
+		archive_error(_("calcurse was built without zlib"));
+#endif
+		mem_free(data);
+	} else if (b->method != ARCHIVE_RAW) {
+		archive_error(_("malformed archive"));
+	}
+	buf[b->len] = '\0';
+
+	archive_digest(buf, b->len, b->digest);
+	b->loaded = 1;
+	b->wanted = 0;
+	io_load_app_buf(buf, b->len, path_archive, filter);
+}
+
+/*
+ * Read the index of the archive, forgetting about loaded blocks. This is done
+ * whenever the appointment file was loaded.
+ */
+void archive_open(void)
+{
+	struct archive_index idx;
+	FILE *fp;
+
+	pthread_mutex_lock(&archive_mutex);
+	fp = fopen(path_archive, "r");
+	archive_read_index(fp, &idx);
+	archive_free_index(&archive);
+	archive = idx;
+	pthread_mutex_unlock(&archive_mutex);
+}
+
+/* Free the index of the archive. */
+void archive_free(void)
+{
+	/*
+	 * Exiting on an error found while loading a block leaves the lock
+	 * held: the memory is then left to the system.
+	 */
+	if (pthread_mutex_trylock(&archive_mutex) != 0)
+		return;
+	archive_free_index(&archive);
+	pthread_mutex_unlock(&archive_mutex);
+}
+
+/* Check whether the archive was modified since its index was read. */
+int archive_changed(void)
+{
+	FILE *fp;
+	int ret;
+
+	pthread_mutex_lock(&archive_mutex);
+	fp = fopen(path_archive, "r");
+	ret = !archive_same_file(fp);
+	if (fp)
+		fclose(fp);
+	pthread_mutex_unlock(&archive_mutex);
+
+	return ret;
+}
+
+/*
+ * Load the archived items that may occur between two days (day numbers, see
+ * date2daynum()). Blocks that were loaded before are not loaded again.
+ */
+void archive_load(long from, long to, struct item_filter *filter)
+{
+	struct archive_block *b;
+	unsigned i;
+
+	/* The item lists are not available while loading during startup. */
+	if (io_loading())
+		return;
+
+	/*
+	 * While saving, the items of the archive are being written: blocks
+	 * loaded meanwhile would be lost, so wait for the save to finish.
+	 */
+	pthread_mutex_lock(&archive_mutex);
+	while (archive_save.active)
+		pthread_cond_wait(&archive_saved, &archive_mutex);
+	for (i = 0; i < archive.nblocks; i++) {
+		b = &archive.blocks[i];
+		if (!b->loaded && b->last >= from && b->first <= to)
+			archive_load_block(b, filter);
+	}
+	pthread_mutex_unlock(&archive_mutex);
+}
+
+/* Load all archived items, such as for a search or an export. */
+void archive_load_all(struct item_filter *filter)
+{
+	archive_load(LONG_MIN, LONG_MAX, filter);
+}
+
+/* Get the days an item may occur on, see io_skim_app(). */
+static void archive_item_days(time_t start, long dur, struct rpt *rpt,
+			      long *first, long *last)
+{
+	*first = sec2daynum(start);
+	*last = dur > 0 ? sec2daynum(start + dur) : *first;
+	if (rpt) {
+		*last = rpt->until ?
+			sec2daynum(rpt->until) + *last - *first : LONG_MAX;
+	}
+}
+
+/* Get the month a day belongs to, as used for the blocks of the archive. */
+static long archive_month(long day)
+{
+	struct date d = daynum2date(day);
+
+	return (long)d.yyyy * 12 + d.mm - 1;
+}
+
+static struct archive_block *archive_find_block(long month)
+{
+	unsigned lo = 0, hi = archive.nblocks, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (archive.blocks[mid].month < month)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo < archive.nblocks && archive.blocks[lo].month == month)
+		return &archive.blocks[lo];
+	return NULL;
+}
+
+/*
+ * Check whether an item is left out of the appointment file because it is
+ * written to the archive by the save in progress. Items of a month whose
+ * block is not loaded stay in the appointment file, see archive_collect().
+ */
+int archive_cold(time_t start, long dur, struct rpt *rpt)
+{
+	struct archive_block *b;
+	long first, last;
+
+	if (!archive_save.active || archive_save.cutoff == LONG_MIN)
+		return 0;
+	archive_item_days(start, dur, rpt, &first, &last);
+	if (last >= archive_save.cutoff)
+		return 0;
+	b = archive_find_block(archive_month(first));
+	return !b || b->loaded;
+}
+
+static void archive_collect(struct archive_collect *c,
+			    enum day_item_type type, union aptev_ptr p,
+			    time_t start, long dur, struct rpt *rpt,
+			    char *note)
+{
+	struct archive_item *it;
+	struct archive_block *b;
+	long month, first, last;
+
+	archive_item_days(start, dur, rpt, &first, &last);
+	if (last >= c->cutoff)
+		return;
+
+	/* The other items of the month are needed to rewrite its block. */
+	month = archive_month(first);
+	if ((b = archive_find_block(month)) && !b->loaded) {
+		if (c->noload)
+			return;
+		b->wanted = 1;
+		c->missing = 1;
+	}
+
+	if (c->n == c->size) {
+		c->size = c->size ? 2 * c->size : 64;
+		c->items = mem_realloc(c->items, c->size,
+				       sizeof(struct archive_item));
+	}
+	it = &c->items[c->n];
+	it->month = month;
+	it->first = first;
+	it->last = last;
+	it->seq = c->n++;
+	it->type = type;
+	it->p = p;
+	it->note = note;
+}
+
+/* Collect the items that belong to the archive, in appointment file order. */
+static void archive_collect_all(struct archive_collect *c)
+{
+	llist_item_t *i;
+	union aptev_ptr p;
+
+	c->n = 0;
+	c->missing = 0;
+
+	LLIST_FOREACH(&recur_elist, i) {
+		p.rev = LLIST_GET_DATA(i);
+		archive_collect(c, RECUR_EVNT, p, p.rev->day, 0, p.rev->rpt,
+				p.rev->note);
+	}
+	LLIST_TS_LOCK(&recur_alist_p);
+	LLIST_TS_FOREACH(&recur_alist_p, i) {
+		p.rapt = LLIST_TS_GET_DATA(i);
+		archive_collect(c, RECUR_APPT, p, p.rapt->start, p.rapt->dur,
+				p.rapt->rpt, p.rapt->note);
+	}
+	LLIST_TS_UNLOCK(&recur_alist_p);
+	LLIST_TS_LOCK(&alist_p);
+	LLIST_TS_FOREACH(&alist_p, i) {
+		p.apt = LLIST_TS_GET_DATA(i);
+		archive_collect(c, APPT, p, p.apt->start, p.apt->dur, NULL,
+				p.apt->note);
+	}
+	LLIST_TS_UNLOCK(&alist_p);
+	LLIST_FOREACH(&eventlist, i) {
+		p.ev = LLIST_GET_DATA(i);
+		archive_collect(c, EVNT, p, p.ev->day, 0, NULL, p.ev->note);
+	}
+}
+
+static int archive_item_cmp(const void *a, const void *b)
+{
+	const struct archive_item *x = a, *y = b;
+
+	if (x->month != y->month)
+		return x->month < y->month ? -1 : 1;
+	return x->seq < y->seq ? -1 : (x->seq > y->seq);
+}
+
+static void archive_write_item(struct archive_item *it, FILE *fp)
+{
+	switch (it->type) {
+	case RECUR_EVNT:
+		recur_event_write(it->p.rev, fp);
+		break;
+	case RECUR_APPT:
+		recur_apoint_write(it->p.rapt, fp);
+		break;
+	case APPT:
+		apoint_write(it->p.apt, fp);
+		break;
+	case EVNT:
+		event_write(it->p.ev, fp);
+		break;
+	default:
+		break;
+	}
+}
+
+/* Render the collected items into one group per month. */
+static void archive_render(struct archive_collect *c)
+{
+	struct archive_group *g;
+	struct archive_item *it;
+	unsigned i;
+	FILE *fp = NULL;
+
+	qsort(c->items, c->n, sizeof(struct archive_item), archive_item_cmp);
+	archive_save.groups = mem_calloc(c->n + 1,
+					 sizeof(struct archive_group));
+	archive_save.ngroups = 0;
+
+	for (i = 0, g = NULL; i < c->n; i++) {
+		it = &c->items[i];
+		if (!g || g->month != it->month) {
+			if (fp)
+				fclose(fp);
+			g = &archive_save.groups[archive_save.ngroups++];
+			g->month = it->month;
+			g->first = it->first;
+			g->last = it->last;
+			fp = open_memstream(&g->buf, &g->len);
+			EXIT_IF(fp == NULL,
+				_("could not allocate output buffer"));
+		}
+		archive_write_item(it, fp);
+		g->first = MIN(g->first, it->first);
+		g->last = MAX(g->last, it->last);
+		if (it->note)
+			archive_add_note(&g->notes, &g->nnotes, it->note);
+	}
+	if (fp)
+		fclose(fp);
+
+	for (i = 0; i < archive_save.ngroups; i++) {
+		g = &archive_save.groups[i];
+		archive_digest(g->buf, g->len, g->digest);
+	}
+}
+
+static void archive_free_groups(void)
+{
+	struct archive_group *g;
+	unsigned i;
+
+	for (i = 0; i < archive_save.ngroups; i++) {
+		g = &archive_save.groups[i];
+		/* The buffer was allocated by open_memstream(). */
+		free(g->buf);
+		archive_free_notes(g->notes, g->nnotes);
+	}
+	if (archive_save.groups)
+		mem_free(archive_save.groups);
+	archive_save.groups = NULL;
+	archive_save.ngroups = 0;
+}
+
+/*
+ * Prepare saving the data files: find the items that belong to the archive
+ * and leave them out of the appointment file until archive_save_done() is
+ * called. Return 1 if the archive must be rewritten by archive_write().
+ *
+ * Loading a block adds its items to the lists the user interface displays,
+ * which only the main thread may do. Periodic saves do not load any block:
+ * the items of a month whose block is not loaded stay in the appointment
+ * file until the next save from the main thread.
+ */
+int archive_save_prepare(int periodic)
+{
+	struct archive_collect c = { .noload = periodic };
+	struct archive_block *b;
+	struct archive_group *g;
+	unsigned i, j = 0;
+	int changed = 0;
+
+	pthread_mutex_lock(&archive_mutex);
+	c.cutoff = archive.cutoff;
+	if (conf.archive_horizon > 0)
+		c.cutoff = MAX(c.cutoff, sec2daynum(now()) -
+				(long)conf.archive_horizon);
+
+	/* Without archive and horizon, there is nothing to look for. */
+	if (c.cutoff == LONG_MIN)
+		goto done;
+
+	archive_collect_all(&c);
+	if (c.missing) {
+		for (i = 0; i < archive.nblocks; i++) {
+			b = &archive.blocks[i];
+			if (b->wanted)
+				archive_load_block(b, NULL);
+		}
+		archive_collect_all(&c);
+	}
+	archive_render(&c);
+	if (c.items)
+		mem_free(c.items);
+
+	/* Compare the months of the items with the loaded blocks. */
+	for (i = 0; i < archive_save.ngroups; i++) {
+		g = &archive_save.groups[i];
+		b = archive_find_block(g->month);
+		if (!b || !b->loaded || strcmp(b->digest, g->digest))
+			changed = 1;
+	}
+	for (i = 0; i < archive.nblocks; i++) {
+		b = &archive.blocks[i];
+		while (j < archive_save.ngroups &&
+		       archive_save.groups[j].month < b->month)
+			j++;
+		if (b->loaded && (j == archive_save.ngroups ||
+		    archive_save.groups[j].month != b->month))
+			changed = 1;
+	}
+
+done:
+	archive_save.active = 1;
+	archive_save.cutoff = c.cutoff;
+	if (!changed)
+		archive_free_groups();
+	pthread_mutex_unlock(&archive_mutex);
+
+	return changed;
+}
+
+/* Compress the contents of a block if that saves space. */
+static char archive_compress(const char *buf, unsigned long len, char **out,
+			     unsigned long *size)
+{
+#ifdef HAVE_LIBZ
+	uLongf n = compressBound(len);
+
+	*out = mem_malloc(n);
+	if (compress2((Bytef *)*out, &n, (const Bytef *)buf, len,
+		      Z_BEST_COMPRESSION) == Z_OK && n < len) {
+		*size = n;
+		return ARCHIVE_ZLIB;
+	}
+	mem_free(*out);
+#endif
+	*out = NULL;
+	*size = len;
+	return ARCHIVE_RAW;
+}
+
+/* Copy a block of the archive being replaced. */
+static int archive_copy_block(FILE *out, struct archive_block *b)
+{
+	char buf[BUFSIZ];
+	unsigned long n, left = b->size;
+
+	if (fseeko(archive.fp, archive.data + b->offset, SEEK_SET) != 0)
+		return 0;
+	while (left > 0) {
+		n = fread(buf, 1, MIN(left, sizeof(buf)), archive.fp);
+		if (n == 0 || fwrite(buf, 1, n, out) != n)
+			return 0;
+		left -= n;
+	}
+
+	return 1;
+}
+
+/*
+ * Write the archive: the blocks of the months with items to archive are
+ * rewritten, and the blocks that were not loaded are copied.
+ */
+int archive_write(FILE *out)
+{
+	struct archive_index *next = &archive_save.next;
+	struct archive_block *nb, *b;
+	struct archive_group *g;
+	char **data;
+	unsigned i, j, k, n;
+	off_t offset = 0;
+	int ret = 1;
+
+	pthread_mutex_lock(&archive_mutex);
+	n = archive_save.ngroups + archive.nblocks;
+	next->blocks = mem_calloc(n + 1, sizeof(struct archive_block));
+	next->nblocks = 0;
+	next->cutoff = archive_save.cutoff;
+	data = mem_calloc(n + 1, sizeof(char *));
+
+	for (i = j = 0; i < archive_save.ngroups || j < archive.nblocks; ) {
+		g = i < archive_save.ngroups ? &archive_save.groups[i] : NULL;
+		b = j < archive.nblocks ? &archive.blocks[j] : NULL;
+		k = next->nblocks;
+		nb = &next->blocks[k];
+		if (b && b->loaded) {
+			/* A loaded block is replaced by its group, if any. */
+			j++;
+			continue;
+		} else if (b && (!g || b->month < g->month)) {
+			*nb = *b;
+			nb->notes = NULL;
+			nb->nnotes = 0;
+			for (n = 0; n < b->nnotes; n++)
+				archive_add_note(&nb->notes, &nb->nnotes,
+						 b->notes[n]);
+			j++;
+		} else {
+			nb->month = g->month;
+			nb->first = g->first;
+			nb->last = g->last;
+			nb->len = g->len;
+			nb->method = archive_compress(g->buf, g->len, &data[k],
+						      &nb->size);
+			nb->notes = g->notes;
+			nb->nnotes = g->nnotes;
+			g->notes = NULL;
+			g->nnotes = 0;
+			nb->loaded = 1;
+			memcpy(nb->digest, g->digest, sizeof(nb->digest));
+			i++;
+		}
+		nb->offset = offset;
+		offset += nb->size;
+		next->nblocks++;
+	}
+
+	fprintf(out, "%s %ld %u\n", ARCHIVE_MAGIC, next->cutoff,
+		next->nblocks);
+	for (k = 0; k < next->nblocks; k++) {
+		nb = &next->blocks[k];
+		fprintf(out, "%ld %ld %ld %lld %lu %lu %c %u", nb->month,
+			nb->first, nb->last, (long long)nb->offset, nb->size,
+			nb->len, nb->method, nb->nnotes);
+		for (n = 0; n < nb->nnotes; n++)
+			fprintf(out, " %s", nb->notes[n]);
+		fputc('\n', out);
+	}
+	next->data = ftello(out);
+
+	for (i = j = k = 0; k < next->nblocks; k++) {
+		nb = &next->blocks[k];
+		if (nb->loaded) {
+			while (archive_save.groups[i].month != nb->month)
+				i++;
+			g = &archive_save.groups[i];
+			if (data[k])
+				ret = fwrite(data[k], 1, nb->size, out) ==
+				      nb->size && ret;
+			else
+				ret = fwrite(g->buf, 1, g->len, out) ==
+				      g->len && ret;
+			if (data[k])
+				mem_free(data[k]);
+		} else {
+			while (archive.blocks[j].month != nb->month)
+				j++;
+			ret = archive_copy_block(out, &archive.blocks[j]) &&
+			      ret;
+		}
+	}
+	mem_free(data);
+	pthread_mutex_unlock(&archive_mutex);
+
+	return ret && !ferror(out);
+}
+
+/*
+ * Finish saving the data files. If the archive was written and published
+ * successfully, its new index is used from now on.
+ */
+void archive_save_done(int ok)
+{
+	struct archive_index *next = &archive_save.next;
+	unsigned i;
+
+	pthread_mutex_lock(&archive_mutex);
+	if (next->blocks) {
+		next->fp = ok ? fopen(path_archive, "r") : NULL;
+		if (next->fp && fstat(fileno(next->fp), &next->st) != 0) {
+			fclose(next->fp);
+			next->fp = NULL;
+		}
+		if (next->fp) {
+			next->exists = 1;
+			archive_ref_notes(next);
+			archive_free_index(&archive);
+			archive = *next;
+		} else {
+			/* The notes were never accounted for. */
+			for (i = 0; i < next->nblocks; i++)
+				archive_free_notes(next->blocks[i].notes,
+						   next->blocks[i].nnotes);
+			mem_free(next->blocks);
+		}
+		next->fp = NULL;
+		next->blocks = NULL;
+		next->nblocks = 0;
+	}
+
+	archive_free_groups();
+	archive_save.active = 0;
+	pthread_cond_broadcast(&archive_saved);
+	pthread_mutex_unlock(&archive_mutex);
+}
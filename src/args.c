@@ -38,12 +38,19 @@
 #include <string.h>
 #include <ctype.h>
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <limits.h>
 #include <getopt.h>
 #include <time.h>
 
 #include "calcurse.h"
 
+#ifdef HAVE_SYS_INOTIFY_H
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+
 /* Input types for parse_datetimearg() */
 enum {
 	ARG_DATE,
@@ -85,7 +92,30 @@ enum {
 	OPT_STATUS,
 	OPT_DAEMON,
 	OPT_INPUT_DATEFMT,
-	OPT_OUTPUT_DATEFMT
+	OPT_OUTPUT_DATEFMT,
+	OPT_PACK_NOTES,
+	OPT_ARCHIVE,
+	OPT_WATCH,
+	OPT_DAEMON_DIRS,
+	OPT_LATENCY_LOG,
+	OPT_BENCH,
+	OPT_VIRTUAL_CLOCK
+};
+
+/*
+ * Interval, in seconds, at which --watch checks the data files for changes
+ * when it cannot be notified of them.
+ */
+#define WATCH_INTERVAL 1
+
+/* State of --watch. */
+struct watch {
+	int inotify_fd;
+	struct stat apts_st;
+	struct stat todo_st;
+	FILE *capture;
+	int stdout_fd;
+	char *output;
 };
 
 /*
@@ -142,17 +172,21 @@ static void help_arg(void)
 	printf("%s\n", _("Consult the man page for details."));
 	putchar('\n');
 	printf("%s\n", _("Miscellaneous:"));
+	printf("%s\n", _("  --archive               Move past items into the archive"));
 	printf("%s\n", _("  -c, --calendar <file>   The calendar data file to use"));
 	printf("%s\n", _("  -C, --confdir <dir>     The configuration directory to use"));
 	printf("%s\n", _("  --daemon                Run notification daemon in the background"));
+	printf("%s\n", _("  --daemon-dirs <dirs>    Run one daemon for several data directories"));
 	printf("%s\n", _("  -D, --datadir <dir>     The data directory to use"));
 	printf("%s\n", _("  -g, --gc                Run the garbage collector"));
 	printf("%s\n", _("  -h, --help              Show this help text"));
 	printf("%s\n", _("  -i, --import <file>     Import iCal data from file"));
+	printf("%s\n", _("  --pack-notes            Move all notes into a note pack"));
 	printf("%s\n", _("  -q, --quiet             Suppress import/export result message"));
 	printf("%s\n", _("  --read-only             Do not save configuration or data files"));
 	printf("%s\n", _("  --status                Display status of running instances"));
 	printf("%s\n", _("  -v, --version           Show version information"));
+	printf("%s\n", _("  --watch                 Reprint query results whenever they change"));
 	printf("%s\n", _("  -x, --export[<format>]  Export to stdout in ical (default) or pcal format"));
 	putchar('\n');
 	printf("%s\n", _("For more information, type '?' from within calcurse, or read the manpage."));
@@ -266,6 +300,7 @@ static void arg_print_date(long date)
  * Print appointments inside the given query range.
  * If no start day is given (-1), today is considered.
  * If no end date is given (-1), a range of 1 day is considered.
+ * The scan stops as soon as the limit of printed items is reached.
  */
 static void
 date_arg_from_to(long from, long to, int add_line, const char *fmt_apt,
@@ -273,8 +308,15 @@ date_arg_from_to(long from, long to, int add_line, const char *fmt_apt,
 		 int *limit)
 {
 	long date;
+	int attr[64], k;
 
-	for (date = from; date <= to; date = date_sec_change(date, 0, 1)) {
+	for (date = from, k = 0; date <= to && *limit != 0;
+	     date = date_sec_change(date, 0, 1), k = (k + 1) % 64) {
+		/* Skip days without items, looked up 64 days at a time. */
+		if (!k)
+			day_check_if_items(sec2date(date), 64, attr);
+		if (!attr[k])
+			continue;
 		day_store_items(date, 0, 1);
 		if (day_item_count(0) == 0)
 			continue;
@@ -287,6 +329,203 @@ date_arg_from_to(long from, long to, int add_line, const char *fmt_apt,
 	}
 }
 
+/*
+ * Compute the actual query range from the start date, end date and range
+ * given on the command line. A missing start date denotes the current day.
+ */
+static void
+get_query_range(time_t from, time_t to, int range, time_t *start, time_t *end)
+{
+	if (from == -1)
+		from = get_today();
+	if (to == -1)
+		to = ENDOFDAY(from);
+	if (range > 0)
+		to = date_sec_change(from, 0, range - 1);
+	else if (range < 0)
+		from = date_sec_change(to, 0, range + 1);
+
+	*start = from;
+	*end = to;
+}
+
+/* Check whether a format string contains the remaining time of an item. */
+static int format_has_remaining(const char *fmt)
+{
+	return strstr(fmt, "%r") || strstr(fmt, "%(remaining");
+}
+
+static void watch_stat(const char *path, struct stat *st)
+{
+	if (stat(path, st) != 0)
+		memset(st, 0, sizeof(struct stat));
+}
+
+static int watch_stat_changed(const char *path, struct stat *st)
+{
+	struct stat cur;
+
+	watch_stat(path, &cur);
+	return cur.st_dev != st->st_dev || cur.st_ino != st->st_ino ||
+	       cur.st_size != st->st_size || cur.st_mtime != st->st_mtime;
+}
+
+#ifdef HAVE_SYS_INOTIFY_H
+/* Watch the directory containing a file for files written or moved there. */
+static int watch_add_dir(int fd, const char *path)
+{
+	char *dir = mem_strdup(path), *sep;
+	int ret;
+
+	sep = strrchr(dir, '/');
+	if (sep == dir)
+		sep[1] = '\0';
+	else if (sep)
+		*sep = '\0';
+	ret = inotify_add_watch(fd, sep ? dir : ".",
+				IN_CLOSE_WRITE | IN_MOVED_TO) >= 0;
+	mem_free(dir);
+
+	return ret;
+}
+#endif
+
+/*
+ * Set up --watch. Where inotify is available, the directories of the data
+ * files are watched so that changes are noticed without polling. With a
+ * virtual clock, the data files are polled on the clock's time instead.
+ */
+static void watch_init(struct watch *w)
+{
+	w->inotify_fd = -1;
+	w->output = NULL;
+#ifdef HAVE_SYS_INOTIFY_H
+	if (vclock_virtual())
+		return;
+	w->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (w->inotify_fd >= 0 && (!watch_add_dir(w->inotify_fd, path_apts) ||
+				   !watch_add_dir(w->inotify_fd, path_todo))) {
+		close(w->inotify_fd);
+		w->inotify_fd = -1;
+	}
+#endif
+}
+
+/*
+ * Wait for the data files to be modified, for at most the given number of
+ * seconds. Events of other files in the same directories end the wait too;
+ * the caller compares the data files to their previous state.
+ */
+static void watch_wait(struct watch *w, time_t secs)
+{
+#ifdef HAVE_SYS_INOTIFY_H
+	struct pollfd pfd;
+	char buf[BUFSIZ];
+
+	if (w->inotify_fd >= 0) {
+		pfd.fd = w->inotify_fd;
+		pfd.events = POLLIN;
+		if (poll(&pfd, 1, MIN(secs, INT_MAX / 1000) * 1000) > 0) {
+			while (read(w->inotify_fd, buf, sizeof(buf)) > 0)
+				;
+		}
+		return;
+	}
+#endif
+	psleep(MIN(secs, WATCH_INTERVAL));
+}
+
+/*
+ * Start a --watch iteration: remember the state of the data files, and
+ * redirect the standard output into a temporary file.
+ */
+static void watch_begin(struct watch *w)
+{
+	watch_stat(path_apts, &w->apts_st);
+	watch_stat(path_todo, &w->todo_st);
+
+	fflush(stdout);
+	w->capture = tmpfile();
+	EXIT_IF(!w->capture, _("cannot create temporary file"));
+	w->stdout_fd = dup(STDOUT_FILENO);
+	EXIT_IF(w->stdout_fd < 0 ||
+		dup2(fileno(w->capture), STDOUT_FILENO) < 0,
+		_("cannot redirect standard output"));
+}
+
+/*
+ * Return the next point in time at which the output of a query might change
+ * without the data files being modified: the start of the next appointment
+ * or midnight. If the output contains the time remaining until an
+ * appointment starts, it changes every minute.
+ */
+static time_t watch_next_change(int minutely)
+{
+	struct notify_app next_app;
+	const time_t t = now();
+	time_t wake = date_sec_change(get_today(), 0, 1);
+	long left = 0;
+
+	next_app.time = date_sec_change(t, 0, 1);
+	next_app.got_app = 0;
+	next_app.txt = NULL;
+
+	recur_apoint_check_next(&next_app, t, get_today());
+	next_app = *apoint_check_next(&next_app, t);
+
+	if (next_app.got_app) {
+		mem_free(next_app.txt);
+		wake = MIN(wake, next_app.time);
+		left = next_app.time - t;
+	}
+	if (minutely)
+		wake = MIN(wake, t + (left % MININSEC ? left % MININSEC :
+				      MININSEC));
+
+	return wake;
+}
+
+/*
+ * Finish a --watch iteration: print the captured output if it differs from
+ * the one printed last, and wait until either the data files are modified or
+ * the given point in time is reached.
+ */
+static void watch_end(struct watch *w, time_t wake)
+{
+	struct string sb;
+	char buf[BUFSIZ];
+	size_t n;
+	time_t t;
+
+	fflush(stdout);
+	dup2(w->stdout_fd, STDOUT_FILENO);
+	close(w->stdout_fd);
+
+	string_init(&sb);
+	rewind(w->capture);
+	while ((n = fread(buf, 1, sizeof(buf), w->capture)) > 0)
+		string_append_bytes(&sb, buf, n);
+	fclose(w->capture);
+
+	if (!w->output || strcmp(w->output, string_buf(&sb)) != 0) {
+		/* Print an empty line if there is nothing left to show. */
+		fputs(*string_buf(&sb) ? string_buf(&sb) : "\n", stdout);
+		fflush(stdout);
+		if (w->output)
+			mem_free(w->output);
+		w->output = string_buf(&sb);
+	} else {
+		mem_free(string_buf(&sb));
+	}
+
+	while ((t = now()) < wake && !vclock_expired()) {
+		watch_wait(w, wake - t);
+		if (watch_stat_changed(path_apts, &w->apts_st) ||
+		    watch_stat_changed(path_todo, &w->todo_st))
+			break;
+	}
+}
+
 /*
  * Convert a string with a (local time) date, date-time or time into
  * the Unix time for that point in time as follows:
@@ -405,15 +644,18 @@ int parse_args(int argc, char **argv)
 	/* Command-line flags - NOTE that read_only is global */
 	int grep = 0, grep_filter = 0, purge = 0, query = 0, next = 0;
 	int status = 0, gc = 0, import = 0, export = 0, daemon = 0;
+	int pack = 0, archive = 0, watch = 0;
 	/* Command line invocation */
 	int filter_opt = 0, format_opt = 0, query_range = 0, cmd_line = 0;
 	int start_from = 0, start_to = 0, end_from = 0, end_to = 0;
 	/* Query ranges */
 	time_t from = -1, to = -1;
 	int range = 0;
-	int limit = INT_MAX;
+	time_t start, end;
+	int limit = INT_MAX, count;
 	/* Filters */
-	struct item_filter filter = { 0, 0, NULL, NULL, -1, -1, -1, -1, 0, 0, 0 };
+	struct item_filter filter = { 0, 0, NULL, NULL, -1, -1, -1, -1, 0, 0, 0, -1,
+				      -1, -1 };
 	/* Format strings */
 	const char *fmt_apt = NULL;
 	const char *fmt_rapt = NULL;
@@ -427,9 +669,11 @@ int parse_args(int argc, char **argv)
 	const char *datadir = NULL;
 	const char *cfile = NULL, *confdir = NULL;
 	char *ifile = NULL;
+	const char *daemon_dirs = NULL;
 
 	int ret, non_interactive = 1;
-	int ch, cpid, type;
+	int ch, cpid, type, add_line, reload;
+	struct watch w = { 0 };
 	regex_t reg;
 	char buf[BUFSIZ];
 	struct tm tm;
@@ -439,6 +683,7 @@ int parse_args(int argc, char **argv)
 
 	struct option longopts[] = {
 		{"appointment", no_argument, NULL, 'a'},
+		{"archive", no_argument, NULL, OPT_ARCHIVE},
 		{"calendar", required_argument, NULL, 'c'},
 		/* Deprecated */
 		{"conf", required_argument, NULL, 'C'},
@@ -497,6 +742,13 @@ int parse_args(int argc, char **argv)
 		{"daemon", no_argument, NULL, OPT_DAEMON},
 		{"input-datefmt", required_argument, NULL, OPT_INPUT_DATEFMT},
 		{"output-datefmt", required_argument, NULL, OPT_OUTPUT_DATEFMT},
+		{"pack-notes", no_argument, NULL, OPT_PACK_NOTES},
+		{"watch", no_argument, NULL, OPT_WATCH},
+		{"daemon-dirs", required_argument, NULL, OPT_DAEMON_DIRS},
+		/* Undocumented, for performance measurements. */
+		{"latency-log", required_argument, NULL, OPT_LATENCY_LOG},
+		{"bench", required_argument, NULL, OPT_BENCH},
+		{"virtual-clock", required_argument, NULL, OPT_VIRTUAL_CLOCK},
 		{NULL, no_argument, NULL, 0}
 	};
 
@@ -592,11 +844,14 @@ int parse_args(int argc, char **argv)
 			query = 1;
 			break;
 		case 's':
-			if (!optarg)
-				optarg = "today";
-			from = parse_datetimearg(optarg, &type);
-			EXIT_IF(from == -1 || type != ARG_DATE,
-				_("invalid date: %s"), optarg);
+			/* Without a date, the range starts on the current day. */
+			if (optarg) {
+				from = parse_datetimearg(optarg, &type);
+				EXIT_IF(from == -1 || type != ARG_DATE,
+					_("invalid date: %s"), optarg);
+			} else {
+				from = -1;
+			}
 			filter.type_mask |= TYPE_MASK_CAL;
 			query = 1;
 			break;
@@ -841,12 +1096,34 @@ int parse_args(int argc, char **argv)
 		case OPT_STATUS:
 			status = 1;
 			break;
+		case OPT_PACK_NOTES:
+			pack = 1;
+			break;
+		case OPT_ARCHIVE:
+			archive = 1;
+			break;
+		case OPT_WATCH:
+			watch = 1;
+			break;
 		case OPT_DAEMON:
 			EXIT_IF(cpid = io_get_pid(path_cpid),
 				_("calcurse is running (pid = %d)"), cpid);
 			daemon = 1;
 			filter.type_mask = TYPE_MASK_APPT | TYPE_MASK_RECUR_APPT;
 			break;
+		case OPT_DAEMON_DIRS:
+			daemon = 1;
+			daemon_dirs = optarg;
+			break;
+		case OPT_LATENCY_LOG:
+			latency_init(optarg);
+			break;
+		case OPT_BENCH:
+			bench_init(optarg);
+			break;
+		case OPT_VIRTUAL_CLOCK:
+			vclock_init(optarg);
+			break;
 		case OPT_INPUT_DATEFMT:
 			conf.input_datefmt = atoi(optarg);
 			EXIT_IF(conf.input_datefmt < 1 || conf.input_datefmt > 4,
@@ -870,25 +1147,20 @@ int parse_args(int argc, char **argv)
 	if (filter.type_mask == 0)
 		filter.type_mask = TYPE_MASK_ALL;
 
-	if (status + grep + query + next + gc + import + export + daemon > 1 ||
+	if (status + grep + query + next + gc + pack + archive + import +
+	    export + daemon > 1 ||
 	    optind < argc ||
 	    (filter_opt && !(grep + query + export)) ||
 	    (format_opt && !(grep + query + dump_imported)) ||
 	    (query_range && !query) ||
-	    (purge && !filter.invert)
+	    (purge && !filter.invert) ||
+	    (watch && !(query + next))
 	   )
 		EXIT(_("invalid argument combination"));
 
 	EXIT_IF(to >= 0 && range, _("cannot specify a range and an end date"));
-	if (from == -1)
-		from = get_today();
-	if (to == -1)
-		to = ENDOFDAY(from);
-	EXIT_IF(to < from, _("end date cannot come before start date"));
-	if (range > 0)
-		to = date_sec_change(from, 0, range - 1);
-	else if (range < 0)
-		from = date_sec_change(to, 0, range + 1);
+	get_query_range(from, to, range, &start, &end);
+	EXIT_IF(end < start, _("end date cannot come before start date"));
 
 	io_check_dir(path_ddir);
 	io_check_dir(path_notes);
@@ -902,9 +1174,9 @@ int parse_args(int argc, char **argv)
 		io_check_file(path_todo);
 		io_check_file(path_conf);
 		io_load_data(&filter, FORCE);
+		archive_load_all(&filter);
 		if (purge || grep_filter) {
-			io_save_todo(path_todo);
-			io_save_apts(path_apts);
+			io_save_data();
 		} else {
 			/*
 			 * Use default values for non-specified format strings.
@@ -922,7 +1194,6 @@ int parse_args(int argc, char **argv)
 		io_check_file(path_apts);
 		io_check_file(path_todo);
 		io_check_file(path_conf);
-		io_load_data(&filter, FORCE);
 
 		/* Use default values for non-specified format strings. */
 		fmt_apt = fmt_apt ? fmt_apt : " - %S -> %E\n\t%m\n";
@@ -930,19 +1201,77 @@ int parse_args(int argc, char **argv)
 		fmt_ev = fmt_ev ? fmt_ev : " * %m\n";
 		fmt_rev = fmt_rev ? fmt_rev : " * %m\n";
 		fmt_todo = fmt_todo ? fmt_todo : "%p. %m\n";
+		if (limit != INT_MAX)
+			filter.limit = limit;
+		/* A single query only needs the items of its range. */
+		if (!watch) {
+			filter.range_from = start;
+			filter.range_to = end;
+		}
+
+		/*
+		 * In watch mode, the query is rerun whenever its result might
+		 * have changed. Only modified data files are reloaded.
+		 */
+		if (watch)
+			watch_init(&w);
+		reload = FORCE;
+		do {
+			if (watch)
+				watch_begin(&w);
+			io_load_data(&filter, reload);
+			reload = 0;
 
-		int add_line = todo_arg(fmt_todo, &limit, &filter);
-		date_arg_from_to(from, to, add_line, fmt_apt, fmt_rapt, fmt_ev,
-				 fmt_rev, &limit);
+			get_query_range(from, to, range, &start, &end);
+			archive_load(sec2daynum(start), sec2daynum(end),
+				     &filter);
+			count = limit;
+			add_line = todo_arg(fmt_todo, &count, &filter);
+			date_arg_from_to(start, end, add_line, fmt_apt,
+					 fmt_rapt, fmt_ev, fmt_rev, &count);
+
+			if (watch)
+				watch_end(&w, watch_next_change(
+					format_has_remaining(fmt_apt) ||
+					format_has_remaining(fmt_rapt)));
+		} while (watch && !vclock_expired());
+	} else if (next && watch) {
+		io_check_file(path_apts);
+		io_check_file(path_todo);
+		watch_init(&w);
+		reload = FORCE;
+		while (!vclock_expired()) {
+			watch_begin(&w);
+			io_load_data(&filter, reload);
+			reload = 0;
+			next_arg();
+			watch_end(&w, watch_next_change(1));
+		}
 	} else if (next) {
 		io_check_file(path_apts);
+		filter.range_from = now();
+		filter.range_to = date_sec_change(filter.range_from, 0, 1);
 		io_load_app(&filter);
 		next_arg();
 	} else if (gc) {
 		io_check_file(path_apts);
 		io_check_file(path_todo);
 		io_load_data(NULL, FORCE);
-		note_gc();
+		archive_load_all(NULL);
+		note_gc_scan();
+	} else if (pack) {
+		io_check_file(path_apts);
+		io_check_file(path_todo);
+		io_load_data(NULL, FORCE);
+		archive_load_all(NULL);
+		note_pack();
+	} else if (archive) {
+		EXIT_IF(conf.archive_horizon == 0,
+			_("no archive horizon set, see general.archivehorizon"));
+		io_check_file(path_apts);
+		io_check_file(path_todo);
+		io_load_data(NULL, FORCE);
+		io_save_data();
 	} else if (import) {
 		io_check_file(path_apts);
 		io_check_file(path_todo);
@@ -965,15 +1294,17 @@ int parse_args(int argc, char **argv)
 		}
 		ret = io_import_data(IO_IMPORT_ICAL, ifile, fmt_ev, fmt_rev,
 				     fmt_apt, fmt_rapt, fmt_todo);
-		io_save_apts(path_apts);
-		io_save_todo(path_todo);
+		io_save_data();
 		if (!ret)
 			exit_calcurse(EXIT_FAILURE);
 	} else if (export) {
 		io_check_file(path_apts);
 		io_check_file(path_todo);
 		io_load_data(&filter, FORCE);
+		archive_load_all(&filter);
 		io_export_data(xfmt, export_uid);
+	} else if (daemon_dirs) {
+		dmon_start_multi(daemon_dirs);
 	} else if (daemon) {
 		dmon_stop();
 		dmon_start(0);
@@ -0,0 +1,344 @@
+/*
+ * Calcurse - text-based organizer
+ *
+ * Copyright (c) 2004-2022 calcurse Development Team <misc@calcurse.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the
+ *        following disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the
+ *        following disclaimer in the documentation and/or other
+ *        materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Send your feedback or comments to : misc@calcurse.org
+ * Calcurse home page : http://calcurse.org
+ *
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "calcurse.h"
+
+#include <sys/ioctl.h>
+
+/*
+ * Scripted benchmark of the interactive user interface.
+ *
+ * The full interface is run on a virtual terminal of fixed size whose output
+ * goes to /dev/null and whose input is a pipe. The steps of a script are fed
+ * into the pipe one run at a time; a run is complete as soon as calcurse has
+ * consumed all of its keys and waits for input again. calcurse exits once the
+ * last run is complete and prints the time spent in each step.
+ *
+ * A script consists of the following lines, empty lines and lines starting
+ * with '#' are ignored:
+ *
+ *   size <rows> <columns>
+ *   step <label> <runs> <keys>
+ *
+ * The keys are the remainder of the line, in which "\n", "\t", "\e", "\\" and
+ * "^X" (for the control character X) are replaced accordingly.
+ */
+
+#define BENCH_ROWS	24
+#define BENCH_COLS	80
+
+struct bench_step {
+	char *label;
+	char *keys;
+	size_t len;
+	unsigned runs, done;
+	unsigned long long sum;
+	unsigned min, max;
+	unsigned allocs;
+};
+
+static llist_t bench_steps;
+static llist_item_t *bench_cur;
+static const char *bench_path;
+static int bench_rows = BENCH_ROWS, bench_cols = BENCH_COLS;
+static int bench_fd[2] = { -1, -1 };
+static FILE *bench_out;
+static struct timespec bench_start_ts;
+#ifdef CALCURSE_MEMORY_DEBUG
+static unsigned bench_start_allocs;
+#endif
+
+static void bench_step_free(struct bench_step *step)
+{
+	mem_free(step->label);
+	mem_free(step->keys);
+	mem_free(step);
+}
+
+/* Replace escape sequences in place and return the resulting length. */
+static size_t bench_unescape(char *s)
+{
+	char *p = s, *q = s;
+
+	while (*p) {
+		if (*p == '\\' && p[1]) {
+			p++;
+			switch (*p) {
+			case 'n':
+				*q++ = '\n';
+				break;
+			case 't':
+				*q++ = '\t';
+				break;
+			case 'e':
+				*q++ = '\033';
+				break;
+			default:
+				*q++ = *p;
+				break;
+			}
+			p++;
+		} else if (*p == '^' && p[1]) {
+			*q++ = p[1] == '?' ? 0x7f : p[1] & 0x1f;
+			p += 2;
+		} else {
+			*q++ = *p++;
+		}
+	}
+	*q = '\0';
+
+	return q - s;
+}
+
+static void bench_parse_step(char *line, int lineno)
+{
+	struct bench_step *step;
+	char *label, *runs, *keys, *end;
+	long n;
+
+	label = strtok_r(line, " \t", &keys);
+	runs = label ? strtok_r(NULL, " \t", &keys) : NULL;
+	EXIT_IF(!runs || !keys || *keys == '\0',
+		_("%s:%d: usage: step <label> <runs> <keys>"), bench_path,
+		lineno);
+	n = strtol(runs, &end, 10);
+	EXIT_IF(*end != '\0' || n < 1 || n > INT_MAX,
+		_("%s:%d: invalid number of runs: %s"), bench_path, lineno,
+		runs);
+
+	step = mem_calloc(1, sizeof(struct bench_step));
+	step->label = mem_strdup(label);
+	step->keys = mem_strdup(keys);
+	step->len = bench_unescape(step->keys);
+	step->runs = n;
+	step->min = UINT_MAX;
+	LLIST_ADD(&bench_steps, step);
+}
+
+/*
+ * Load a benchmark script. The interface is started on a virtual terminal and
+ * no data is written back, as if calcurse was started in read-only mode.
+ */
+void bench_init(const char *path)
+{
+	FILE *fp;
+	char buf[BUFSIZ], *p;
+	int lineno = 0;
+
+	fp = fopen(path, "r");
+	EXIT_IF(!fp, _("failed to open benchmark script %s"), path);
+	bench_path = path;
+	LLIST_INIT(&bench_steps);
+
+	while (fgets(buf, BUFSIZ, fp)) {
+		lineno++;
+		if ((p = strchr(buf, '\n')))
+			*p = '\0';
+		for (p = buf; *p == ' ' || *p == '\t'; p++) ;
+		if (*p == '\0' || *p == '#')
+			continue;
+		if (starts_with(p, "size ")) {
+			EXIT_IF(sscanf(p + 5, "%d %d", &bench_rows,
+				       &bench_cols) != 2 || bench_rows < 1 ||
+				bench_cols < 1,
+				_("%s:%d: usage: size <rows> <columns>"),
+				path, lineno);
+		} else if (starts_with(p, "step ")) {
+			bench_parse_step(p + 5, lineno);
+		} else {
+			EXIT(_("%s:%d: unknown directive: %.*s"), path, lineno,
+			     (int)MIN(strcspn(p, " \t"), 32), p);
+		}
+	}
+	file_close(fp, __FILE_POS__);
+	EXIT_IF(!LLIST_FIRST(&bench_steps),
+		_("benchmark script %s contains no steps"), path);
+
+	read_only = 1;
+}
+
+/*
+ * Start the curses mode on the virtual terminal if a benchmark is to be run.
+ * Return 0 if no benchmark is set up.
+ */
+int bench_newterm(void)
+{
+	char buf[16];
+
+	if (!bench_path)
+		return 0;
+
+	/*
+	 * The size of a terminal without window size ioctl is taken from the
+	 * environment, also when the screen is reset later on.
+	 */
+	snprintf(buf, sizeof(buf), "%d", bench_rows);
+	setenv("LINES", buf, 1);
+	snprintf(buf, sizeof(buf), "%d", bench_cols);
+	setenv("COLUMNS", buf, 1);
+
+	/* The pipe replaces the standard input, where keys are waited for. */
+	EXIT_IF(pipe(bench_fd) != 0, _("could not create pipe: %s"),
+		strerror(errno));
+	fcntl(bench_fd[1], F_SETFL, fcntl(bench_fd[1], F_GETFL) | O_NONBLOCK);
+	EXIT_IF(dup2(bench_fd[0], STDIN_FILENO) < 0,
+		_("could not set up the virtual terminal"));
+	if (bench_fd[0] != STDIN_FILENO)
+		close(bench_fd[0]);
+	bench_fd[0] = STDIN_FILENO;
+	bench_out = fopen("/dev/null", "w");
+	EXIT_IF(!bench_out, _("could not set up the virtual terminal"));
+	EXIT_IF(!newterm(NULL, bench_out, stdin),
+		_("could not set up the virtual terminal"));
+
+	return 1;
+}
+
+static void bench_record(void)
+{
+	struct bench_step *step = LLIST_GET_DATA(bench_cur);
+	struct timespec now;
+	long long us;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	us = (long long)(now.tv_sec - bench_start_ts.tv_sec) * 1000000 +
+	     (now.tv_nsec - bench_start_ts.tv_nsec) / 1000;
+	if (us > UINT_MAX)
+		us = UINT_MAX;
+
+	step->sum += us;
+	if (us < step->min)
+		step->min = us;
+	if (us > step->max)
+		step->max = us;
+#ifdef CALCURSE_MEMORY_DEBUG
+	step->allocs += mem_ncalls() - bench_start_allocs;
+#endif
+	step->done++;
+}
+
+/*
+ * Feed the keys of the next run into the virtual terminal once calcurse has
+ * consumed the previous ones. Called whenever calcurse waits for a key.
+ */
+void bench_feed(void)
+{
+	struct bench_step *step;
+	int pending;
+
+	if (bench_fd[1] < 0)
+		return;
+	if (ioctl(bench_fd[0], FIONREAD, &pending) == 0 && pending > 0)
+		return;
+	/* Do not count the time needed to load the data files. */
+	if (!bench_cur && io_loading())
+		return;
+
+	if (bench_cur) {
+		bench_record();
+		step = LLIST_GET_DATA(bench_cur);
+		if (step->done == step->runs)
+			bench_cur = LLIST_NEXT(bench_cur);
+		if (!bench_cur)
+			exit_calcurse(EXIT_SUCCESS);
+	} else {
+		bench_cur = LLIST_FIRST(&bench_steps);
+	}
+
+	step = LLIST_GET_DATA(bench_cur);
+	EXIT_IF(write(bench_fd[1], step->keys, step->len) !=
+		(ssize_t)step->len, _("%s: keys of step %s do not fit "
+		"into the input buffer"), bench_path, step->label);
+#ifdef CALCURSE_MEMORY_DEBUG
+	bench_start_allocs = mem_ncalls();
+#endif
+	clock_gettime(CLOCK_MONOTONIC, &bench_start_ts);
+}
+
+/* Print the time spent in each step, in milliseconds. */
+static void bench_dump(FILE *fp)
+{
+	llist_item_t *i;
+	struct bench_step *step;
+	unsigned long long total = 0;
+
+	fprintf(fp, "%-24s %6s %10s %9s %9s %9s", "step", "runs", "total",
+		"mean", "min", "max");
+#ifdef CALCURSE_MEMORY_DEBUG
+	fprintf(fp, " %9s", "allocs");
+#endif
+	fputc('\n', fp);
+
+	LLIST_FOREACH(&bench_steps, i) {
+		step = LLIST_GET_DATA(i);
+		if (!step->done)
+			continue;
+		total += step->sum;
+		fprintf(fp, "%-24s %6u %10.3f %9.3f %9.3f %9.3f", step->label,
+			step->done, step->sum / 1000.0,
+			(double)step->sum / step->done / 1000.0,
+			step->min / 1000.0, step->max / 1000.0);
+#ifdef CALCURSE_MEMORY_DEBUG
+		fprintf(fp, " %9u", step->allocs);
+#endif
+		fputc('\n', fp);
+	}
+	fprintf(fp, "%-24s %6s %10.3f\n", "total", "", total / 1000.0);
+}
+
+/* Print the results of a benchmark, if any, and free its resources. */
+void bench_exit(void)
+{
+	if (!bench_path)
+		return;
+
+	printf(_("Benchmark on a %dx%d terminal:\n"), bench_cols, bench_rows);
+	bench_dump(stdout);
+
+	LLIST_FREE_INNER(&bench_steps, bench_step_free);
+	LLIST_FREE(&bench_steps);
+	if (bench_fd[1] >= 0)
+		close(bench_fd[1]);
+	bench_fd[1] = -1;
+	bench_path = NULL;
+}
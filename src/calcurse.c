@@ -42,6 +42,9 @@
 
 int count, reg;
 
+/* Set while the data files are loaded during startup. */
+static int loading;
+
 static inline void key_generic_change_view(void)
 {
 	wins_reset_status_page();
@@ -250,21 +253,40 @@ static inline void key_generic_help(void)
 	wins_update(FLAG_ALL);
 }
 
-static inline void key_generic_save(void)
+/*
+ * Rebuild the state derived from the reloaded items, given as a mask of
+ * TYPE_MASK_CAL and TYPE_MASK_TODO, and redraw the panels showing them.
+ */
+static void update_reloaded(int loaded)
 {
-	char *msg = NULL;
-	int ret;
-
-	ret = io_save_cal(interactive);
+	int flags = FLAG_STA;
 
-	if (ret == IO_SAVE_RELOAD) {
+	if (loaded & TYPE_MASK_TODO) {
 		ui_todo_load_items();
 		ui_todo_sel_reset();
+		flags |= FLAG_TOD;
+	}
+	if (loaded & TYPE_MASK_CAL) {
 		day_do_storage(0);
 		notify_check_next_app(1);
 		ui_calendar_monthly_view_cache_set_invalid();
+		flags |= FLAG_CAL | FLAG_APP | FLAG_NOT;
 	}
-	wins_update(FLAG_ALL);
+	wins_update(flags);
+}
+
+static inline void key_generic_save(void)
+{
+	char *msg = NULL;
+	int ret;
+
+	ret = io_save_cal(interactive);
+
+	/* A merge changes both data files. */
+	if (ret == IO_SAVE_RELOAD)
+		update_reloaded(TYPE_MASK_ALL);
+	else
+		wins_update(FLAG_ALL);
 	switch (ret) {
 	case IO_SAVE_CTINUE:
 		msg = _("Data were saved successfully");
@@ -287,19 +309,10 @@ static inline void key_generic_save(void)
 static inline void key_generic_reload(void)
 {
 	char *msg = NULL;
-	int ret;
+	int ret, loaded;
 
-	ret = io_reload_data();
-	if (ret == IO_RELOAD_LOAD ||
-	    ret == IO_RELOAD_CTINUE ||
-	    ret == IO_RELOAD_MERGE) {
-		ui_todo_load_items();
-		ui_todo_sel_reset();
-		day_do_storage(0);
-		notify_check_next_app(1);
-		ui_calendar_monthly_view_cache_set_invalid();
-	}
-	wins_update(FLAG_ALL);
+	ret = io_reload_data(&loaded);
+	update_reloaded(loaded);
 	switch (ret) {
 	case IO_RELOAD_LOAD:
 	case IO_RELOAD_CTINUE:
@@ -389,17 +402,22 @@ static inline void key_generic_prev_week(void)
 
 static inline void key_move_up(void)
 {
+	int n;
+
 	if (wins_slctd() == CAL) {
 		key_generic_prev_week();
 	} else if (wins_slctd() == APP) {
-		if (!ui_day_sel_move(-1)) {
-			ui_calendar_move(DAY_PREV, 1);
-			day_do_storage(1);
-			ui_day_sel_dayend();
+		for (n = 0; n < count; n++) {
+			if (!ui_day_sel_move(-1)) {
+				ui_calendar_move(DAY_PREV, 1);
+				day_do_storage(1);
+				ui_day_sel_dayend();
+			}
 		}
 		wins_update(FLAG_APP | FLAG_CAL);
 	} else if (wins_slctd() == TOD) {
-		ui_todo_sel_move(-1);
+		for (n = 0; n < count; n++)
+			ui_todo_sel_move(-1);
 		wins_update(FLAG_TOD);
 	}
 }
@@ -413,17 +431,22 @@ static inline void key_generic_next_week(void)
 
 static inline void key_move_down(void)
 {
+	int n;
+
 	if (wins_slctd() == CAL) {
 		key_generic_next_week();
 	} else if (wins_slctd() == APP) {
-		if (!ui_day_sel_move(1)) {
-			ui_calendar_move(DAY_PREV, day_get_days() - 2);
-			day_do_storage(1);
-			ui_day_sel_daybegin(day_get_days() - 1);
+		for (n = 0; n < count; n++) {
+			if (!ui_day_sel_move(1)) {
+				ui_calendar_move(DAY_PREV, day_get_days() - 2);
+				day_do_storage(1);
+				ui_day_sel_daybegin(day_get_days() - 1);
+			}
 		}
 		wins_update(FLAG_APP | FLAG_CAL);
 	} else if (wins_slctd() == TOD) {
-		ui_todo_sel_move(1);
+		for (n = 0; n < count; n++)
+			ui_todo_sel_move(1);
 		wins_update(FLAG_TOD);
 	}
 }
@@ -687,6 +710,27 @@ cleanup:
 	wins_update(FLAG_ALL);
 }
 
+/* Fill in the panels and start the other threads once the data are loaded. */
+static void finish_loading(void)
+{
+	io_stop_load_thread();
+	EXIT_IF(io_load_thread_error(), "%s", io_load_thread_error());
+	loading = 0;
+
+	ui_calendar_monthly_view_cache_set_invalid();
+	day_do_storage(1);
+	ui_todo_load_items();
+	ui_todo_sel_reset();
+	wins_update(FLAG_ALL);
+
+	/* Start miscellaneous threads. */
+	if (notify_bar())
+		notify_start_main_thread();
+	ui_calendar_start_date_thread();
+	if (conf.periodic_save > 0)
+		io_start_psave_thread();
+}
+
 /*
  * Calcurse is a text-based personal organizer which helps keeping track
  * of events and everyday tasks. It contains a calendar, a 'todo' list,
@@ -710,6 +754,8 @@ int main(int argc, char **argv)
 		/* Non-interactive mode. */
 		exit_calcurse(EXIT_SUCCESS);
 	} else {
+		EXIT_IF(vclock_stepped(), _("the virtual clock needs a rate "
+			"in interactive mode"));
 		io_check_data_files();
 		dmon_stop();
 		io_set_lock();
@@ -720,7 +766,8 @@ int main(int argc, char **argv)
 
 	/* Begin of interactive mode with ncurses interface. */
 	sigs_init();		/* signal handling init */
-	initscr();		/* start the curses mode */
+	if (!bench_newterm())
+		initscr();	/* start the curses mode */
 	cbreak();		/* control chars generate a signal */
 	noecho();		/* controls echoing of typed chars */
 	curs_set(0);		/* make cursor invisible */
@@ -772,7 +819,6 @@ int main(int argc, char **argv)
 	config_load();
 	wins_erase_status_bar();
 	io_load_keys(conf.pager);
-	io_load_data(NULL, FORCE);
 	wins_slctd_set(conf.default_panel);
 	wins_resize();
 	/*
@@ -780,23 +826,25 @@ int main(int argc, char **argv)
 	 * implicitly calling wrefresh() later (causing ncurses race conditions).
 	 */
 	wins_wrefresh(win[KEY].p);
-	ui_calendar_monthly_view_cache_set_invalid();
-	day_do_storage(1);
-	ui_todo_load_items();
-	ui_todo_sel_reset();
-	wins_update(FLAG_ALL);
 
-	/* Start miscellaneous threads. */
-	if (notify_bar())
-		notify_start_main_thread();
-	ui_calendar_start_date_thread();
-	if (conf.periodic_save > 0)
-		io_start_psave_thread();
+	/*
+	 * Draw the user interface while the appointments and the todo list are
+	 * loaded in the background. The panels are filled in once loading is
+	 * complete; any key press other than a resize waits for it.
+	 */
+	io_start_load_thread();
+	loading = 1;
+	wins_update(FLAG_ALL);
+	if (io_loading())
+		status_mesg(_("Loading data..."), "");
 
 	/* User input */
 	for (;;) {
 		int key;
 
+		if (loading && (!io_loading() || que_ued() || want_reload))
+			finish_loading();
+
 		while (que_ued()) {
 			que_show();
 			if (conf.systemevents) {
@@ -810,7 +858,7 @@ int main(int argc, char **argv)
 		if (resize) {
 			resize = 0;
 			wins_reset();
-			if (conf.multiple_days) {
+			if (conf.multiple_days && !loading) {
 				day_do_storage(0);
 				wins_update(FLAG_APP);
 			}
@@ -821,10 +869,21 @@ int main(int argc, char **argv)
 			key_generic_reload();
 		}
 
-		/* Check input loop once every minute. */
-		wtimeout(win[KEY].p, 60000);
+		if (note_preview_updated())
+			wins_update(FLAG_APP | FLAG_TOD);
+
+		/*
+		 * Check input loop once every minute, or frequently while data
+		 * or note previews are being loaded.
+		 */
+		wtimeout(win[KEY].p, loading || note_preview_pending() ?
+			 100 : 60000);
 		key = keys_get(win[KEY].p, &count, &reg);
 		wtimeout(win[KEY].p, -1);
+		if (key != ERR)
+			latency_start(key);
+		if (loading && key != ERR && key != KEY_RESIZE)
+			finish_loading();
 		switch (key) {
 		HANDLE_KEY(KEY_GENERIC_CHANGE_VIEW, key_generic_change_view);
 		HANDLE_KEY(KEY_GENERIC_PREV_VIEW, key_generic_prev_view);
@@ -51,6 +51,8 @@
 
 #include <pthread.h>
 #include <time.h>
+#include <sys/stat.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <regex.h>
@@ -92,8 +94,13 @@
 #define KEYS_PATH_NAME   "keys"
 #define CPID_PATH_NAME   ".calcurse.pid"
 #define DPID_PATH_NAME   ".daemon.pid"
+#define LOCK_PATH_NAME   ".calcurse.lock"
+#define SPOOL_PATH_NAME  ".reminders"
+#define ARCHIVE_PATH_SUFFIX ".archive"
 #define DLOG_PATH_NAME   "daemon.log"
 #define NOTES_DIR_NAME   "notes/"
+#define NOTES_PACK_NAME  ".pack"
+#define NOTES_INDEX_NAME ".pack.idx"
 #define HOOKS_DIR_NAME   "hooks/"
 
 #define DEFAULT_EDITOR     "vi"
@@ -175,6 +182,9 @@
 /* Size of the hash table the note garbage collector uses. */
 #define NOTE_GC_HSIZE 1024
 
+/* Size of the hash table of the note preview cache. */
+#define NOTE_PREVIEW_HSIZE 128
+
 /* Mnemonics */
 #define NOHILT		0 	/* 'No highlight' argument */
 #define NOFORCE		0
@@ -285,11 +295,13 @@ struct conf {
 	unsigned auto_save;
 	unsigned auto_gc;
 	unsigned periodic_save;
+	unsigned archive_horizon;	/* days before items are archived */
 	unsigned systemevents;
 	unsigned confirm_quit;
 	unsigned confirm_delete;
 	enum win default_panel;
 	unsigned compact_panels;
+	unsigned note_preview;
 	unsigned multiple_days;
 	unsigned header_line;
 	unsigned event_separator;
@@ -403,7 +415,8 @@ enum recur_type {
 struct rpt {
 	enum recur_type type;	/* FREQ */
 	int freq;		/* INTERVAL */
-	time_t until;		/* UNTIL */
+	time_t until;		/* UNTIL, derived from COUNT if that is set */
+	int count;		/* COUNT, 0 if not set */
 	llist_t bymonth;	/* BYMONTH list */
 	llist_t bywday;		/* BY(WEEK)DAY list */
 	llist_t bymonthday;	/* BYMONTHDAY list */
@@ -493,6 +506,9 @@ struct item_filter {
 	int priority;
 	int completed;
 	int uncompleted;
+	int limit;		/* number of todo items to keep, -1 for all */
+	time_t range_from;	/* days queried, -1 to load all appointments */
+	time_t range_to;
 };
 
 /* Generic item description (to hold appointments, events...). */
@@ -588,22 +604,6 @@ enum vkey {
 #define FLAG_STA (1 << STA)
 #define FLAG_ALL ((1 << NBWINS) - 1)
 
-#define WINS_NBAR_LOCK \
-  pthread_cleanup_push(wins_nbar_cleanup, NULL); \
-  wins_nbar_lock();
-
-#define WINS_NBAR_UNLOCK \
-  wins_nbar_unlock(); \
-  pthread_cleanup_pop(0);
-
-#define WINS_CALENDAR_LOCK \
-  pthread_cleanup_push(wins_calendar_cleanup, NULL); \
-  wins_calendar_lock();
-
-#define WINS_CALENDAR_UNLOCK \
-  wins_calendar_unlock(); \
-  pthread_cleanup_pop(0);
-
 enum ui_mode {
 	UI_CURSES,
 	UI_CMDLINE,
@@ -632,6 +632,9 @@ struct scrollwin {
 	const char *label;
 };
 
+/* Callback used to render a list item to a stream, see io_render_list(). */
+typedef void (*io_render_cb_t) (FILE *, void *, void *);
+
 /* Generic list box structure. */
 enum listbox_row_type {
 	LISTBOX_ROW_TEXT,
@@ -685,6 +688,12 @@ struct string {
 	int len;
 };
 
+/* Maximum number of characters written by the fmt_*() emitters. */
+#define FMT_UINT_MAX     10
+#define FMT_INT_MAX      (FMT_UINT_MAX + 1)
+#define FMT_DATE_MAX     (FMT_UINT_MAX + 6)
+#define FMT_DATETIME_MAX (FMT_DATE_MAX + 8)
+
 /* Return codes for the getstring() function. */
 enum getstr {
 	GETSTRING_VALID,
@@ -775,6 +784,14 @@ enum export_type {
 	IO_EXPORT_NBTYPES
 };
 
+/* Events counted while a virtual clock is in use. */
+enum vclock_event {
+	VCLOCK_WAKEUP,
+	VCLOCK_SCAN,
+	VCLOCK_COMMAND,
+	VCLOCK_NB_EVENTS
+};
+
 /* apoint.c */
 extern llist_ts_t alist_p;
 void apoint_free_bkp(void);
@@ -785,16 +802,28 @@ void apoint_llist_free(void);
 struct apoint *apoint_new(char *, char *, time_t, long, char);
 unsigned apoint_inday(struct apoint *, time_t *);
 void apoint_sec2str(struct apoint *, time_t, char *, char *);
+void apoint_serialize(struct apoint *, struct string *);
 char *apoint_tostr(struct apoint *);
 char *apoint_hash(struct apoint *);
 void apoint_write(struct apoint *, FILE *);
-char *apoint_scan(FILE *, struct tm, struct tm, char, char *,
+char *apoint_scan(char *, struct tm, struct tm, char, char *,
 			   struct item_filter *);
 void apoint_delete(struct apoint *);
 struct notify_app *apoint_check_next(struct notify_app *, time_t);
 void apoint_switch_notify(struct apoint *);
 void apoint_paste_item(struct apoint *, time_t);
 
+/* archive.c */
+void archive_open(void);
+void archive_free(void);
+int archive_changed(void);
+void archive_load(long, long, struct item_filter *);
+void archive_load_all(struct item_filter *);
+int archive_cold(time_t, long, struct rpt *);
+int archive_save_prepare(int);
+int archive_write(FILE *);
+void archive_save_done(int);
+
 /* args.c */
 int parse_args(int, char **);
 
@@ -861,6 +890,7 @@ void day_write_stdout(time_t, const char *, const char *, const char *,
 void day_do_storage(int day_changed);
 void day_popup_item(struct day_item *);
 int day_check_if_item(struct date);
+void day_check_if_items(struct date, int, int *);
 unsigned day_chk_busy_slices(struct date, int, int *);
 struct day_item *day_cut_item(int);
 int day_paste_item(struct day_item *, time_t);
@@ -872,6 +902,7 @@ void day_item_switch_notify(struct day_item *);
 
 /* dmon.c */
 void dmon_start(int);
+void dmon_start_multi(const char *);
 void dmon_stop(void);
 
 /* event.c */
@@ -884,10 +915,11 @@ void event_llist_init(void);
 void event_llist_free(void);
 struct event *event_new(char *, char *, time_t, int);
 unsigned event_inday(struct event *, time_t *);
+void event_serialize(struct event *, struct string *);
 char *event_tostr(struct event *);
 char *event_hash(struct event *);
 void event_write(struct event *, FILE *);
-char *event_scan(FILE *, struct tm, int, char *, struct item_filter *);
+char *event_scan(char *, struct tm, int, char *, struct item_filter *);
 void event_delete(struct event *);
 void event_paste_item(struct event *, time_t);
 int event_dummy(struct day_item *);
@@ -916,12 +948,20 @@ void io_dump_apts(const char *, const char *, const char *, const char *);
 unsigned io_save_apts(const char *);
 void io_dump_todo(const char *);
 unsigned io_save_todo(const char *);
+unsigned io_save_data(void);
+unsigned io_save_spool(const struct stat *);
 unsigned io_save_keys(void);
+int io_compute_hash(const char *, char *);
 int io_save_cal(enum save_type);
 void io_load_app(struct item_filter *);
+void io_load_app_buf(char *, size_t, const char *, struct item_filter *);
+char *io_load_app_noexit(struct item_filter *);
+void io_load_error(const char *, unsigned, const char *);
+char *io_data_str(char *);
+void io_data_str_free(char *);
 void io_load_todo(struct item_filter *);
 int io_load_data(struct item_filter *, int);
-int io_reload_data(void);
+int io_reload_data(int *);
 void io_load_keys(const char *);
 int io_check_dir(const char *);
 unsigned io_dir_exists(const char *);
@@ -935,6 +975,11 @@ struct io_file *io_log_init(void);
 void io_log_print(struct io_file *, int, const char *);
 void io_log_display(struct io_file *, const char *, const char *);
 void io_log_free(struct io_file *);
+int io_render_list(FILE *, llist_item_t *, io_render_cb_t, void *);
+void io_start_load_thread(void);
+int io_loading(void);
+void io_stop_load_thread(void);
+const char *io_load_thread_error(void);
 void io_start_psave_thread(void);
 void io_stop_psave_thread(void);
 void io_set_lock(void);
@@ -953,6 +998,7 @@ void keys_dump_defaults(char *);
 const char *keys_get_label(enum vkey);
 const char *keys_get_binding(enum vkey);
 enum vkey keys_get_action(int);
+void keys_idle(void);
 int keys_wgetch(WINDOW *);
 void keys_wait_for_any_key(WINDOW *);
 enum vkey keys_get(WINDOW * win, int *, int *);
@@ -1006,6 +1052,7 @@ void *dbg_calloc(size_t, size_t, const char *);
 void *dbg_realloc(void *, size_t, size_t, const char *);
 char *dbg_strdup(const char *, const char *);
 void dbg_free(void *, const char *);
+unsigned mem_ncalls(void);
 void mem_stats(void);
 
 #else /* MEMORY DEBUG disabled */
@@ -1019,6 +1066,20 @@ void mem_stats(void);
 
 #endif /* CALCURSE_MEMORY_DEBUG */
 
+/* bench.c */
+void bench_init(const char *);
+int bench_newterm(void);
+void bench_feed(void);
+void bench_exit(void);
+
+/* latency.c */
+void latency_init(const char *);
+void latency_start(int);
+void latency_render(void);
+void latency_end(void);
+void latency_dump(FILE *);
+void latency_exit(void);
+
 /* note.c */
 char *generate_note(const char *);
 void edit_note(char **, const char *);
@@ -1026,7 +1087,18 @@ void view_note(const char *, const char *);
 void erase_note(char **);
 void note_read(char *, FILE *);
 void note_read_contents(char *, size_t, FILE *);
+void note_ref(const char *);
+void note_unref(const char *);
 void note_gc(void);
+void note_gc_scan(void);
+int note_exists(const char *);
+FILE *note_fopen(const char *);
+void note_pack(void);
+int note_preview(const char *, char *, size_t);
+int note_preview_pending(void);
+int note_preview_updated(void);
+void note_preview_drop(const char *);
+void note_preview_free(void);
 
 /* notify.c */
 int notify_time_left(void);
@@ -1043,6 +1115,9 @@ unsigned notify_launch_cmd(void);
 void notify_update_bar(void);
 unsigned notify_get_next(struct notify_app *);
 unsigned notify_get_next_bkgd(void);
+int notify_write_spool(FILE *, const struct stat *);
+unsigned notify_get_next_spool(void);
+void notify_swap_app(struct notify_app *);
 char *notify_app_txt(void);
 void notify_check_next_app(int);
 void notify_check_added(char *, time_t, char);
@@ -1079,25 +1154,32 @@ struct recur_event *recur_event_new(char *, char *, time_t, int,
 				     struct rpt *);
 char recur_def2char(enum recur_type);
 int recur_char2def(char);
-char *recur_apoint_scan(FILE *, struct tm, struct tm, char,
+char *recur_apoint_scan(char *, struct tm, struct tm, char,
 				       char *, struct item_filter *,
 				       struct rpt *);
-char *recur_event_scan(FILE *, struct tm, int, char *,
+char *recur_event_scan(char *, struct tm, int, char *,
 				     struct item_filter *, struct rpt *);
+void recur_apoint_serialize(struct recur_apoint *, struct string *);
 char *recur_apoint_tostr(struct recur_apoint *);
 char *recur_apoint_hash(struct recur_apoint *);
 void recur_apoint_write(struct recur_apoint *, FILE *);
+void recur_event_serialize(struct recur_event *, struct string *);
 char *recur_event_tostr(struct recur_event *);
 char *recur_event_hash(struct recur_event *);
 void recur_event_write(struct recur_event *, FILE *);
-void recur_save_data(FILE *);
+int recur_save_data(FILE *);
 unsigned recur_item_find_occurrence(time_t, long, struct rpt *, llist_t *,
 				    time_t, time_t *);
+void recur_cache_invalidate(const void *);
+void recur_cache_flush(void);
 unsigned recur_apoint_find_occurrence(struct recur_apoint *, time_t, time_t *);
 unsigned recur_event_find_occurrence(struct recur_event *, time_t, time_t *);
 unsigned recur_item_inday(time_t, long, struct rpt *, llist_t *, time_t);
 unsigned recur_apoint_inday(struct recur_apoint *, time_t *);
 unsigned recur_event_inday(struct recur_event *, time_t *);
+uint64_t recur_item_daymask(time_t, long, struct rpt *, llist_t *, long, int);
+uint64_t recur_apoint_daymask(struct recur_apoint *, long, int);
+uint64_t recur_event_daymask(struct recur_event *, long, int);
 void recur_event_add_exc(struct recur_event *, time_t);
 void recur_apoint_add_exc(struct recur_apoint *, time_t);
 void recur_event_erase(struct recur_event *);
@@ -1108,10 +1190,11 @@ void recur_bymonthday(llist_t *, FILE *);
 void recur_exc_scan(llist_t *, FILE *);
 void recur_apoint_check_next(struct notify_app *, time_t, time_t);
 void recur_apoint_switch_notify(struct recur_apoint *);
-void recur_event_paste_item(struct recur_event *, time_t);
-void recur_apoint_paste_item(struct recur_apoint *, time_t);
+int recur_event_paste_item(struct recur_event *, time_t);
+int recur_apoint_paste_item(struct recur_apoint *, time_t);
 int recur_next_occurrence(time_t, long, struct rpt *, llist_t *, time_t, time_t *);
 int recur_nth_occurrence(time_t, long, struct rpt *, llist_t *, int, time_t *);
+int recur_count_until(time_t, long, struct rpt *, llist_t *);
 int recur_prev_occurrence(time_t, long, struct rpt *, llist_t *, time_t, time_t *);
 
 
@@ -1124,6 +1207,7 @@ void sigs_unignore(void);
 /* strings.c */
 void string_init(struct string *);
 void string_reset(struct string *);
+void string_clear(struct string *);
 int string_grow(struct string *, int);
 char *string_buf(struct string *);
 int string_catf(struct string *, const char *, ...);
@@ -1131,16 +1215,30 @@ int string_vcatf(struct string *, const char *, va_list);
 int string_printf(struct string *, const char *, ...);
 int string_catftime(struct string *, const char *, const struct tm *);
 int string_strftime(struct string *, const char *, const struct tm *);
+void string_append_bytes(struct string *, const char *, int);
+void string_append_str(struct string *, const char *);
+void string_append_char(struct string *, char);
+void string_append_int(struct string *, int);
+void string_append_tm(struct string *, const struct tm *, int);
+char *string_reserve(struct string *, int);
+void string_commit(struct string *, char *);
+char *fmt_uint(char *, unsigned, int);
+char *fmt_int(char *, int);
+char *fmt_date(char *, const struct tm *);
+char *fmt_datetime(char *, const struct tm *);
+char *fmt_str(char *, const char *, size_t);
 
 /* todo.c */
 extern llist_t todolist;
 struct todo *todo_get_item(int, int);
 struct todo *todo_add(char *, int, int, char *);
+void todo_serialize(struct todo *, struct string *);
 char *todo_tostr(struct todo *);
 char *todo_hash(struct todo *);
 void todo_write(struct todo *, FILE *);
 void todo_delete_note(struct todo *);
 void todo_delete(struct todo *);
+void todo_delete_last(void);
 void todo_resort(struct todo *);
 void todo_flag(struct todo *);
 int todo_get_position(struct todo *, int);
@@ -1158,6 +1256,7 @@ void ui_day_item_pipe(void);
 void ui_day_item_repeat(void);
 void ui_day_item_cut(unsigned);
 void ui_day_item_cut_free(unsigned);
+void ui_day_free(void);
 void ui_day_item_copy(unsigned);
 void ui_day_item_paste(unsigned);
 void ui_day_load_items(void);
@@ -1226,6 +1325,10 @@ int get_item_min(time_t);
 struct tm date2tm(struct date, unsigned, unsigned);
 time_t date2sec(struct date, unsigned, unsigned);
 struct date sec2date(time_t);
+long date2daynum(struct date);
+struct date daynum2date(long);
+long sec2daynum(time_t);
+int daynum_wday(long);
 time_t tzdate2sec(struct date, unsigned, unsigned, char *);
 int date_cmp(struct date *, struct date *);
 int date_cmp_day(time_t, time_t);
@@ -1242,7 +1345,6 @@ void draw_scrollbar(struct scrollwin *, int);
 void item_in_popup(const char *, const char *, const char *, const char *);
 time_t get_today(void);
 time_t get_slctd_day(void);
-time_t now(void);
 char *nowstr(void);
 void print_bool_option_incolor(WINDOW *, unsigned, int, int);
 const char *get_tempdir(void);
@@ -1257,7 +1359,6 @@ int parse_duration(const char *, unsigned *, time_t);
 int parse_date_increment(const char *, unsigned *, time_t);
 int parse_datetime(const char *, time_t *, time_t);
 void file_close(FILE *, const char *);
-void psleep(unsigned);
 int fork_exec(int *, int *, int *, int, const char *, const char *const *);
 int shell_exec(int *, int *, int *, int, const char *, const char *const *);
 int child_wait(int *, int *, int *, int);
@@ -1297,8 +1398,13 @@ extern char *path_apts;
 extern char *path_conf;
 extern char *path_keys;
 extern char *path_notes;
+extern char *path_notes_pack;
+extern char *path_notes_idx;
 extern char *path_cpid;
 extern char *path_dpid;
+extern char *path_lock;
+extern char *path_spool;
+extern char *path_archive;
 extern char *path_dmon_log;
 extern char *path_hooks;
 extern struct conf conf;
@@ -1306,19 +1412,26 @@ extern struct pad apad;
 extern struct nbar nbar;
 extern struct dmon_conf dmon;
 void vars_init(void);
-extern pthread_t notify_t_main, io_t_psave, ui_calendar_t_date;
+extern pthread_t notify_t_main, io_t_load, io_t_psave, ui_calendar_t_date;
+
+/* vclock.c */
+void vclock_init(const char *);
+int vclock_virtual(void);
+int vclock_stepped(void);
+time_t now(void);
+int vclock_expired(void);
+void vclock_count(enum vclock_event);
+void psleep(unsigned);
+void vclock_report(FILE *);
+void vclock_exit(void);
 
 /* wins.c */
 extern struct window win[NBWINS];
 extern struct scrollwin sw_cal;
 extern struct listbox lb_apt;
 extern struct listbox lb_todo;
-unsigned wins_nbar_lock(void);
-void wins_nbar_unlock(void);
-void wins_nbar_cleanup(void *);
-unsigned wins_calendar_lock(void);
-void wins_calendar_unlock(void);
-void wins_calendar_cleanup(void *);
+void wins_post(int);
+int wins_wgetch(WINDOW *);
 int wins_refresh(void);
 int wins_wrefresh(WINDOW *);
 int wins_doupdate(void);
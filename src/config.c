@@ -101,6 +101,7 @@ static const struct confvar confmap[] = {
 	{"appearance.dayseparator", CONFIG_HANDLER_BOOL(conf.day_separator)},
 	{"appearance.emptyline", CONFIG_HANDLER_BOOL(conf.empty_appt_line)},
 	{"appearance.emptyday", CONFIG_HANDLER_STR(conf.empty_day)},
+	{"appearance.notepreview", CONFIG_HANDLER_BOOL(conf.note_preview)},
 	{"appearance.notifybar", CONFIG_HANDLER_BOOL(nbar.show)},
 	{"appearance.sidebarwidth", config_parse_sidebar_width, config_serialize_sidebar_width, NULL},
 	{"appearance.theme", config_parse_color_theme, config_serialize_color_theme, NULL},
@@ -114,6 +115,7 @@ static const struct confvar confmap[] = {
 	{"format.appointmenttime", CONFIG_HANDLER_STR(conf.timefmt)},
 	{"format.outputdate", config_parse_output_datefmt, config_serialize_output_datefmt, NULL},
 	{"format.dayheading", CONFIG_HANDLER_STR(conf.day_heading)},
+	{"general.archivehorizon", CONFIG_HANDLER_UNSIGNED(conf.archive_horizon)},
 	{"general.autogc", CONFIG_HANDLER_BOOL(conf.auto_gc)},
 	{"general.autosave", CONFIG_HANDLER_BOOL(conf.auto_save)},
 	{"general.confirmdelete", CONFIG_HANDLER_BOOL(conf.confirm_delete)},
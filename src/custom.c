@@ -535,9 +535,11 @@ enum {
 	DAY_SEPARATOR,
 	EMPTY_APPT_LINE,
 	EMPTY_DAY,
+	NOTE_PREVIEW,
 	AUTO_SAVE,
 	AUTO_GC,
 	PERIODIC_SAVE,
+	ARCHIVE_HORIZON,
 	SYSTEM_EVENTS,
 	CONFIRM_QUIT,
 	CONFIRM_DELETE,
@@ -565,9 +567,11 @@ static void print_general_option(int i, WINDOW *win, int y, int hilt, void *cb_d
 		"appearance.dayseparator = ",
 		"appearance.emptyline = ",
 		"appearance.emptyday = ",
+		"appearance.notepreview = ",
 		"general.autosave = ",
 		"general.autogc = ",
 		"general.periodicsave = ",
+		"general.archivehorizon = ",
 		"general.systemevents = ",
 		"general.confirmquit = ",
 		"general.confirmdelete = ",
@@ -653,6 +657,12 @@ static void print_general_option(int i, WINDOW *win, int y, int hilt, void *cb_d
 		mvwaddstr(win, y + 1, XPOS,
 			  _("(text for a day without events and appointments)"));
 		break;
+	case NOTE_PREVIEW:
+		print_bool_option_incolor(win, conf.note_preview, y,
+					  XPOS + strlen(opt[NOTE_PREVIEW]));
+		mvwaddstr(win, y + 1, XPOS,
+			  _("(show the first line of notes in the panels)"));
+		break;
 	case MULTIPLE_DAYS:
 		print_bool_option_incolor(win, conf.multiple_days, y,
 					  XPOS + strlen(opt[MULTIPLE_DAYS]));
@@ -680,6 +690,15 @@ static void print_general_option(int i, WINDOW *win, int y, int hilt, void *cb_d
 			  _("(if not null, automatically save data every "
 			  "'periodic_save' minutes)"));
 		break;
+	case ARCHIVE_HORIZON:
+		custom_apply_attr(win, ATTR_HIGHEST);
+		mvwprintw(win, y, XPOS + strlen(opt[ARCHIVE_HORIZON]), "%d",
+			  conf.archive_horizon);
+		custom_remove_attr(win, ATTR_HIGHEST);
+		mvwaddstr(win, y + 1, XPOS,
+			  _("(if not null, items that ended that many days ago "
+			  "are archived when saving)"));
+		break;
 	case SYSTEM_EVENTS:
 		print_bool_option_incolor(win, conf.systemevents, y,
 					  XPOS + strlen(opt[SYSTEM_EVENTS]));
@@ -786,6 +805,8 @@ static void general_option_edit(int i)
 	const char *input_datefmt_prefix = _("Enter the date format: ");
 	const char *periodic_save_str =
 	    _("Enter the delay, in minutes, between automatic saves (0 to disable) ");
+	const char *archive_horizon_str =
+	    _("Enter the number of days after which items are archived (0 to disable) ");
 	int val;
 	char *buf;
 
@@ -842,6 +863,9 @@ static void general_option_edit(int i)
 		else if (val == GETSTRING_RET)
 			strcpy(conf.empty_day, EMPTY_DAY_DEFAULT);
 		break;
+	case NOTE_PREVIEW:
+		conf.note_preview = !conf.note_preview;
+		break;
 	case HEADING_POS:
 		if (conf.heading_pos == RIGHT)
 			conf.heading_pos = LEFT;
@@ -867,6 +891,15 @@ static void general_option_edit(int i)
 			}
 		}
 		break;
+	case ARCHIVE_HORIZON:
+		status_mesg(archive_horizon_str, "");
+		snprintf(buf, BUFSIZ, "%d", conf.archive_horizon);
+		if (updatestring(win[STA].p, &buf, 0, 1) == 0) {
+			val = atoi(buf);
+			if (val >= 0)
+				conf.archive_horizon = val;
+		}
+		break;
 	case SYSTEM_EVENTS:
 		conf.systemevents = !conf.systemevents;
 		break;
@@ -460,6 +460,7 @@ day_store_items(time_t date, int include_captions, int n)
 
 	day_free_vector();
 	day_init_vector();
+	archive_load(sec2daynum(date), sec2daynum(date) + n - 1, NULL);
 
 	for (i = 0; i < n; i++, date = NEXTDAY(date)) {
 		if (YEAR1902_2037 && !check_sec(&date))
@@ -535,17 +536,25 @@ day_display_item(struct day_item *day, WINDOW *win, int incolor, int width,
 {
 	int ch_recur, ch_note;
 	char buf[width * UTF8_MAXLEN];
+	char preview[BUFSIZ];
+	size_t len;
 
 	if (width <= 0)
 		return;
 
 	char *mesg = day_item_get_display_mesg(day);
+	char *note = day_item_get_note(day);
 
 	ch_recur = (day->type == RECUR_EVNT) ? '*' : ' ';
-	ch_note = day_item_get_note(day) ? '>' : ' ';
+	ch_note = note ? '>' : ' ';
 
 	strncpy(buf, mesg, width * UTF8_MAXLEN);
 	buf[sizeof(buf) - 1] = '\0';
+	if (conf.note_preview && note &&
+	    note_preview(note, preview, sizeof(preview)) && *preview) {
+		len = strlen(buf);
+		snprintf(buf + len, sizeof(buf) - len, " -- %s", preview);
+	}
 	utf8_chop(buf, width - 3);
 
 	if (!incolor)
@@ -629,14 +638,12 @@ void day_popup_item(struct day_item *day)
 	if (day->type == EVNT || day->type == RECUR_EVNT) {
 		if (day_item_get_note(day)) {
 			char note[note_size];
-			char *notepath, *msg;
+			char *msg;
 			FILE *fp;
 
-			asprintf(&notepath, "%s%s", path_notes, day_item_get_note(day));
-			fp = fopen(notepath, "r");
+			fp = note_fopen(day_item_get_note(day));
 			note_read_contents(note, note_size, fp);
 			fclose(fp);
-			mem_free(notepath);
 
 			asprintf(&msg, "%s\n\n%s\n%s", day_item_get_display_mesg(day), note_heading, note);
 			item_in_popup(NULL, NULL, msg, _("Event:"));
@@ -656,14 +663,12 @@ void day_popup_item(struct day_item *day)
 
 		if (day_item_get_note(day)) {
 			char note[note_size];
-			char *notepath, *msg;
+			char *msg;
 			FILE *fp;
 
-			asprintf(&notepath, "%s%s", path_notes, day_item_get_note(day));
-			fp = fopen(notepath, "r");
+			fp = note_fopen(day_item_get_note(day));
 			note_read_contents(note, note_size, fp);
 			fclose(fp);
-			mem_free(notepath);
 
 			asprintf(&msg, "%s\n\n%s\n%s", day_item_get_display_mesg(day), note_heading, note);
 			item_in_popup(a_st, a_end, msg, _("Appointment:"));
@@ -688,6 +693,7 @@ int day_check_if_item(struct date day)
 {
 	const time_t t = date2sec(day, 0, 0);
 
+	archive_load(date2daynum(day), date2daynum(day), NULL);
 	if (LLIST_FIND_FIRST(&eventlist, (time_t *)&t, event_inday))
 		return ATTR_TRUE;
 
@@ -712,6 +718,72 @@ int day_check_if_item(struct date day)
 	return 0;
 }
 
+/*
+ * Same as day_check_if_item() for n (at most 64) consecutive days starting
+ * with the given day; the attributes are returned in 'attr'. Each item list
+ * is traversed once to build bit masks of the days that have items.
+ */
+void day_check_if_items(struct date day, int n, int *attr)
+{
+	const long first = date2daynum(day);
+	const time_t t_end = date2sec(daynum2date(first + n), 0, 0);
+	uint64_t regular = 0, recur = 0;
+	llist_item_t *i;
+	long d, e;
+	int k;
+
+	EXIT_IF(n < 0 || n > 64, _("too many days"));
+
+	/* The item lists are not available while loading during startup. */
+	if (io_loading()) {
+		for (k = 0; k < n; k++)
+			attr[k] = 0;
+		return;
+	}
+	archive_load(first, first + n - 1, NULL);
+
+	LLIST_FOREACH(&eventlist, i) {
+		struct event *ev = LLIST_GET_DATA(i);
+
+		if (ev->day >= t_end)
+			break;
+		d = sec2daynum(ev->day) - first;
+		if (d >= 0)
+			regular |= (uint64_t)1 << d;
+	}
+
+	LLIST_TS_LOCK(&alist_p);
+	LLIST_TS_FOREACH(&alist_p, i) {
+		struct apoint *apt = LLIST_TS_GET_DATA(i);
+
+		if (apt->start >= t_end)
+			break;
+		d = sec2daynum(apt->start) - first;
+		e = apt->dur > 0 ?
+		    sec2daynum(apt->start + apt->dur - 1) - first : d;
+		for (d = MAX(d, 0); d <= e && d < n; d++)
+			regular |= (uint64_t)1 << d;
+	}
+	LLIST_TS_UNLOCK(&alist_p);
+
+	LLIST_FOREACH(&recur_elist, i)
+		recur |= recur_event_daymask(LLIST_GET_DATA(i), first, n);
+
+	LLIST_TS_LOCK(&recur_alist_p);
+	LLIST_TS_FOREACH(&recur_alist_p, i)
+		recur |= recur_apoint_daymask(LLIST_TS_GET_DATA(i), first, n);
+	LLIST_TS_UNLOCK(&recur_alist_p);
+
+	for (k = 0; k < n; k++) {
+		if (regular & ((uint64_t)1 << k))
+			attr[k] = ATTR_TRUE;
+		else if (recur & ((uint64_t)1 << k))
+			attr[k] = ATTR_LOW;
+		else
+			attr[k] = 0;
+	}
+}
+
 static unsigned fill_slices(int *slices, int slicesno, int first, int last)
 {
 	int i;
@@ -739,6 +811,10 @@ unsigned day_chk_busy_slices(struct date day, int slicesno, int *slices)
 	llist_item_t *i;
 	int slicelen;
 
+	if (io_loading())
+		return 0;
+	archive_load(date2daynum(day), date2daynum(day), NULL);
+
 	slicelen = DAYINSEC / slicesno;
 
 #define  SLICENUM(tsec)  ((tsec) / slicelen % slicesno)
@@ -862,9 +938,8 @@ int day_paste_item(struct day_item *p, time_t date)
 			&until)
 		)
 			return 0;
-		if (check_sec(&until))
-			recur_event_paste_item(p->item.rev, date);
-		else
+		if (!check_sec(&until) ||
+		    !recur_event_paste_item(p->item.rev, date))
 			return 0;
 		break;
 	case APPT:
@@ -879,9 +954,8 @@ int day_paste_item(struct day_item *p, time_t date)
 			&until)
 		)
 			return 0;
-		if (check_sec(&until))
-			recur_apoint_paste_item(p->item.rapt, date);
-		else
+		if (!check_sec(&until) ||
+		    !recur_apoint_paste_item(p->item.rapt, date))
 			return 0;
 		break;
 	default:
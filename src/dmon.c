@@ -42,8 +42,10 @@
 #include <errno.h>
 #include <string.h>
 #include <signal.h>
+#include <dirent.h>
 
 #include "calcurse.h"
+#include "sha1.h"
 
 #define DMON_SLEEP_TIME  60
 
@@ -62,7 +64,30 @@
     }                                                           \
 } while (0)
 
+/* A calendar served by a daemon handling several data directories. */
+struct dmon_cal {
+	char *path_ddir;
+	char *path_apts;
+	char *path_spool;
+	char *path_conf;
+	char *path_cpid;
+	char *path_dpid;
+	char *path_dmon_log;
+	time_t conf_mtime;
+	int broken;
+	struct stat broken_st;
+	int cntdwn;
+	unsigned notify_all;
+	unsigned log;
+	char cmd[BUFSIZ];
+	struct notify_app app;
+};
+
 static unsigned data_loaded;
+static struct stat data_loaded_st;
+static char data_loaded_sha1[SHA1_DIGESTLEN * 2 + 1];
+static unsigned dmon_multi;
+static llist_t dmon_cals;
 
 static void dmon_sigs_hdlr(int sig)
 {
@@ -75,6 +100,11 @@ static void dmon_sigs_hdlr(int sig)
 		free_user_data();
 
 	DMON_LOG(_("terminated at %s with signal %d\n"), nowstr(), sig);
+	vclock_exit();
+
+	/* A daemon serving several calendars does not use a lock file. */
+	if (dmon_multi)
+		exit(EXIT_SUCCESS);
 
 	if (unlink(path_dpid) != 0) {
 		DMON_LOG(_("Could not remove daemon lock file: %s\n"),
@@ -85,10 +115,26 @@ static void dmon_sigs_hdlr(int sig)
 	exit(EXIT_SUCCESS);
 }
 
+/* Stop a replay on a virtual clock once the clock has run out. */
+static void dmon_check_replay(void)
+{
+	if (!vclock_expired())
+		return;
+
+	/* Wait for the notifications still running. */
+	while (wait(NULL) > 0)
+		;
+	dmon_sigs_hdlr(SIGTERM);
+}
+
 static unsigned daemonize(int status)
 {
 	int fd;
 
+	/* Replays on a virtual clock are run in the foreground. */
+	if (vclock_virtual())
+		goto signals;
+
 	/*
 	 * Operate in the background: Daemonizing.
 	 *
@@ -139,6 +185,7 @@ static unsigned daemonize(int status)
 	/* Write access for the owner only. */
 	umask(0022);
 
+signals:
 	if (!sigs_set_hdlr(SIGINT, dmon_sigs_hdlr)
 	    || !sigs_set_hdlr(SIGTERM, dmon_sigs_hdlr)
 	    || !sigs_set_hdlr(SIGALRM, dmon_sigs_hdlr)
@@ -149,6 +196,74 @@ static unsigned daemonize(int status)
 	return 1;
 }
 
+/*
+ * Load the appointments, unless the ones loaded before are still up to date,
+ * and write a new reminder spool. When forced, the appointments are only kept
+ * if the contents of the apts file did not change, as saving the todo list
+ * also rewrites it. Errors are logged, and 0 is returned.
+ */
+static int dmon_load_app(int force)
+{
+	struct stat st;
+	char sha1[SHA1_DIGESTLEN * 2 + 1];
+	char *msg;
+
+	if (stat(path_apts, &st) != 0) {
+		DMON_LOG(_("Could not access \"%s\": %s\n"), path_apts,
+			 strerror(errno));
+		return 0;
+	}
+
+	if (data_loaded && !force && st.st_dev == data_loaded_st.st_dev &&
+	    st.st_ino == data_loaded_st.st_ino &&
+	    st.st_size == data_loaded_st.st_size &&
+	    st.st_mtime == data_loaded_st.st_mtime)
+		goto spool;
+
+	if (!io_compute_hash(path_apts, sha1)) {
+		DMON_LOG(_("Could not access \"%s\": %s\n"), path_apts,
+			 strerror(errno));
+		return 0;
+	}
+	if (data_loaded && strcmp(sha1, data_loaded_sha1) == 0) {
+		data_loaded_st = st;
+		goto spool;
+	}
+
+	if (data_loaded) {
+		apoint_llist_free();
+		recur_apoint_llist_free();
+		event_llist_free();
+		recur_event_llist_free();
+	} else {
+		todo_init_list();
+	}
+	apoint_llist_init();
+	recur_apoint_llist_init();
+	event_llist_init();
+	recur_event_llist_init();
+	msg = io_load_app_noexit(NULL);
+	data_loaded = 1;
+	if (msg) {
+		DMON_LOG(_("Could not load appointments: %s\n"), msg);
+		/* The message was allocated by asprintf(). */
+		free(msg);
+		/* Make sure the items loaded so far are not reused. */
+		data_loaded_sha1[0] = '\0';
+		memset(&data_loaded_st, 0, sizeof(data_loaded_st));
+		return 0;
+	}
+	data_loaded_st = st;
+	strcpy(data_loaded_sha1, sha1);
+	DMON_LOG(_("loaded appointments at %s\n"), nowstr());
+
+spool:
+	if (!io_save_spool(&st))
+		DMON_LOG(_("Could not write reminder spool\n"));
+
+	return 1;
+}
+
 void dmon_start(int parent_exit_status)
 {
 	if (!daemonize(parent_exit_status))
@@ -165,26 +280,27 @@ void dmon_start(int parent_exit_status)
 	if (!io_file_exists(path_apts))
 		DMON_ABRT(_("Could not access \"%s\": %s\n"), path_apts,
 			  strerror(errno));
-	apoint_llist_init();
-	recur_apoint_llist_init();
-	event_llist_init();
-	recur_event_llist_init();
-	todo_init_list();
-	io_load_app(NULL);
-	data_loaded = 1;
 
 	DMON_LOG(_("started at %s\n"), nowstr());
 	for (;;) {
-		int left;
+		int left, reload = 0;
 
 		if (want_reload) {
 			want_reload = 0;
-			io_reload_data();
-			notify_check_next_app(1);
+			reload = 1;
+			notify_free_app();
 		}
 
-		if (!notify_get_next_bkgd())
-			DMON_ABRT(_("error loading next appointment\n"));
+		/*
+		 * The appointments are only loaded if the reminder spool
+		 * written when saving the data files cannot be used.
+		 */
+		if (reload || !notify_get_next_spool()) {
+			if (!dmon_load_app(reload))
+				DMON_ABRT(_("Could not load appointments, aborting\n"));
+			if (!notify_get_next_bkgd())
+				DMON_ABRT(_("error loading next appointment\n"));
+		}
 
 		left = notify_time_left();
 		if (left > 0 &&
@@ -202,6 +318,232 @@ void dmon_start(int parent_exit_status)
 			 DMON_SLEEP_TIME);
 		psleep(DMON_SLEEP_TIME);
 		DMON_LOG(_("awakened at %s\n"), nowstr());
+		dmon_check_replay();
+		/* Reap the user-defined notifications. */
+		while (waitpid(0, NULL, WNOHANG) > 0)
+			;
+	}
+}
+
+static void dmon_add_cal(const char *dir)
+{
+	struct dmon_cal *cal = mem_malloc(sizeof(struct dmon_cal));
+
+	asprintf(&cal->path_ddir, "%s/", dir);
+	asprintf(&cal->path_apts, "%s%s", cal->path_ddir, APTS_PATH_NAME);
+	asprintf(&cal->path_spool, "%s%s", cal->path_ddir, SPOOL_PATH_NAME);
+	asprintf(&cal->path_conf, "%s%s", cal->path_ddir, CONF_PATH_NAME);
+	asprintf(&cal->path_cpid, "%s%s", cal->path_ddir, CPID_PATH_NAME);
+	asprintf(&cal->path_dpid, "%s%s", cal->path_ddir, DPID_PATH_NAME);
+	asprintf(&cal->path_dmon_log, "%s%s", cal->path_ddir,
+		 DLOG_PATH_NAME);
+	cal->conf_mtime = -1;
+	cal->broken = 0;
+	cal->app.time = 0;
+	cal->app.got_app = 0;
+	cal->app.txt = NULL;
+	cal->app.state = APOINT_NULL;
+
+	LLIST_ADD(&dmon_cals, cal);
+}
+
+/*
+ * Add the calendar in the given data directory or, if it does not contain an
+ * apts file, the calendars in its subdirectories.
+ */
+static void dmon_add_dir(const char *dir)
+{
+	char *path, *sub;
+	struct dirent *dp;
+	DIR *dirp;
+
+	asprintf(&path, "%s/%s", dir, APTS_PATH_NAME);
+	if (io_file_exists(path)) {
+		dmon_add_cal(dir);
+	} else if ((dirp = opendir(dir))) {
+		while ((dp = readdir(dirp)) != NULL) {
+			if (*dp->d_name == '.')
+				continue;
+			asprintf(&sub, "%s/%s/%s", dir, dp->d_name,
+				 APTS_PATH_NAME);
+			if (io_file_exists(sub)) {
+				mem_free(sub);
+				asprintf(&sub, "%s/%s", dir, dp->d_name);
+				dmon_add_cal(sub);
+			}
+			mem_free(sub);
+		}
+		closedir(dirp);
+	}
+	mem_free(path);
+}
+
+/*
+ * Make the given calendar the current one: point the data file paths to its
+ * directory, and restore its notification settings and next appointment.
+ * The configuration file is only read again when it was modified.
+ */
+static void dmon_cal_enter(struct dmon_cal *cal)
+{
+	struct stat st;
+
+	path_ddir = cal->path_ddir;
+	path_apts = cal->path_apts;
+	path_spool = cal->path_spool;
+	path_conf = cal->path_conf;
+	path_cpid = cal->path_cpid;
+	path_dpid = cal->path_dpid;
+	path_dmon_log = cal->path_dmon_log;
+
+	if (stat(path_conf, &st) != 0)
+		st.st_mtime = 0;
+	if (st.st_mtime != cal->conf_mtime) {
+		notify_init_vars();
+		dmon.log = 0;
+		if (st.st_mtime)
+			config_load();
+		if (cal->conf_mtime == -1)
+			DMON_LOG(_("started at %s\n"), nowstr());
+		cal->conf_mtime = st.st_mtime;
+		cal->cntdwn = nbar.cntdwn;
+		cal->notify_all = nbar.notify_all;
+		cal->log = dmon.log;
+		strncpy(cal->cmd, nbar.cmd, BUFSIZ - 1);
+		cal->cmd[BUFSIZ - 1] = '\0';
+	} else {
+		nbar.cntdwn = cal->cntdwn;
+		nbar.notify_all = cal->notify_all;
+		dmon.log = cal->log;
+		strncpy(nbar.cmd, cal->cmd, BUFSIZ - 1);
+		nbar.cmd[BUFSIZ - 1] = '\0';
+	}
+
+	notify_swap_app(&cal->app);
+}
+
+static void dmon_cal_leave(struct dmon_cal *cal)
+{
+	notify_swap_app(&cal->app);
+}
+
+/* Check whether the process whose pid is stored in a lock file is running. */
+static int dmon_pid_running(char *path)
+{
+	int pid = io_get_pid(path);
+
+	return pid && kill((pid_t) pid, 0) == 0;
+}
+
+/* Send a reminder for the next appointment of the current calendar. */
+static void dmon_cal_check(struct dmon_cal *cal)
+{
+	struct stat st;
+	int left, loaded;
+
+	/* The calendar is handled by another instance. */
+	if (dmon_pid_running(path_cpid) || dmon_pid_running(path_dpid))
+		return;
+
+	if (!io_file_exists(path_apts)) {
+		DMON_LOG(_("Could not access \"%s\": %s\n"), path_apts,
+			 strerror(errno));
+		return;
+	}
+
+	/*
+	 * Appointments are only loaded if the reminder spool is out of date,
+	 * and freed again as soon as a new spool has been written.
+	 */
+	if (want_reload || !notify_get_next_spool()) {
+		/*
+		 * A calendar that failed to load is skipped, without affecting
+		 * the other ones, until its apts file is modified.
+		 */
+		if (cal->broken && stat(path_apts, &st) == 0 &&
+		    st.st_dev == cal->broken_st.st_dev &&
+		    st.st_ino == cal->broken_st.st_ino &&
+		    st.st_size == cal->broken_st.st_size &&
+		    st.st_mtime == cal->broken_st.st_mtime)
+			return;
+
+		loaded = dmon_load_app(1);
+		cal->broken = !loaded && stat(path_apts, &cal->broken_st) == 0;
+		if (cal->broken)
+			notify_free_app();
+		else if (!notify_get_next_bkgd())
+			DMON_LOG(_("error loading next appointment\n"));
+		apoint_llist_free();
+		recur_apoint_llist_free();
+		event_llist_free();
+		recur_event_llist_free();
+		data_loaded = 0;
+	}
+
+	left = notify_time_left();
+	if (left > 0 && left <= MAX(DMON_SLEEP_TIME, nbar.cntdwn) &&
+	    notify_needs_reminder()) {
+		DMON_LOG(_("launching notification at %s for: \"%s\"\n"),
+			 nowstr(), notify_app_txt());
+		if (!notify_launch_cmd())
+			DMON_LOG(_("error while sending notification\n"));
+	}
+}
+
+/*
+ * Run a single daemon for the calendars in a colon-separated list of data
+ * directories. Directories without an apts file are searched for calendars
+ * one level deep. All calendars are checked from one loop, each with the
+ * notification settings from its own configuration file.
+ *
+ * Every wake-up checks each calendar in turn, since any of their data files
+ * may have changed. There is no per-calendar schedule: a calendar whose next
+ * reminder is far off costs a few stat() calls and a spool lookup.
+ */
+void dmon_start_multi(const char *dirs)
+{
+	char *list, *dir, *abs, *cwd;
+	llist_item_t *i;
+
+	LLIST_INIT(&dmon_cals);
+	cwd = getcwd(NULL, 0);
+	list = mem_strdup(dirs);
+	for (dir = strtok(list, ":"); dir; dir = strtok(NULL, ":")) {
+		/* The daemon changes its working directory. */
+		if (*dir != '/' && cwd) {
+			asprintf(&abs, "%s/%s", cwd, dir);
+			dmon_add_dir(abs);
+			mem_free(abs);
+		} else {
+			dmon_add_dir(dir);
+		}
+	}
+	mem_free(list);
+	free(cwd);
+
+	EXIT_IF(!LLIST_FIRST(&dmon_cals), _("no calendar found in %s"), dirs);
+
+	dmon_multi = 1;
+	if (!daemonize(0))
+		DMON_ABRT(_("Cannot daemonize, aborting\n"));
+
+	apoint_llist_init();
+	recur_apoint_llist_init();
+	event_llist_init();
+	recur_event_llist_init();
+	todo_init_list();
+
+	for (;;) {
+		LLIST_FOREACH(&dmon_cals, i) {
+			struct dmon_cal *cal = LLIST_GET_DATA(i);
+
+			dmon_cal_enter(cal);
+			dmon_cal_check(cal);
+			dmon_cal_leave(cal);
+		}
+		want_reload = 0;
+
+		psleep(DMON_SLEEP_TIME);
+		dmon_check_replay();
 		/* Reap the user-defined notifications. */
 		while (waitpid(0, NULL, WNOHANG) > 0)
 			;
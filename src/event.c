@@ -48,7 +48,7 @@ struct event dummy = { DUMMY, 0, "", NULL };
 
 void event_free(struct event *ev)
 {
-	mem_free(ev->mesg);
+	io_data_str_free(ev->mesg);
 	erase_note(&ev->note);
 	mem_free(ev);
 }
@@ -61,8 +61,10 @@ struct event *event_dup(struct event *in)
 	ev->id = in->id;
 	ev->day = in->day;
 	ev->mesg = mem_strdup(in->mesg);
-	if (in->note)
+	if (in->note) {
 		ev->note = mem_strdup(in->note);
+		note_ref(ev->note);
+	}
 	else
 		ev->note = NULL;
 
@@ -96,10 +98,11 @@ struct event *event_new(char *mesg, char *note, time_t day, int id)
 	struct event *ev;
 
 	ev = mem_malloc(sizeof(struct event));
-	ev->mesg = mem_strdup(mesg);
+	ev->mesg = io_data_str(mesg);
 	ev->day = day;
 	ev->id = id;
-	ev->note = (note != NULL) ? mem_strdup(note) : NULL;
+	ev->note = (note != NULL) ? io_data_str(note) : NULL;
+	note_ref(ev->note);
 
 	LLIST_ADD_SORTED(&eventlist, ev, event_cmp);
 
@@ -112,21 +115,41 @@ unsigned event_inday(struct event *i, time_t *start)
 	return (date_cmp_day(i->day, *start) == 0);
 }
 
-char *event_tostr(struct event *o)
+/* Append the serialized form of an event to a string. */
+void event_serialize(struct event *o, struct string *s)
 {
-	struct string s;
+	size_t note_len = o->note ? strlen(o->note) : 0;
+	size_t mesg_len = strlen(o->mesg);
 	struct tm lt;
 	time_t t;
+	char *p;
 
-	string_init(&s);
+	p = string_reserve(s, FMT_DATE_MAX + 4 + FMT_INT_MAX + note_len + 2 +
+			   mesg_len);
 
 	t = o->day;
 	localtime_r(&t, &lt);
-	string_catf(&s, "%02u/%02u/%04u [%d] ", lt.tm_mon + 1, lt.tm_mday,
-		1900 + lt.tm_year, o->id);
-	if (o->note != NULL)
-		string_catf(&s, ">%s ", o->note);
-	string_catf(&s, "%s", o->mesg);
+	p = fmt_date(p, &lt);
+	p = fmt_str(p, " [", 2);
+	p = fmt_int(p, o->id);
+	p = fmt_str(p, "] ", 2);
+
+	if (o->note != NULL) {
+		*p++ = '>';
+		p = fmt_str(p, o->note, note_len);
+		*p++ = ' ';
+	}
+	p = fmt_str(p, o->mesg, mesg_len);
+
+	string_commit(s, p);
+}
+
+char *event_tostr(struct event *o)
+{
+	struct string s;
+
+	string_init(&s);
+	event_serialize(o, &s);
 
 	return string_buf(&s);
 }
@@ -143,16 +166,19 @@ char *event_hash(struct event *ev)
 
 void event_write(struct event *o, FILE * f)
 {
-	char *str = event_tostr(o);
-	fprintf(f, "%s\n", str);
-	mem_free(str);
+	struct string s;
+
+	string_init(&s);
+	event_serialize(o, &s);
+	fwrite(string_buf(&s), 1, s.len, f);
+	fputc('\n', f);
+	mem_free(string_buf(&s));
 }
 
 /* Load the events from file */
-char *event_scan(FILE * f, struct tm start, int id, char *note,
+char *event_scan(char *mesg, struct tm start, int id, char *note,
 			 struct item_filter *filter)
 {
-	char buf[BUFSIZ], *nl;
 	time_t tstart, tend;
 	struct event *ev = NULL;
 	int cond;
@@ -161,14 +187,6 @@ char *event_scan(FILE * f, struct tm start, int id, char *note,
 	    !check_time(start.tm_hour, start.tm_min))
 		return _("illegal date in event");
 
-	/* Read the event description */
-	if (!fgets(buf, sizeof buf, f))
-		return _("error in appointment description");
-
-	nl = strchr(buf, '\n');
-	if (nl) {
-		*nl = '\0';
-	}
 	start.tm_hour = 0;
 	start.tm_min = 0;
 	start.tm_sec = 0;
@@ -185,14 +203,14 @@ char *event_scan(FILE * f, struct tm start, int id, char *note,
 	if (filter) {
 		cond = (
 		    !(filter->type_mask & TYPE_MASK_EVNT) ||
-		    (filter->regex && regexec(filter->regex, buf, 0, 0, 0)) ||
+		    (filter->regex && regexec(filter->regex, mesg, 0, 0, 0)) ||
 		    (filter->start_from != -1 && tstart < filter->start_from) ||
 		    (filter->start_to != -1 && tstart > filter->start_to) ||
 		    (filter->end_from != -1 && tend < filter->end_from) ||
 		    (filter->end_to != -1 && tend > filter->end_to)
 		);
 		if (filter->hash) {
-			ev = event_new(buf, note, tstart, id);
+			ev = event_new(mesg, note, tstart, id);
 			char *hash = event_hash(ev);
 			cond = cond || !hash_matches(filter->hash, hash);
 			mem_free(hash);
@@ -205,7 +223,7 @@ char *event_scan(FILE * f, struct tm start, int id, char *note,
 		}
 	}
 	if (!ev)
-		ev = event_new(buf, note, tstart, id);
+		ev = event_new(mesg, note, tstart, id);
 	return NULL;
 }
 
@@ -191,7 +191,8 @@ enum getstr getstring(WINDOW * win, char *str, int l, int x, int y)
 		getstr_print(win, x, y, &st);
 		wins_doupdate();
 
-		ch = wgetch(win);
+		keys_idle();
+		ch = wins_wgetch(win);
 		if ((ch == '\n') || (ch == KEY_ENTER))
 			break;
 		switch (ch) {
@@ -303,10 +304,8 @@ int updatestring(WINDOW * win, char **str, int x, int y)
 	ret = getstring(win, buf, BUFSIZ, x, y);
 
 	if (ret == GETSTRING_VALID) {
-		len = strlen(buf);
-		*str = mem_realloc(*str, len + 1, 1);
-		EXIT_IF(*str == NULL, _("out of memory"));
-		memcpy(*str, buf, len + 1);
+		io_data_str_free(*str);
+		*str = mem_strdup(buf);
 	} else if (ret == GETSTRING_RET)
 		**str = '\0';
 	mem_free(buf);
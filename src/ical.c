@@ -115,11 +115,16 @@ static void ical_export_valarm(FILE * stream)
 	fputs("END:VALARM\n", stream);
 }
 
-static void ical_export_rrule(FILE *stream, struct rpt *rpt, ical_vevent_e item,
-			      char *buf)
+/*
+ * Exception days do not consume the count of a rrule, but an EXDATE removes
+ * an occurrence from a COUNT-limited iCal rule. If an exception falls on or
+ * before the derived until day, the rule is exported with UNTIL instead.
+ */
+static void ical_export_rrule(FILE *stream, struct rpt *rpt, llist_t *exc,
+			      ical_vevent_e item, char *buf)
 {
 	llist_item_t *j;
-	int d;
+	int d, count = rpt->count;
 	char *fmt = item == EVENT ? ICALDATEFMT :
 		    item == APPOINTMENT ? ICALDATETIMEFMT :
 		    NULL;
@@ -127,7 +132,14 @@ static void ical_export_rrule(FILE *stream, struct rpt *rpt, ical_vevent_e item,
 	fprintf(stream, "RRULE:FREQ=%s", ical_recur_type[rpt->type]);
 	if (rpt->freq > 1)
 		fprintf(stream, ";INTERVAL=%d", rpt->freq);
-	if (rpt->until) {
+	LLIST_FOREACH(exc, j) {
+		struct excp *e = LLIST_GET_DATA(j);
+		if (DAY(e->st) <= rpt->until)
+			count = 0;
+	}
+	if (count > 0) {
+		fprintf(stream, ";COUNT=%d", count);
+	} else if (rpt->until) {
 		date_sec2date_fmt(rpt->until, fmt, buf);
 		fprintf(stream, ";UNTIL=%s", buf);
 	}
@@ -197,7 +209,7 @@ static char *ical_unindent(char *a, char *z)
 
 static void ical_export_note(FILE *stream, char *name)
 {
-	char *note_file, *p, *q, *r, *rest;
+	char *p, *q, *r, *rest;
 	char *property[] = {
 		"Location: ",
 		"Comment: ",
@@ -212,14 +224,14 @@ static void ical_export_note(FILE *stream, char *name)
 	FILE *fp;
 	int has_desc, has_prop, i;
 
-	asprintf(&note_file, "%s/%s", path_notes, name);
-	if (!(fp = fopen(note_file, "r")) || ungetc(getc(fp), fp) == EOF) {
-		fclose(fp);
+	if (!(fp = note_fopen(name)) || ungetc(getc(fp), fp) == EOF) {
+		if (fp)
+			fclose(fp);
 		return;
 	}
 	string_init(&note);
 	while (fgets(lbuf, BUFSIZ, fp))
-		string_catf(&note, "%s", lbuf);
+		string_append_str(&note, lbuf);
 	fclose(fp);
 
 	has_desc = has_prop = 0;
@@ -273,178 +285,202 @@ static void ical_export_footer(FILE * stream)
 	fputs("END:VCALENDAR\n", stream);
 }
 
+/* Export a recurrent event. */
+static void ical_export_recur_event(FILE * stream, void *item, void *arg)
+{
+	struct recur_event *rev = item;
+	int export_uid = *(int *)arg;
+	llist_item_t *j;
+	char ical_date[BUFSIZ], *hash;
+
+	fputs("BEGIN:VEVENT\n", stream);
+	if (export_uid) {
+		hash = recur_event_hash(rev);
+		fprintf(stream, "UID:%s\n", hash);
+		mem_free(hash);
+	}
+	date_sec2date_fmt(rev->day, ICALDATEFMT, ical_date);
+	fprintf(stream, "DTSTART;VALUE=DATE:%s\n", ical_date);
+	ical_export_rrule(stream, rev->rpt, &rev->exc, EVENT, ical_date);
+	if (LLIST_FIRST(&rev->exc)) {
+		fputs("EXDATE;VALUE=DATE:", stream);
+		LLIST_FOREACH(&rev->exc, j) {
+			struct excp *exc = LLIST_GET_DATA(j);
+			date_sec2date_fmt(exc->st, ICALDATETIMEFMT,
+					  ical_date);
+			fprintf(stream, "%s", ical_date);
+			fputc(LLIST_NEXT(j) ? ',' : '\n', stream);
+		}
+	}
+	ical_format_line(stream, "SUMMARY:", rev->mesg);
+	if (rev->note)
+		ical_export_note(stream, rev->note);
+	fputs("END:VEVENT\n", stream);
+}
+
 /* Export recurrent events. */
 static void ical_export_recur_events(FILE * stream, int export_uid)
 {
-	llist_item_t *i, *j;
+	io_render_list(stream, LLIST_FIRST(&recur_elist),
+		       ical_export_recur_event, &export_uid);
+}
+
+/* Export an event. */
+static void ical_export_event(FILE * stream, void *item, void *arg)
+{
+	struct event *ev = item;
+	int export_uid = *(int *)arg;
 	char ical_date[BUFSIZ], *hash;
 
-	LLIST_FOREACH(&recur_elist, i) {
-		struct recur_event *rev = LLIST_GET_DATA(i);
-		fputs("BEGIN:VEVENT\n", stream);
-		if (export_uid) {
-			hash = recur_event_hash(rev);
-			fprintf(stream, "UID:%s\n", hash);
-			mem_free(hash);
-		}
-		date_sec2date_fmt(rev->day, ICALDATEFMT, ical_date);
-		fprintf(stream, "DTSTART;VALUE=DATE:%s\n", ical_date);
-		ical_export_rrule(stream, rev->rpt, EVENT, ical_date);
-		if (LLIST_FIRST(&rev->exc)) {
-			fputs("EXDATE;VALUE=DATE:", stream);
-			LLIST_FOREACH(&rev->exc, j) {
-				struct excp *exc = LLIST_GET_DATA(j);
-				date_sec2date_fmt(exc->st, ICALDATETIMEFMT,
-						  ical_date);
-				fprintf(stream, "%s", ical_date);
-				fputc(LLIST_NEXT(j) ? ',' : '\n', stream);
-			}
-		}
-		ical_format_line(stream, "SUMMARY:", rev->mesg);
-		if (rev->note)
-			ical_export_note(stream, rev->note);
-		fputs("END:VEVENT\n", stream);
+	fputs("BEGIN:VEVENT\n", stream);
+	if (export_uid) {
+		hash = event_hash(ev);
+		fprintf(stream, "UID:%s\n", hash);
+		mem_free(hash);
 	}
+	date_sec2date_fmt(ev->day, ICALDATEFMT, ical_date);
+	fprintf(stream, "DTSTART;VALUE=DATE:%s\n", ical_date);
+	ical_format_line(stream, "SUMMARY:", ev->mesg);
+	if (ev->note)
+		ical_export_note(stream, ev->note);
+	fputs("END:VEVENT\n", stream);
 }
 
 /* Export events. */
 static void ical_export_events(FILE * stream, int export_uid)
 {
-	llist_item_t *i;
-	char ical_date[BUFSIZ], *hash;
+	io_render_list(stream, LLIST_FIRST(&eventlist), ical_export_event,
+		       &export_uid);
+}
+
+/* Export a recurrent appointment. */
+static void ical_export_recur_apoint(FILE * stream, void *item, void *arg)
+{
+	struct recur_apoint *rapt = item;
+	int export_uid = *(int *)arg;
+	llist_item_t *j;
+	char ical_datetime[BUFSIZ], *hash;
+	time_t tod;
 
-	LLIST_FOREACH(&eventlist, i) {
-		struct event *ev = LLIST_TS_GET_DATA(i);
-		fputs("BEGIN:VEVENT\n", stream);
-		if (export_uid) {
-			hash = event_hash(ev);
-			fprintf(stream, "UID:%s\n", hash);
-			mem_free(hash);
+	/*
+	 * Add time-of-day to UNTIL/EXDATE.
+	 * In calcurse until/exception is a date (midnight), but in
+	 * RFC 5545 UNTIL/EXDATE is a DATE-TIME value type by default.
+	 */
+	tod = get_item_time(rapt->start);
+	if (rapt->rpt->until)
+		rapt->rpt->until += tod;
+
+	date_sec2date_fmt(rapt->start, ICALDATETIMEFMT, ical_datetime);
+	fputs("BEGIN:VEVENT\n", stream);
+	if (export_uid) {
+		hash = recur_apoint_hash(rapt);
+		fprintf(stream, "UID:%s\n", hash);
+		mem_free(hash);
+	}
+	fprintf(stream, "DTSTART:%s\n", ical_datetime);
+	if (rapt->dur > 0) {
+		fprintf(stream, "DURATION:P%ldDT%ldH%ldM%ldS\n",
+			rapt->dur / DAYINSEC,
+			(rapt->dur / HOURINSEC) % DAYINHOURS,
+			(rapt->dur / MININSEC) % HOURINMIN,
+			rapt->dur % MININSEC);
+	}
+	ical_export_rrule(stream, rapt->rpt, &rapt->exc, APPOINTMENT,
+			  ical_datetime);
+	if (LLIST_FIRST(&rapt->exc)) {
+		fputs("EXDATE:", stream);
+		LLIST_FOREACH(&rapt->exc, j) {
+			struct excp *exc = LLIST_GET_DATA(j);
+			date_sec2date_fmt(exc->st + tod, ICALDATETIMEFMT,
+					  ical_datetime);
+			fprintf(stream, "%s", ical_datetime);
+			fputc(LLIST_NEXT(j) ? ',' : '\n', stream);
 		}
-		date_sec2date_fmt(ev->day, ICALDATEFMT, ical_date);
-		fprintf(stream, "DTSTART;VALUE=DATE:%s\n", ical_date);
-		ical_format_line(stream, "SUMMARY:", ev->mesg);
-		if (ev->note)
-			ical_export_note(stream, ev->note);
-		fputs("END:VEVENT\n", stream);
 	}
+	ical_format_line(stream, "SUMMARY:", rapt->mesg);
+	if (rapt->note)
+		ical_export_note(stream, rapt->note);
+	if (rapt->state & APOINT_NOTIFY)
+		ical_export_valarm(stream);
+	fputs("END:VEVENT\n", stream);
 }
 
 /* Export recurrent appointments. */
 static void ical_export_recur_apoints(FILE * stream, int export_uid)
 {
-	llist_item_t *i, *j;
-	char ical_datetime[BUFSIZ], *hash;
-	time_t tod;
-
 	LLIST_TS_LOCK(&recur_alist_p);
-	LLIST_TS_FOREACH(&recur_alist_p, i) {
-		struct recur_apoint *rapt = LLIST_TS_GET_DATA(i);
+	io_render_list(stream, LLIST_TS_FIRST(&recur_alist_p),
+		       ical_export_recur_apoint, &export_uid);
+	LLIST_TS_UNLOCK(&recur_alist_p);
+}
 
-		/*
-		 * Add time-of-day to UNTIL/EXDATE.
-		 * In calcurse until/exception is a date (midnight), but in
-		 * RFC 5545 UNTIL/EXDATE is a DATE-TIME value type by default.
-		 */
-		tod = get_item_time(rapt->start);
-		if (rapt->rpt->until)
-			rapt->rpt->until += tod;
-
-		date_sec2date_fmt(rapt->start, ICALDATETIMEFMT,
-				  ical_datetime);
-		fputs("BEGIN:VEVENT\n", stream);
-		if (export_uid) {
-			hash = recur_apoint_hash(rapt);
-			fprintf(stream, "UID:%s\n", hash);
-			mem_free(hash);
-		}
-		fprintf(stream, "DTSTART:%s\n", ical_datetime);
-		if (rapt->dur > 0) {
-			fprintf(stream, "DURATION:P%ldDT%ldH%ldM%ldS\n",
-				rapt->dur / DAYINSEC,
-				(rapt->dur / HOURINSEC) % DAYINHOURS,
-				(rapt->dur / MININSEC) % HOURINMIN,
-				rapt->dur % MININSEC);
-		}
-		ical_export_rrule(stream, rapt->rpt, APPOINTMENT, ical_datetime);
-		if (LLIST_FIRST(&rapt->exc)) {
-			fputs("EXDATE:", stream);
-			LLIST_FOREACH(&rapt->exc, j) {
-				struct excp *exc = LLIST_GET_DATA(j);
-				date_sec2date_fmt(exc->st + tod, ICALDATETIMEFMT,
-						  ical_datetime);
-				fprintf(stream, "%s", ical_datetime);
-				fputc(LLIST_NEXT(j) ? ',' : '\n', stream);
-			}
-		}
-		ical_format_line(stream, "SUMMARY:", rapt->mesg);
-		if (rapt->note)
-			ical_export_note(stream, rapt->note);
-		if (rapt->state & APOINT_NOTIFY)
-			ical_export_valarm(stream);
-		fputs("END:VEVENT\n", stream);
+/* Export an appointment. */
+static void ical_export_apoint(FILE * stream, void *item, void *arg)
+{
+	struct apoint *apt = item;
+	int export_uid = *(int *)arg;
+	char ical_datetime[BUFSIZ], *hash;
+
+	fputs("BEGIN:VEVENT\n", stream);
+	if (export_uid) {
+		hash = apoint_hash(apt);
+		fprintf(stream, "UID:%s\n", hash);
+		mem_free(hash);
 	}
-	LLIST_TS_UNLOCK(&recur_alist_p);
+	date_sec2date_fmt(apt->start, ICALDATETIMEFMT, ical_datetime);
+	fprintf(stream, "DTSTART:%s\n", ical_datetime);
+	if (apt->dur > 0) {
+		fprintf(stream, "DURATION:P%ldDT%ldH%ldM%ldS\n",
+			apt->dur / DAYINSEC,
+			(apt->dur / HOURINSEC) % DAYINHOURS,
+			(apt->dur / MININSEC) % HOURINMIN,
+			apt->dur % MININSEC);
+	}
+	ical_format_line(stream, "SUMMARY:", apt->mesg);
+	if (apt->note)
+		ical_export_note(stream, apt->note);
+	if (apt->state & APOINT_NOTIFY)
+		ical_export_valarm(stream);
+	fputs("END:VEVENT\n", stream);
 }
 
 /* Export appointments. */
 static void ical_export_apoints(FILE * stream, int export_uid)
 {
-	llist_item_t *i;
-	char ical_datetime[BUFSIZ], *hash;
-
 	LLIST_TS_LOCK(&alist_p);
-	LLIST_TS_FOREACH(&alist_p, i) {
-		struct apoint *apt = LLIST_TS_GET_DATA(i);
-		fputs("BEGIN:VEVENT\n", stream);
-		if (export_uid) {
-			hash = apoint_hash(apt);
-			fprintf(stream, "UID:%s\n", hash);
-			mem_free(hash);
-		}
-		date_sec2date_fmt(apt->start, ICALDATETIMEFMT,
-				  ical_datetime);
-		fprintf(stream, "DTSTART:%s\n", ical_datetime);
-		if (apt->dur > 0) {
-			fprintf(stream, "DURATION:P%ldDT%ldH%ldM%ldS\n",
-				apt->dur / DAYINSEC,
-				(apt->dur / HOURINSEC) % DAYINHOURS,
-				(apt->dur / MININSEC) % HOURINMIN,
-				apt->dur % MININSEC);
-		}
-		ical_format_line(stream, "SUMMARY:", apt->mesg);
-		if (apt->note)
-			ical_export_note(stream, apt->note);
-		if (apt->state & APOINT_NOTIFY)
-			ical_export_valarm(stream);
-		fputs("END:VEVENT\n", stream);
-	}
+	io_render_list(stream, LLIST_TS_FIRST(&alist_p), ical_export_apoint,
+		       &export_uid);
 	LLIST_TS_UNLOCK(&alist_p);
 }
 
-/* Export todo items. */
-static void ical_export_todo(FILE * stream, int export_uid)
+/* Export a todo item. */
+static void ical_export_todo_item(FILE * stream, void *item, void *arg)
 {
-	llist_item_t *i;
+	struct todo *todo = item;
+	int export_uid = *(int *)arg;
 	char *hash;
 
-	LLIST_FOREACH(&todolist, i) {
-		struct todo *todo = LLIST_TS_GET_DATA(i);
-
-		fputs("BEGIN:VTODO\n", stream);
-		if (export_uid) {
-			hash = todo_hash(todo);
-			fprintf(stream, "UID:%s\n", hash);
-			mem_free(hash);
-		}
-		fprintf(stream, "PRIORITY:%d\n", todo->id);
-		ical_format_line(stream, "SUMMARY:", todo->mesg);
-		if (todo->note)
-			ical_export_note(stream, todo->note);
-		if (todo->completed)
-			fprintf(stream, "STATUS:COMPLETED\n");
-		fputs("END:VTODO\n", stream);
+	fputs("BEGIN:VTODO\n", stream);
+	if (export_uid) {
+		hash = todo_hash(todo);
+		fprintf(stream, "UID:%s\n", hash);
+		mem_free(hash);
 	}
+	fprintf(stream, "PRIORITY:%d\n", todo->id);
+	ical_format_line(stream, "SUMMARY:", todo->mesg);
+	if (todo->note)
+		ical_export_note(stream, todo->note);
+	if (todo->completed)
+		fprintf(stream, "STATUS:COMPLETED\n");
+	fputs("END:VTODO\n", stream);
+}
+
+/* Export todo items. */
+static void ical_export_todo(FILE * stream, int export_uid)
+{
+	io_render_list(stream, LLIST_FIRST(&todolist), ical_export_todo_item,
+		       &export_uid);
 }
 
 /* Print a header to describe import log report format. */
@@ -504,7 +540,8 @@ static void ical_store_todo(int priority, int completed, char *mesg,
 	if (fmt_todo)
 		print_todo(fmt_todo, todo);
 	mem_free(mesg);
-	erase_note(&note);
+	if (note)
+		mem_free(note);
 }
 
 /*
@@ -549,6 +586,7 @@ ical_store_event(char *mesg, char *note, time_t day, time_t end,
 	tmp.type = RECUR_DAILY;
 	tmp.freq = 1;
 	tmp.until = day + ((end - day - 1) / DAYINSEC) * DAYINSEC;
+	tmp.count = 0;
 	LLIST_INIT(&tmp.bymonth);
 	LLIST_INIT(&tmp.bywday);
 	LLIST_INIT(&tmp.bymonthday);
@@ -559,7 +597,8 @@ ical_store_event(char *mesg, char *note, time_t day, time_t end,
 
 cleanup:
 	mem_free(mesg);
-	erase_note(&note);
+	if (note)
+		mem_free(note);
 }
 
 static void
@@ -583,7 +622,7 @@ ical_store_apoint(char *mesg, char *note, time_t start, long dur,
 		 * day, and the start time is after the until value, the
 		 * calcurse until day must be changed to the day before.
 		 */
-		if (rpt->until) {
+		if (rpt->until && !rpt->count) {
 			day = DAY(rpt->until);
 			if (recur_item_find_occurrence(start, dur, rpt, NULL,
 						       day, NULL) &&
@@ -602,7 +641,8 @@ ical_store_apoint(char *mesg, char *note, time_t start, long dur,
 			print_apoint(fmt_apt, start, apt);
 	}
 	mem_free(mesg);
-	erase_note(&note);
+	if (note)
+		mem_free(note);
 }
 
 /*
@@ -623,15 +663,15 @@ static char *ical_unformat_line(char *line, int eol, int indentation)
 			switch (*(p + 1)) {
 			case 'N':
 			case 'n':
-				string_catf(&s, "%c", '\n');
+				string_append_char(&s, '\n');
 				if (indentation)
-					string_catf(&s, "%s", INDENT);
+					string_append_str(&s, INDENT);
 				p++;
 				break;
 			case '\\':
 			case ';':
 			case ',':
-				string_catf(&s, "%c", *(p + 1));
+				string_append_char(&s, *(p + 1));
 				p++;
 				break;
 			default:
@@ -645,13 +685,13 @@ static char *ical_unformat_line(char *line, int eol, int indentation)
 			mem_free(s.buf);
 			return NULL;
 		default:
-			string_catf(&s, "%c", *p);
+			string_append_char(&s, *p);
 			break;
 		}
 	}
 	/* Add the final EOL removed by ical_readline(). */
 	if (eol)
-		string_catf(&s, "\n");
+		string_append_char(&s, '\n');
 
 	return string_buf(&s);
 }
@@ -1154,8 +1194,8 @@ static struct rpt *ical_read_rrule(FILE *log, char *rrulestr,
 	}
 
 	/*
-	 * COUNT is converted to UNTIL in ical_read_event() once all recurrence
-	 * parameters are known.
+	 * COUNT is kept as such; ical_read_event() derives the until day once
+	 * all recurrence parameters are known.
 	 */
 	if ((p = strstr(rrulestr, "COUNT="))) {
 		p = strchr(p, '=') + 1;
@@ -1542,7 +1582,7 @@ ical_read_event(FILE * fdi, FILE * log, unsigned *noevents,
 				mem_free(s.buf);
 			}
 			if (vevent.rpt) {
-				time_t day, until;
+				time_t day;
 				long dur;
 				char *msg;
 
@@ -1550,14 +1590,16 @@ ical_read_event(FILE * fdi, FILE * log, unsigned *noevents,
 				day = DAY(vevent.start);
 				msg = _("rrule does not match start day (%s).");
 
-				if (vevent.count) {
-					recur_nth_occurrence(vevent.start,
-							     dur,
-							     vevent.rpt,
-							     &vevent.exc,
-							     vevent.count,
-							     &until);
-					vevent.rpt->until = until;
+				if (vevent.count > 0) {
+					vevent.rpt->count = vevent.count;
+					if (!recur_count_until(vevent.start,
+							       dur, vevent.rpt,
+							       &vevent.exc)) {
+						ical_log(log, ICAL_VEVENT,
+							 ITEMLINE,
+							 _("rrule count is too big."));
+						goto skip;
+					}
 				}
 				if (!recur_item_find_occurrence(vevent.start,
 								dur,
@@ -1614,10 +1656,11 @@ ical_read_event(FILE * fdi, FILE * log, unsigned *noevents,
 			if (!has_exdate) {
 				has_exdate = 1;
 				string_init(&exdate);
-				string_catf(&exdate, "%s", buf);
+				string_append_str(&exdate, buf);
 			} else {
 				p = ical_get_value(buf);
-				string_catf(&exdate, ",%s", p);
+				string_append_char(&exdate, ',');
+				string_append_str(&exdate, p);
 			}
 		} else if (starts_with_ci(buf, "SUMMARY")) {
 			vevent.mesg = ical_read_summary(buf, noskipped,
@@ -34,9 +34,12 @@
  *
  */
 
+#include <ctype.h>
+#include <limits.h>
 #include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/file.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <signal.h>
@@ -44,10 +47,24 @@
 #include <math.h>
 #include <unistd.h>
 #include <errno.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <fcntl.h>
 
 #include "calcurse.h"
 #include "sha1.h"
 
+#ifdef HAVE_SYS_SENDFILE_H
+#include <sys/sendfile.h>
+#endif
+#ifdef HAVE_LINUX_FS_H
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
+
+/* Size of the buffer used to copy or compare files chunk by chunk. */
+#define IO_FILE_BUFSIZ 65536
+
 struct ht_keybindings_s {
 	const char *label;
 	enum vkey key;
@@ -69,6 +86,21 @@ static int modified = 0;
 static char apts_sha1[SHA1_DIGESTLEN * 2 + 1];
 static char todo_sha1[SHA1_DIGESTLEN * 2 + 1];
 
+/*
+ * Contents of a loaded appointment file. The descriptions and note names of
+ * its items point into the buffer instead of being copied, and the buffer is
+ * freed together with the last of them. A reload may leave an older buffer
+ * behind while items of it are still held, e.g. in a cut register.
+ */
+struct io_data {
+	char *buf;
+	size_t len;
+	unsigned refs;
+	struct io_data *next;
+};
+static struct io_data *io_data_list = NULL;
+static pthread_mutex_t io_data_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 /* Ask user for a file name to export data to. */
 static FILE *get_export_stream(enum export_type type)
 {
@@ -191,10 +223,15 @@ void io_init(const char *cfile, const char *datadir, const char *confdir)
 	} else {
 		asprintf(&path_apts, "%s%s", path_ddir, APTS_PATH_NAME);
 	}
+	asprintf(&path_archive, "%s%s", path_apts, ARCHIVE_PATH_SUFFIX);
 	asprintf(&path_todo, "%s%s", path_ddir, TODO_PATH_NAME);
 	asprintf(&path_cpid, "%s%s", path_ddir, CPID_PATH_NAME);
 	asprintf(&path_dpid, "%s%s", path_ddir, DPID_PATH_NAME);
+	asprintf(&path_lock, "%s%s", path_ddir, LOCK_PATH_NAME);
+	asprintf(&path_spool, "%s%s", path_ddir, SPOOL_PATH_NAME);
 	asprintf(&path_notes, "%s%s", path_ddir, NOTES_DIR_NAME);
+	asprintf(&path_notes_pack, "%s%s", path_notes, NOTES_PACK_NAME);
+	asprintf(&path_notes_idx, "%s%s", path_notes, NOTES_INDEX_NAME);
 	asprintf(&path_dmon_log, "%s%s", path_ddir, DLOG_PATH_NAME);
 
 	/* Configuration files */
@@ -218,6 +255,11 @@ void io_extract_data(char *dst_data, const char *org, int len)
 
 static pthread_mutex_t io_mutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_mutex_t io_periodic_save_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t io_load_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int io_loading_data = 0;
+static pthread_t io_load_worker;
+static int io_load_in_worker = 0;
+static char *io_load_errmsg = NULL;
 
 static void io_mutex_lock(void)
 {
@@ -261,45 +303,479 @@ void io_dump_apts(const char *fmt_apt, const char *fmt_rapt,
 }
 
 /*
- * Save the apts data file, which contains the
- * appointments first, and then the events.
- * Recursive items are written first.
+ * Parallel rendering of item lists.
+ *
+ * Long lists are split into chunks which are rendered by a few worker threads,
+ * each into a memory stream of its own. The chunks are then written out in
+ * their original order, so that the output is identical to rendering the
+ * items one by one.
  */
-unsigned io_save_apts(const char *aptsfile)
+#define IO_RENDER_MINITEMS   1024	/* shorter lists are rendered directly */
+#define IO_RENDER_MAXTHREADS 8
+#define IO_RENDER_CHUNKS     4	/* chunks per thread */
+#define IO_RENDER_IOV        16	/* buffers per writev() call */
+
+struct io_render_job {
+	void **items;
+	int nitems;
+	int nchunks;
+	int next;
+	io_render_cb_t cb;
+	void *arg;
+	char **buf;
+	size_t *len;
+	int failed;
+	pthread_mutex_t mutex;
+};
+
+/* Number of threads used to render a list. */
+static int io_render_threads(void)
+{
+	long n = 1;
+
+#ifdef _SC_NPROCESSORS_ONLN
+	n = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	if (n < 1)
+		n = 1;
+	return n < IO_RENDER_MAXTHREADS ? n : IO_RENDER_MAXTHREADS;
+}
+
+static void *io_render_thread(void *arg)
+{
+	struct io_render_job *job = arg;
+	int k, j, first, last;
+	FILE *fp;
+
+	for (;;) {
+		pthread_mutex_lock(&job->mutex);
+		k = job->failed ? job->nchunks : job->next++;
+		pthread_mutex_unlock(&job->mutex);
+		if (k >= job->nchunks)
+			break;
+
+		first = (long)job->nitems * k / job->nchunks;
+		last = (long)job->nitems * (k + 1) / job->nchunks;
+		fp = open_memstream(&job->buf[k], &job->len[k]);
+		if (fp == NULL) {
+			/* Leave the error to the thread that joins us. */
+			pthread_mutex_lock(&job->mutex);
+			job->failed = 1;
+			pthread_mutex_unlock(&job->mutex);
+			break;
+		}
+		for (j = first; j < last; j++)
+			job->cb(fp, job->items[j], job->arg);
+		fclose(fp);
+	}
+
+	return NULL;
+}
+
+/* Write all chunks of a rendered list with as few system calls as possible. */
+static int io_render_flush(int fd, struct io_render_job *job)
 {
+	struct iovec iov[IO_RENDER_IOV];
+	int k = 0, n, j;
+	ssize_t written;
+
+	while (k < job->nchunks) {
+		for (n = 0; n < IO_RENDER_IOV && k + n < job->nchunks; n++) {
+			iov[n].iov_base = job->buf[k + n];
+			iov[n].iov_len = job->len[k + n];
+		}
+		j = 0;
+		while (j < n) {
+			written = writev(fd, iov + j, n - j);
+			if (written < 0) {
+				if (errno == EINTR)
+					continue;
+				return 0;
+			}
+			while (j < n && (size_t)written >= iov[j].iov_len)
+				written -= iov[j++].iov_len;
+			if (j < n) {
+				iov[j].iov_base = (char *)iov[j].iov_base +
+						  written;
+				iov[j].iov_len -= written;
+			}
+		}
+		k += n;
+	}
+
+	return 1;
+}
+
+/*
+ * Render all items of a list, starting with the given list item, to a stream
+ * by calling the callback for each of them. Returns 0 if writing failed.
+ *
+ * The callback must only write to the stream it is passed and must be safe to
+ * run concurrently for different items.
+ */
+int io_render_list(FILE *stream, llist_item_t *first, io_render_cb_t cb,
+		   void *arg)
+{
+	struct io_render_job job;
+	pthread_t thread[IO_RENDER_MAXTHREADS];
 	llist_item_t *i;
+	int nthreads, n = 0, k, ret;
+
+	for (i = first; i; i = LLIST_NEXT(i))
+		n++;
+
+	nthreads = io_render_threads();
+	if (n < IO_RENDER_MINITEMS || nthreads < 2) {
+		for (i = first; i; i = LLIST_NEXT(i))
+			cb(stream, LLIST_GET_DATA(i), arg);
+		return !ferror(stream);
+	}
+
+	job.items = mem_calloc(n, sizeof(void *));
+	job.nitems = 0;
+	for (i = first; i; i = LLIST_NEXT(i))
+		job.items[job.nitems++] = LLIST_GET_DATA(i);
+	job.nchunks = nthreads * IO_RENDER_CHUNKS;
+	job.next = 0;
+	job.cb = cb;
+	job.arg = arg;
+	job.buf = mem_calloc(job.nchunks, sizeof(char *));
+	job.len = mem_calloc(job.nchunks, sizeof(size_t));
+	job.failed = 0;
+	pthread_mutex_init(&job.mutex, NULL);
+
+	for (k = 0; k < nthreads; k++)
+		pthread_create(&thread[k], NULL, io_render_thread, &job);
+	for (k = 0; k < nthreads; k++)
+		pthread_join(thread[k], NULL);
+	EXIT_IF(job.failed, _("could not allocate output buffer"));
+
+	ret = fflush(stream) == 0 && io_render_flush(fileno(stream), &job);
+
+	/* The buffers were allocated by open_memstream(). */
+	for (k = 0; k < job.nchunks; k++)
+		free(job.buf[k]);
+	pthread_mutex_destroy(&job.mutex);
+	mem_free(job.items);
+	mem_free(job.buf);
+	mem_free(job.len);
+
+	return ret;
+}
+
+static void io_render_apoint(FILE *stream, void *item, void *arg)
+{
+	struct apoint *apt = item;
+
+	if (!archive_cold(apt->start, apt->dur, NULL))
+		apoint_write(apt, stream);
+}
+
+static void io_render_event(FILE *stream, void *item, void *arg)
+{
+	struct event *ev = item;
+
+	if (!archive_cold(ev->day, 0, NULL))
+		event_write(ev, stream);
+}
+
+static void io_render_todo(FILE *stream, void *item, void *arg)
+{
+	todo_write(item, stream);
+}
+
+/*
+ * Locking of the data files.
+ *
+ * Data files are never modified in place: they are written to a temporary
+ * file in the same directory first, which is then renamed over the original
+ * one. Readers thus always see a complete file. In order to also see matching
+ * versions of the appointments and the todo list, readers hold a shared lock
+ * on the lock file while loading both, and writers hold an exclusive lock for
+ * the short time it takes to rename the new files into place.
+ *
+ * The locks are taken with flock(), which attaches them to the open file
+ * description rather than to the process: each call opens the lock file anew,
+ * so threads of the same process exclude each other as well, and closing
+ * another descriptor of the lock file does not release them. They must not be
+ * nested, though, as a thread would then wait for itself.
+ */
+static int io_data_lock(int exclusive)
+{
+	int fd;
+
+	/* Read-only sessions must not leave a lock file behind. */
+	if (read_only && !exclusive)
+		fd = open(path_lock, O_RDONLY);
+	else if ((fd = open(path_lock, O_RDWR | O_CREAT, 0644)) < 0 &&
+		 !exclusive)
+		fd = open(path_lock, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	/* Children must not hold on to the lock. */
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+	while (flock(fd, exclusive ? LOCK_EX : LOCK_SH) < 0) {
+		if (errno != EINTR) {
+			close(fd);
+			return -1;
+		}
+	}
+
+	return fd;
+}
+
+static void io_data_unlock(int fd)
+{
+	if (fd >= 0)
+		close(fd);
+}
+
+/* A data file being written to a temporary file. */
+struct io_save_file {
+	char *path;
+	char *tmppath;
 	FILE *fp;
+};
 
-	if (aptsfile) {
-		if (read_only)
-			return 1;
+/* The previous version of a published data file, see io_save_publish_undo(). */
+struct io_save_undo {
+	char *path;
+	char *oldpath;		/* NULL if there was no previous version */
+};
 
-		if ((fp = fopen(aptsfile, "w")) == NULL)
-			return 0;
+/*
+ * Create a temporary file next to the given data file. Symbolic links are
+ * resolved so that the file they point to is replaced, and the permissions of
+ * an existing file are preserved.
+ */
+static char *io_resolve_link(const char *path)
+{
+	char *res = mem_strdup(path), *target, *dir, *sep;
+	struct stat st;
+	ssize_t len;
+	int depth;
+
+	for (depth = 0; depth < 8; depth++) {
+		if (lstat(res, &st) != 0 || !S_ISLNK(st.st_mode))
+			break;
+		target = mem_malloc(st.st_size + 1);
+		len = readlink(res, target, st.st_size + 1);
+		if (len < 0 || len > st.st_size) {
+			mem_free(target);
+			break;
+		}
+		target[len] = '\0';
+
+		if (target[0] != '/' && (sep = strrchr(res, '/'))) {
+			*sep = '\0';
+			asprintf(&dir, "%s/%s", res, target);
+			mem_free(target);
+			target = dir;
+		}
+		mem_free(res);
+		res = target;
+	}
+
+	return res;
+}
+
+static int io_save_open(struct io_save_file *sf, const char *path)
+{
+	struct stat st;
+	mode_t mask;
+	int fd;
+
+	sf->path = io_resolve_link(path);
+	asprintf(&sf->tmppath, "%s.XXXXXX", sf->path);
+	sf->fp = NULL;
+
+	if ((fd = mkstemp(sf->tmppath)) < 0)
+		goto error;
+
+	if (stat(sf->path, &st) == 0) {
+		fchmod(fd, st.st_mode & 07777);
+	} else {
+		mask = umask(0);
+		umask(mask);
+		fchmod(fd, 0666 & ~mask);
+	}
+
+	if (!(sf->fp = fdopen(fd, "w"))) {
+		close(fd);
+		unlink(sf->tmppath);
+		goto error;
+	}
+
+	return 1;
+
+error:
+	mem_free(sf->path);
+	mem_free(sf->tmppath);
+	return 0;
+}
+
+/*
+ * Flush and close a temporary file. If writing failed, the file is removed
+ * and 0 is returned.
+ */
+static int io_save_close(struct io_save_file *sf, int ok)
+{
+	ok = ok && fflush(sf->fp) == 0 && fsync(fileno(sf->fp)) == 0;
+	ok = fclose(sf->fp) == 0 && ok;
+	if (!ok) {
+		unlink(sf->tmppath);
+		mem_free(sf->path);
+		mem_free(sf->tmppath);
+	}
+
+	return ok;
+}
+
+/* Remove a temporary file that is not going to be published. */
+static void io_save_discard(struct io_save_file *sf)
+{
+	unlink(sf->tmppath);
+	mem_free(sf->path);
+	mem_free(sf->tmppath);
+}
+
+/* Replace a data file by the temporary file written before. */
+static int io_save_publish(struct io_save_file *sf)
+{
+	int ret = rename(sf->tmppath, sf->path) == 0;
+
+	if (!ret)
+		unlink(sf->tmppath);
+	mem_free(sf->path);
+	mem_free(sf->tmppath);
+
+	return ret;
+}
+
+/* Drop the previous version of a data file kept by io_save_publish_undo(). */
+static void io_save_commit(struct io_save_undo *undo)
+{
+	if (undo->oldpath) {
+		unlink(undo->oldpath);
+		mem_free(undo->oldpath);
+	}
+	mem_free(undo->path);
+}
+
+/* Restore the data file replaced by io_save_publish_undo(). */
+static void io_save_rollback(struct io_save_undo *undo)
+{
+	if (undo->oldpath) {
+		rename(undo->oldpath, undo->path);
+		mem_free(undo->oldpath);
 	} else {
-		fp = stdout;
+		unlink(undo->path);
+	}
+	mem_free(undo->path);
+}
+
+/*
+ * Publish a temporary file like io_save_publish(), keeping the previous version
+ * of the data file under another name until either io_save_commit() drops it
+ * or io_save_rollback() puts it back.
+ */
+static int io_save_publish_undo(struct io_save_file *sf,
+				struct io_save_undo *undo)
+{
+	int fd;
+
+	undo->path = mem_strdup(sf->path);
+	asprintf(&undo->oldpath, "%s.XXXXXX", sf->path);
+	if ((fd = mkstemp(undo->oldpath)) < 0)
+		goto error;
+	close(fd);
+	unlink(undo->oldpath);
+	if (link(sf->path, undo->oldpath) != 0) {
+		if (errno != ENOENT)
+			goto error;
+		/* There is no previous version. */
+		mem_free(undo->oldpath);
+		undo->oldpath = NULL;
+	}
+
+	if (!io_save_publish(sf)) {
+		io_save_commit(undo);
+		return 0;
 	}
+	return 1;
 
-	recur_save_data(fp);
+error:
+	io_save_discard(sf);
+	mem_free(undo->oldpath);
+	mem_free(undo->path);
+	return 0;
+}
+
+/*
+ * Write the appointments, events and recursive items, which come first, to a
+ * stream.
+ */
+static int io_write_apts(FILE *fp)
+{
+	int ret;
+
+	ret = recur_save_data(fp);
 
 	if (ui_mode == UI_CURSES)
 		LLIST_TS_LOCK(&alist_p);
-	LLIST_TS_FOREACH(&alist_p, i) {
-		struct apoint *apt = LLIST_TS_GET_DATA(i);
-		apoint_write(apt, fp);
-	}
+	ret = io_render_list(fp, LLIST_TS_FIRST(&alist_p), io_render_apoint,
+			     NULL) && ret;
 	if (ui_mode == UI_CURSES)
 		LLIST_TS_UNLOCK(&alist_p);
 
-	LLIST_FOREACH(&eventlist, i) {
-		struct event *ev = LLIST_TS_GET_DATA(i);
-		event_write(ev, fp);
-	}
+	ret = io_render_list(fp, LLIST_FIRST(&eventlist), io_render_event,
+			     NULL) && ret;
 
-	if (aptsfile)
-		file_close(fp, __FILE_POS__);
+	return ret;
+}
 
-	return 1;
+/* Write the todo items to a stream. */
+static int io_write_todo(FILE *fp)
+{
+	return io_render_list(fp, LLIST_FIRST(&todolist), io_render_todo,
+			      NULL);
+}
+
+/*
+ * Save a single data file using the given writer, or print it to stdout if
+ * no file name is specified.
+ */
+static unsigned io_save_file(const char *path, int (*write_fn)(FILE *))
+{
+	struct io_save_file sf;
+	int fd, ret;
+
+	if (!path)
+		return write_fn(stdout);
+	if (read_only)
+		return 1;
+
+	if (!io_save_open(&sf, path))
+		return 0;
+	if (!io_save_close(&sf, write_fn(sf.fp)))
+		return 0;
+
+	fd = io_data_lock(1);
+	ret = io_save_publish(&sf);
+	io_data_unlock(fd);
+
+	return ret;
+}
+
+/*
+ * Save the apts data file, which contains the
+ * appointments first, and then the events.
+ * Recursive items are written first.
+ */
+unsigned io_save_apts(const char *aptsfile)
+{
+	return io_save_file(aptsfile, io_write_apts);
 }
 
 /* Print all todo items to stdout. */
@@ -316,28 +792,110 @@ void io_dump_todo(const char *fmt_todo)
 /* Save the todo data file. */
 unsigned io_save_todo(const char *todofile)
 {
-	llist_item_t *i;
-	FILE *fp;
+	return io_save_file(todofile, io_write_todo);
+}
 
-	if (todofile) {
-		if (read_only)
-			return 1;
+/*
+ * Write the reminder spool for the given version of the apts file into a
+ * temporary file, see notify_write_spool().
+ */
+static int io_save_spool_tmp(struct io_save_file *sf, const struct stat *st)
+{
+	if (!io_save_open(sf, path_spool))
+		return 0;
+	return io_save_close(sf, notify_write_spool(sf->fp, st));
+}
 
-		if ((fp = fopen(todofile, "w")) == NULL)
-			return 0;
-	} else {
-		fp = stdout;
-	}
+/*
+ * Save the reminder spool for the appointments loaded from an apts file with
+ * the given status.
+ */
+unsigned io_save_spool(const struct stat *apts_st)
+{
+	struct io_save_file sf;
 
-	LLIST_FOREACH(&todolist, i) {
-		struct todo *todo = LLIST_TS_GET_DATA(i);
-		todo_write(todo, fp);
+	if (read_only)
+		return 1;
+	if (!io_save_spool_tmp(&sf, apts_st))
+		return 0;
+	return io_save_publish(&sf);
+}
+
+/*
+ * Save both data files, such that readers see either the old or the new
+ * version of both of them. The reminder spool is updated along with them, and
+ * so is the archive when items move into it.
+ */
+static unsigned io_save_files(enum save_type s_t)
+{
+	struct io_save_file apts, todo, spool, archive;
+	struct io_save_undo undo;
+	struct stat st;
+	int fd, ret = 0, has_spool, has_archive, archived = 0;
+
+	if (read_only)
+		return 1;
+
+	has_archive = archive_save_prepare(s_t == periodic);
+	if (has_archive && (!io_save_open(&archive, path_archive) ||
+	    !io_save_close(&archive, archive_write(archive.fp))))
+		goto done;
+	if (!io_save_open(&todo, path_todo))
+		goto discard_archive;
+	if (!io_save_close(&todo, io_write_todo(todo.fp)))
+		goto discard_archive;
+	if (!io_save_open(&apts, path_apts) ||
+	    !io_save_close(&apts, io_write_apts(apts.fp))) {
+		io_save_discard(&todo);
+		goto discard_archive;
 	}
 
-	if (todofile)
-		file_close(fp, __FILE_POS__);
+	/* The new apts file keeps its status when being renamed. */
+	has_spool = stat(apts.tmppath, &st) == 0 &&
+		    io_save_spool_tmp(&spool, &st);
 
-	return 1;
+	fd = io_data_lock(1);
+	/*
+	 * Archived items must not get lost with the new apts file. Neither may
+	 * they show up twice, in the new archive and the old apts file: the
+	 * old archive is put back if the apts file cannot be published.
+	 */
+	if (has_archive &&
+	    !(archived = io_save_publish_undo(&archive, &undo))) {
+		io_data_unlock(fd);
+		io_save_discard(&todo);
+		io_save_discard(&apts);
+		if (has_spool)
+			io_save_discard(&spool);
+		goto done;
+	}
+	ret = io_save_publish(&todo);
+	if (io_save_publish(&apts)) {
+		if (has_archive)
+			io_save_commit(&undo);
+	} else {
+		ret = 0;
+		if (has_archive)
+			io_save_rollback(&undo);
+		archived = 0;
+	}
+	if (has_spool)
+		io_save_publish(&spool);
+	io_data_unlock(fd);
+	goto done;
+
+discard_archive:
+	if (has_archive)
+		io_save_discard(&archive);
+done:
+	archive_save_done(archived);
+	return ret;
+}
+
+/* Save both data files, see io_save_files(). */
+unsigned io_save_data(void)
+{
+	return io_save_files(interactive);
 }
 
 /* Save user-defined keys */
@@ -357,7 +915,7 @@ unsigned io_save_keys(void)
 	return 1;
 }
 
-static int io_compute_hash(const char *path, char *buf)
+int io_compute_hash(const char *path, char *buf)
 {
 	FILE *fp = fopen(path, "r");
 
@@ -462,284 +1020,661 @@ static int resolve_save_conflict(void)
 #define NOKNOW		-1
 static int new_data()
 {
-	char sha1_new[SHA1_DIGESTLEN * 2 + 1];
-	int ret = NONEW;
+	char sha1_new[SHA1_DIGESTLEN * 2 + 1];
+	int ret = NONEW;
+
+	if (io_compute_hash(path_apts, sha1_new)) {
+		if (strncmp(sha1_new, apts_sha1, SHA1_DIGESTLEN * 2) != 0) {
+			ret |= APTS;
+		}
+	} else {
+		ret = NOKNOW;
+		goto exit;
+	}
+
+	if (io_compute_hash(path_todo, sha1_new)) {
+		if (strncmp(sha1_new, todo_sha1, SHA1_DIGESTLEN * 2) != 0) {
+			ret |= TODO;
+		}
+	} else {
+		ret = NOKNOW;
+		goto exit;
+	}
+
+	/* Archived items are part of the appointments. */
+	if (archive_changed())
+		ret |= APTS;
+   exit:
+	return ret;
+}
+
+/*
+ * Save the calendar data.
+ * The return value tells how a possible save conflict should be/was resolved:
+ * IO_SAVE_CTINUE: continue save operation and overwrite the data files
+ * IO_SAVE_RELOAD: cancel save operation (data files changed and reloaded)
+ * IO_SAVE_CANCEL: cancel save operation (user's decision, keep data files, no reload)
+ * IO_SAVE_NOOP: cancel save operation (nothing has changed)
+ * IO_SAVE_ERROR: cannot access data
+ */
+int io_save_cal(enum save_type s_t)
+{
+	int ret, new;
+
+	if (read_only)
+		return IO_SAVE_CANCEL;
+
+	io_mutex_lock();
+	if ((new = new_data()) == NOKNOW) {
+		ret = IO_SAVE_ERROR;
+		goto cleanup;
+	}
+	if (new) { /* New data */
+		if (s_t == periodic) {
+			ret = IO_SAVE_CANCEL;
+			goto cleanup;
+		}
+		/* Interactively decide what to do. */
+		if ((ret = resolve_save_conflict()))
+			goto cleanup;
+	} else /* No new data */
+		if (!io_get_modified()) {
+			ret = IO_SAVE_NOOP;
+			goto cleanup;
+		}
+
+	ret = IO_SAVE_CTINUE;
+	run_hook("pre-save");
+	if (io_save_files(s_t)) {
+		io_compute_hash(path_apts, apts_sha1);
+		io_compute_hash(path_todo, todo_sha1);
+		io_unset_modified();
+		/* The saved data no longer references queued notes. */
+		if (conf.auto_gc)
+			note_gc();
+	} else
+		ret = IO_SAVE_ERROR;
+	run_hook("post-save");
+
+cleanup:
+	io_mutex_unlock();
+	return ret;
+}
+
+/*
+ * Report an error found while loading a data file, at the given line if it is
+ * not 0, and exit.
+ */
+void io_load_error(const char *filename, unsigned line, const char *mesg)
+{
+	char *err;
+
+	if (line)
+		asprintf(&err, "%s:%u: %s", filename, line, mesg);
+	else
+		asprintf(&err, "%s: %s", filename, mesg);
+
+	/*
+	 * Files loaded on a worker thread leave the error to the thread
+	 * waiting for them, see io_load_thread_error() and
+	 * io_load_app_noexit().
+	 */
+	pthread_mutex_lock(&io_load_mutex);
+	if (io_load_in_worker && pthread_equal(io_load_worker, pthread_self())) {
+		io_load_errmsg = err;
+		io_loading_data = 0;
+		pthread_mutex_unlock(&io_load_mutex);
+		pthread_exit(NULL);
+	}
+	pthread_mutex_unlock(&io_load_mutex);
+
+	EXIT("%s", err);
+}
+
+/* Make errors found while loading on the current thread end the thread. */
+static void io_load_worker_enter(void)
+{
+	pthread_mutex_lock(&io_load_mutex);
+	io_load_worker = pthread_self();
+	io_load_in_worker = 1;
+	pthread_mutex_unlock(&io_load_mutex);
+}
+
+/* Find the buffer of a loaded appointment file a string belongs to. */
+static struct io_data **io_data_find(const char *str)
+{
+	struct io_data **d;
+
+	for (d = &io_data_list; *d; d = &(*d)->next) {
+		if (str >= (*d)->buf && str <= (*d)->buf + (*d)->len)
+			return d;
+	}
+	return NULL;
+}
+
+/* Drop a reference to the buffer of a loaded appointment file. */
+static void io_data_unref(struct io_data **d)
+{
+	struct io_data *tmp;
+
+	if (--(*d)->refs > 0)
+		return;
+	tmp = *d;
+	*d = tmp->next;
+	mem_free(tmp->buf);
+	mem_free(tmp);
+}
+
+/*
+ * Get a string to store in an item: the string itself if it is part of a
+ * loaded appointment file, or a copy of it otherwise.
+ */
+char *io_data_str(char *str)
+{
+	struct io_data **d;
+
+	pthread_mutex_lock(&io_data_mutex);
+	if ((d = io_data_find(str)))
+		(*d)->refs++;
+	pthread_mutex_unlock(&io_data_mutex);
+
+	return d ? str : mem_strdup(str);
+}
+
+/* Free a string obtained from io_data_str(). */
+void io_data_str_free(char *str)
+{
+	struct io_data **d;
+
+	pthread_mutex_lock(&io_data_mutex);
+	if ((d = io_data_find(str)))
+		io_data_unref(d);
+	pthread_mutex_unlock(&io_data_mutex);
+
+	if (!d)
+		mem_free(str);
+}
+
+/*
+ * Read a note file name. If the file contents are kept in data, the name is
+ * terminated in place instead of being copied to buf.
+ */
+static char *io_load_note(FILE *f, char *data, char *buf, const char *path,
+			  unsigned line)
+{
+	char *p;
+	size_t n;
+
+	if (!data) {
+		note_read(buf, f);
+		return buf;
+	}
+
+	p = data + ftello(f);
+	n = strcspn(p, " \n");
+	if (p[n] != ' ')
+		io_load_error(path, line, _("syntax error in note"));
+	fseeko(f, n + 1, SEEK_CUR);
+	p[MIN(n, MAX_NOTESIZ)] = '\0';
+	return p;
+}
+
+/*
+ * Read the item description up to the end of the line. If the file contents
+ * are kept in data, the description is terminated in place instead of being
+ * copied to buf.
+ */
+static char *io_load_desc(FILE *f, char *data, char *buf, int size)
+{
+	char *p, *nl;
+	size_t n;
+
+	if (!data) {
+		if (!fgets(buf, size, f))
+			return NULL;
+		p = buf;
+	} else {
+		p = data + ftello(f);
+		n = strcspn(p, "\n");
+		if (n == 0 && p[n] == '\0')
+			return NULL;
+		fseeko(f, p[n] ? n + 1 : n, SEEK_CUR);
+	}
+
+	if ((nl = strchr(p, '\n')))
+		*nl = '\0';
+	return p;
+}
+
+/*
+ * Check what type of data is written at the current position of the
+ * appointment file, and then load either: a new appointment, a new event, or a
+ * new recursive item (which can also be either an event or an appointment).
+ */
+static void io_load_app_item(FILE *data_file, char *data, const char *path,
+			     unsigned line, struct item_filter *filter)
+{
+	int c, is_appointment = 0, is_event = 0, is_recursive = 0;
+	struct tm start, end, until;
+	struct rpt rpt;
+	int id = 0;
+	char type, state = 0L;
+	char note[MAX_NOTESIZ + 1], *notep;
+	char buf[BUFSIZ], *mesg;
+	char *scan_error = NULL;
+
+	memset(&start, 0, sizeof(start));
+	end = until = start;
+
+	/* Read the date first: it is common to both events
+	 * and appointments.
+	 */
+	if (fscanf(data_file, "%d / %d / %d ",
+		   &start.tm_mon, &start.tm_mday,
+		   &start.tm_year) != 3)
+		io_load_error(path, line,
+			      _("syntax error in the item date"));
+
+	/* Read the next character : if it is an '@' then we have
+	 * an appointment, else if it is an '[' we have en event.
+	 */
+	c = getc(data_file);
+
+	if (c == '@')
+		is_appointment = 1;
+	else if (c == '[')
+		is_event = 1;
+	else
+		io_load_error(path, line,
+			      _("no event nor appointment found"));
+
+	/* Read the remaining informations. */
+	if (is_appointment) {
+		if (fscanf
+		    (data_file,
+		     " %d : %d -> %d / %d / %d @ %d : %d ",
+		     &start.tm_hour, &start.tm_min, &end.tm_mon,
+		     &end.tm_mday, &end.tm_year, &end.tm_hour,
+		     &end.tm_min) != 7)
+			io_load_error(path, line,
+				      _("syntax error in item time or duration"));
+	} else if (is_event) {
+		if (fscanf(data_file, " %d ", &id) != 1
+		    || getc(data_file) != ']')
+			io_load_error(path, line,
+				      _("syntax error in item identifier"));
+		while ((c = getc(data_file)) == ' ') ;
+		ungetc(c, data_file);
+	} else {
+		io_load_error(path, line,
+			      _("wrong format in the appointment or event"));
+		/* NOTREACHED */
+	}
+
+	/* Check if we have a recursive item. */
+	c = getc(data_file);
+
+	if (c == '{') {
+		is_recursive = 1;
+		if (fscanf(data_file, " %d%c ", &rpt.freq, &type) != 2)
+			io_load_error(path, line,
+				      _("syntax error in item repetition"));
+		else
+			rpt.type = recur_char2def(type);
+		c = getc(data_file);
+		/* Optional until date */
+		if (c == '-' && getc(data_file) == '>') {
+			if (fscanf
+			    (data_file, " %d / %d / %d ",
+			     &until.tm_mon, &until.tm_mday,
+			     &until.tm_year) != 3)
+				io_load_error(path, line,
+					      _("syntax error in until date"));
+			if (!check_date(until.tm_year, until.tm_mon,
+					until.tm_mday))
+				io_load_error(path, line,
+					      _("until date error"));
+			until.tm_hour = 0;
+			until.tm_min = 0;
+			until.tm_sec = 0;
+			until.tm_isdst = -1;
+			until.tm_year -= 1900;
+			until.tm_mon--;
+			rpt.until = mktime(&until);
+			rpt.count = 0;
+			c = getc(data_file);
+		} else if (c == '#') {
+			/* Optional count, the until day is derived. */
+			if (fscanf(data_file, "%d ", &rpt.count) != 1 ||
+			    rpt.count <= 0)
+				io_load_error(path, line,
+					      _("syntax error in repeat count"));
+			rpt.until = 0;
+			c = getc(data_file);
+		} else {
+			rpt.until = 0;
+			rpt.count = 0;
+		}
+		/* Optional bymonthday list */
+		if (c == 'd') {
+			if (rpt.type == RECUR_WEEKLY)
+				io_load_error(path, line,
+					      _("BYMONTHDAY illegal with WEEKLY"));
+			ungetc(c, data_file);
+			recur_bymonthday(&rpt.bymonthday, data_file);
+			c = getc(data_file);
+		} else
+			LLIST_INIT(&rpt.bymonthday);
+		/* Optional bywday list */
+		if (c == 'w') {
+			ungetc(c, data_file);
+			recur_bywday(rpt.type, &rpt.bywday, data_file);
+			c = getc(data_file);
+		} else
+			LLIST_INIT(&rpt.bywday);
+		/* Optional bymonth list */
+		if (c == 'm') {
+			ungetc(c, data_file);
+			recur_bymonth(&rpt.bymonth, data_file);
+			c = getc(data_file);
+		} else
+			LLIST_INIT(&rpt.bymonth);
+		/* Optional exception dates */
+		if (c == '!') {
+			ungetc(c, data_file);
+			recur_exc_scan(&rpt.exc, data_file);
+			c = getc(data_file);
+		} else
+			LLIST_INIT(&rpt.exc);
+		/* End of recurrence rule */
+		if (c != '}')
+			io_load_error(path, line,
+				      _("missing end of recurrence"));
+		while ((c = getc(data_file)) == ' ') ;
+	}
+
+	/* Check if a note is attached to the item. */
+	if (c == '>') {
+		notep = io_load_note(data_file, data, note, path, line);
+		c = getc(data_file);
+	} else
+		notep = NULL;
+
+	/*
+	 * Last: read the item description and load it into its
+	 * corresponding linked list, depending on the item type.
+	 */
+	if (is_appointment) {
+		if (c == '!')
+			state |= APOINT_NOTIFY;
+		else if (c == '|')
+			state = 0L;
+		else
+			io_load_error(path, line,
+				      _("syntax error in item state"));
+	} else {
+		ungetc(c, data_file);
+	}
+	mesg = io_load_desc(data_file, data, buf, sizeof(buf));
+	if (!mesg)
+		io_load_error(path, line,
+			      _("error in appointment description"));
+
+	if (is_appointment) {
+		if (is_recursive)
+			scan_error = recur_apoint_scan(mesg, start, end, state,
+					  notep, filter, &rpt);
+		else
+			scan_error = apoint_scan(mesg, start, end, state,
+				    notep, filter);
+	} else if (is_event) {
+		if (is_recursive)
+			scan_error = recur_event_scan(mesg, start, id, notep,
+					 filter, &rpt);
+		else
+			scan_error = event_scan(mesg, start, id, notep, filter);
+	} else {
+		io_load_error(path, line,
+			      _("wrong format in the appointment or event"));
+		/* NOTREACHED */
+	}
+	if (scan_error)
+		io_load_error(path, line, scan_error);
+}
+
+/* Skip blanks and read a decimal number in the line ending at e. */
+static int io_skim_int(const char **p, const char *e, int *n)
+{
+	const char *s = *p;
+
+	while (s < e && *s == ' ')
+		s++;
+	if (s == e || !isdigit((unsigned char)*s))
+		return 0;
+	for (*n = 0; s < e && isdigit((unsigned char)*s); s++)
+		*n = *n * 10 + (*s - '0');
+	*p = s;
+	return 1;
+}
+
+/* Skip blanks and the given character in the line ending at e. */
+static int io_skim_char(const char **p, const char *e, char c)
+{
+	const char *s = *p;
+
+	while (s < e && *s == ' ')
+		s++;
+	if (s == e || *s != c)
+		return 0;
+	*p = s + 1;
+	return 1;
+}
+
+/* Read a date (mm/dd/yyyy) as a day number. */
+static int io_skim_date(const char **p, const char *e, long *day)
+{
+	struct date d;
+	int mm, dd, yyyy;
+
+	if (!io_skim_int(p, e, &mm) || !io_skim_char(p, e, '/') ||
+	    !io_skim_int(p, e, &dd) || !io_skim_char(p, e, '/') ||
+	    !io_skim_int(p, e, &yyyy) || !check_date(yyyy, mm, dd))
+		return 0;
+	d.mm = mm;
+	d.dd = dd;
+	d.yyyy = yyyy;
+	*day = date2daynum(d);
+	return 1;
+}
+
+/*
+ * Get the days an item of the appointment file may occur on from the start of
+ * its line, without parsing the description, note and recurrence rules. An
+ * unbounded recurrence lasts until LONG_MAX. Return 0 if the line is malformed.
+ */
+static int io_skim_app(const char *p, const char *e, long *first, long *last)
+{
+	long start, end, until;
+	int h1, m1, h2, m2, n;
 
-	if (io_compute_hash(path_apts, sha1_new)) {
-		if (strncmp(sha1_new, apts_sha1, SHA1_DIGESTLEN * 2) != 0) {
-			ret |= APTS;
-		}
-	} else {
-		ret = NOKNOW;
-		goto exit;
+	if (!io_skim_date(&p, e, &start))
+		return 0;
+	end = start;
+	if (io_skim_char(&p, e, '@')) {
+		if (!io_skim_int(&p, e, &h1) || !io_skim_char(&p, e, ':') ||
+		    !io_skim_int(&p, e, &m1) || !io_skim_char(&p, e, '-') ||
+		    !io_skim_char(&p, e, '>') || !io_skim_date(&p, e, &end) ||
+		    !io_skim_char(&p, e, '@') || !io_skim_int(&p, e, &h2) ||
+		    !io_skim_char(&p, e, ':') || !io_skim_int(&p, e, &m2) ||
+		    !check_time(h1, m1) || !check_time(h2, m2) ||
+		    end < start || (end == start &&
+		    h2 * HOURINMIN + m2 < h1 * HOURINMIN + m1))
+			return 0;
+	} else if (!io_skim_char(&p, e, '[') || !io_skim_int(&p, e, &n) ||
+		   !io_skim_char(&p, e, ']')) {
+		return 0;
 	}
+	*first = start;
+	*last = end;
 
-	if (io_compute_hash(path_todo, sha1_new)) {
-		if (strncmp(sha1_new, todo_sha1, SHA1_DIGESTLEN * 2) != 0) {
-			ret |= TODO;
-		}
-	} else {
-		ret = NOKNOW;
-		goto exit;
-	}
-   exit:
-	return ret;
+	if (!io_skim_char(&p, e, '{'))
+		return 1;
+	/* The last occurrence of a recurring item starts on the until day. */
+	if (!io_skim_int(&p, e, &n) || p == e)
+		return 0;
+	p++;
+	if (!io_skim_char(&p, e, '-'))
+		*last = LONG_MAX;
+	else if (io_skim_char(&p, e, '>') && io_skim_date(&p, e, &until) &&
+		 until >= start)
+		*last = until + (end - start);
+	else
+		return 0;
+	return 1;
 }
 
 /*
- * Save the calendar data.
- * The return value tells how a possible save conflict should be/was resolved:
- * IO_SAVE_CTINUE: continue save operation and overwrite the data files
- * IO_SAVE_RELOAD: cancel save operation (data files changed and reloaded)
- * IO_SAVE_CANCEL: cancel save operation (user's decision, keep data files, no reload)
- * IO_SAVE_NOOP: cancel save operation (nothing has changed)
- * IO_SAVE_ERROR: cannot access data
+ * Load the appointments of the days a read-only query needs. The appointment
+ * file is memory-mapped and only the lines of items that may occur on these
+ * days are parsed, so that memory use follows the size of the query rather
+ * than the size of the file. Return 0 if the file cannot be mapped.
  */
-int io_save_cal(enum save_type s_t)
+static int io_load_app_range(struct item_filter *filter)
 {
-	int ret, new;
-
-	if (read_only)
-		return IO_SAVE_CANCEL;
+	FILE *data_file;
+	struct stat st;
+	const char *map, *p, *e, *nl;
+	long from = sec2daynum(filter->range_from);
+	long to = sec2daynum(filter->range_to);
+	long first, last;
+	unsigned line = 0;
+	int fd;
 
-	io_mutex_lock();
-	if ((new = new_data()) == NOKNOW) {
-		ret = IO_SAVE_ERROR;
-		goto cleanup;
+	fd = open(path_apts, O_RDONLY);
+	EXIT_IF(fd < 0, _("failed to open appointment file"));
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		close(fd);
+		return 0;
 	}
-	if (new) { /* New data */
-		if (s_t == periodic) {
-			ret = IO_SAVE_CANCEL;
-			goto cleanup;
-		}
-		/* Interactively decide what to do. */
-		if ((ret = resolve_save_conflict()))
-			goto cleanup;
-	} else /* No new data */
-		if (!io_get_modified()) {
-			ret = IO_SAVE_NOOP;
-			goto cleanup;
-		}
-
-	ret = IO_SAVE_CTINUE;
-	run_hook("pre-save");
-	if (io_save_todo(path_todo) &&
-	    io_save_apts(path_apts)) {
-		io_compute_hash(path_apts, apts_sha1);
-		io_compute_hash(path_todo, todo_sha1);
-		io_unset_modified();
-	} else
-		ret = IO_SAVE_ERROR;
-	run_hook("post-save");
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return 0;
+	data_file = fmemopen((void *)map, st.st_size, "r");
+	if (!data_file) {
+		munmap((void *)map, st.st_size);
+		return 0;
+	}
+	posix_madvise((void *)map, st.st_size, POSIX_MADV_SEQUENTIAL);
 
-cleanup:
-	io_mutex_unlock();
-	return ret;
-}
+	for (p = map, e = map + st.st_size; p < e; p = nl < e ? nl + 1 : e) {
+		line++;
+		nl = memchr(p, '\n', e - p);
+		if (!nl)
+			nl = e;
+		/* Malformed lines are parsed to report the error. */
+		if (io_skim_app(p, nl, &first, &last) &&
+		    (last < from || first > to))
+			continue;
+		fseeko(data_file, p - map, SEEK_SET);
+		io_load_app_item(data_file, NULL, path_apts, line, filter);
+	}
 
-static void io_load_error(const char *filename, unsigned line,
-			  const char *mesg)
-{
-	EXIT("%s:%u: %s", filename, line, mesg);
+	file_close(data_file, __FILE_POS__);
+	munmap((void *)map, st.st_size);
+	return 1;
 }
 
 /*
- * Check what type of data is written in the appointment file,
- * and then load either: a new appointment, a new event, or a new
- * recursive item (which can also be either an event or an appointment).
+ * Load the appointment file. If the filter restricts loading to a range of
+ * days, the file hash used to detect changes is not computed.
  */
 void io_load_app(struct item_filter *filter)
 {
 	FILE *data_file;
-	int c, is_appointment, is_event, is_recursive;
-	struct tm start, end, until, lt;
-	struct rpt rpt;
-	time_t t;
-	int id = 0;
-	char type, state = 0L;
-	char note[MAX_NOTESIZ + 1], *notep;
-	unsigned line = 0;
-	char *scan_error;
+	struct stat st;
+	char *buf;
+	size_t len;
 
-	t = time(NULL);
-	localtime_r(&t, &lt);
-	start = end = until = lt;
+	if (filter && filter->range_from != -1 &&
+	    io_load_app_range(filter))
+		return;
 
 	data_file = fopen(path_apts, "r");
-	EXIT_IF(data_file == NULL, _("failed to open appointment file"));
+	if (data_file == NULL)
+		io_load_error(path_apts, 0, _("failed to open appointment file"));
 
 	sha1_stream(data_file, apts_sha1);
 	rewind(data_file);
 
-	for (;;) {
-		is_appointment = is_event = is_recursive = 0;
-		line++;
-		scan_error = NULL;
-
-		c = getc(data_file);
-		if (c == EOF)
-			break;
-		ungetc(c, data_file);
-
-		/* Read the date first: it is common to both events
-		 * and appointments.
-		 */
-		if (fscanf(data_file, "%d / %d / %d ",
-			   &start.tm_mon, &start.tm_mday,
-			   &start.tm_year) != 3)
-			io_load_error(path_apts, line,
-				      _("syntax error in the item date"));
-
-		/* Read the next character : if it is an '@' then we have
-		 * an appointment, else if it is an '[' we have en event.
-		 */
-		c = getc(data_file);
+	/* Keep the file contents for the strings of the loaded items. */
+	if (fstat(fileno(data_file), &st) != 0)
+		io_load_error(path_apts, 0, _("failed to open appointment file"));
+	if (st.st_size == 0) {
+		file_close(data_file, __FILE_POS__);
+		return;
+	}
+	buf = mem_malloc(st.st_size + 1);
+	len = fread(buf, 1, st.st_size, data_file);
+	buf[len] = '\0';
+	file_close(data_file, __FILE_POS__);
 
-		if (c == '@')
-			is_appointment = 1;
-		else if (c == '[')
-			is_event = 1;
-		else
-			io_load_error(path_apts, line,
-				      _("no event nor appointment found"));
+	io_load_app_buf(buf, len, path_apts, filter);
+}
 
-		/* Read the remaining informations. */
-		if (is_appointment) {
-			if (fscanf
-			    (data_file,
-			     " %d : %d -> %d / %d / %d @ %d : %d ",
-			     &start.tm_hour, &start.tm_min, &end.tm_mon,
-			     &end.tm_mday, &end.tm_year, &end.tm_hour,
-			     &end.tm_min) != 7)
-				io_load_error(path_apts, line,
-					      _("syntax error in item time or duration"));
-		} else if (is_event) {
-			if (fscanf(data_file, " %d ", &id) != 1
-			    || getc(data_file) != ']')
-				io_load_error(path_apts, line,
-					      _("syntax error in item identifier"));
-			while ((c = getc(data_file)) == ' ') ;
-			ungetc(c, data_file);
-		} else {
-			io_load_error(path_apts, line,
-				      _("wrong format in the appointment or event"));
-			/* NOTREACHED */
-		}
+/*
+ * Load appointments from a null-terminated buffer in appointment file format,
+ * read from the given file. The buffer is kept for the strings of the loaded
+ * items and freed once they are all gone.
+ */
+/* State of io_load_app_buf(), released even if parsing ends the thread. */
+struct io_load_buf {
+	struct io_data *d;
+	FILE *fp;
+};
 
-		/* Check if we have a recursive item. */
-		c = getc(data_file);
+static void io_load_buf_release(void *arg)
+{
+	struct io_load_buf *lb = arg;
 
-		if (c == '{') {
-			is_recursive = 1;
-			if (fscanf(data_file, " %d%c ", &rpt.freq, &type) != 2)
-				io_load_error(path_apts, line,
-					      _("syntax error in item repetition"));
-			else
-				rpt.type = recur_char2def(type);
-			c = getc(data_file);
-			/* Optional until date */
-			if (c == '-' && getc(data_file) == '>') {
-				if (fscanf
-				    (data_file, " %d / %d / %d ",
-				     &until.tm_mon, &until.tm_mday,
-				     &until.tm_year) != 3)
-					io_load_error(path_apts, line,
-						      _("syntax error in until date"));
-				if (!check_date(until.tm_year, until.tm_mon,
-						until.tm_mday))
-					io_load_error(path_apts, line,
-						      _("until date error"));
-				until.tm_hour = 0;
-				until.tm_min = 0;
-				until.tm_sec = 0;
-				until.tm_isdst = -1;
-				until.tm_year -= 1900;
-				until.tm_mon--;
-				rpt.until = mktime(&until);
-				c = getc(data_file);
-			} else
-				rpt.until = 0;
-			/* Optional bymonthday list */
-			if (c == 'd') {
-				if (rpt.type == RECUR_WEEKLY)
-					io_load_error(path_apts, line,
-						      _("BYMONTHDAY illegal with WEEKLY"));
-				ungetc(c, data_file);
-				recur_bymonthday(&rpt.bymonthday, data_file);
-				c = getc(data_file);
-			} else
-				LLIST_INIT(&rpt.bymonthday);
-			/* Optional bywday list */
-			if (c == 'w') {
-				ungetc(c, data_file);
-				recur_bywday(rpt.type, &rpt.bywday, data_file);
-				c = getc(data_file);
-			} else
-				LLIST_INIT(&rpt.bywday);
-			/* Optional bymonth list */
-			if (c == 'm') {
-				ungetc(c, data_file);
-				recur_bymonth(&rpt.bymonth, data_file);
-				c = getc(data_file);
-			} else
-				LLIST_INIT(&rpt.bymonth);
-			/* Optional exception dates */
-			if (c == '!') {
-				ungetc(c, data_file);
-				recur_exc_scan(&rpt.exc, data_file);
-				c = getc(data_file);
-			} else
-				LLIST_INIT(&rpt.exc);
-			/* End of recurrence rule */
-			if (c != '}')
-				io_load_error(path_apts, line,
-					      _("missing end of recurrence"));
-			while ((c = getc(data_file)) == ' ') ;
-		}
+	if (lb->fp)
+		file_close(lb->fp, __FILE_POS__);
+	pthread_mutex_lock(&io_data_mutex);
+	io_data_unref(io_data_find(lb->d->buf));
+	pthread_mutex_unlock(&io_data_mutex);
+}
 
-		/* Check if a note is attached to the item. */
-		if (c == '>') {
-			note_read(note, data_file);
-			c = getc(data_file);
-			notep = note;
-		} else
-			notep = NULL;
+void io_load_app_buf(char *buf, size_t len, const char *path,
+		     struct item_filter *filter)
+{
+	struct io_load_buf lb;
+	unsigned line = 0;
+	int c;
 
-		/*
-		 * Last: read the item description and load it into its
-		 * corresponding linked list, depending on the item type.
-		 */
-		if (is_appointment) {
-			if (c == '!')
-				state |= APOINT_NOTIFY;
-			else if (c == '|')
-				state = 0L;
-			else
-				io_load_error(path_apts, line,
-					      _("syntax error in item state"));
-
-			if (is_recursive)
-				scan_error = recur_apoint_scan(data_file, start, end, state,
-						  notep, filter, &rpt);
-			else
-				scan_error = apoint_scan(data_file, start, end, state,
-					    notep, filter);
-		} else if (is_event) {
-			ungetc(c, data_file);
-			if (is_recursive)
-				scan_error = recur_event_scan(data_file, start, id, notep,
-						 filter, &rpt);
-			else
-				scan_error = event_scan(data_file, start, id, notep, filter);
-		} else {
-			io_load_error(path_apts, line,
-				      _("wrong format in the appointment or event"));
-			/* NOTREACHED */
-		}
-		if (scan_error)
-			io_load_error(path_apts, line, scan_error);
+	if (len == 0) {
+		mem_free(buf);
+		return;
 	}
-	file_close(data_file, __FILE_POS__);
+	lb.d = mem_malloc(sizeof(struct io_data));
+	lb.d->buf = buf;
+	lb.d->len = len;
+	lb.d->refs = 1;
+	lb.fp = NULL;
+
+	pthread_mutex_lock(&io_data_mutex);
+	lb.d->next = io_data_list;
+	io_data_list = lb.d;
+	pthread_mutex_unlock(&io_data_mutex);
+
+	pthread_cleanup_push(io_load_buf_release, &lb);
+	lb.fp = fmemopen(lb.d->buf, lb.d->len, "r");
+	if (lb.fp == NULL)
+		io_load_error(path, 0, _("failed to open appointment file"));
+	while ((c = getc(lb.fp)) != EOF) {
+		ungetc(c, lb.fp);
+		io_load_app_item(lb.fp, lb.d->buf, path, ++line, filter);
+	}
+	pthread_cleanup_pop(1);
 }
 
 /* Load the todo data */
@@ -750,6 +1685,7 @@ void io_load_todo(struct item_filter *filter)
 	int c, id, completed, cond;
 	char buf[BUFSIZ], e_todo[BUFSIZ], note[MAX_NOTESIZ + 1];
 	unsigned line = 0;
+	int n = 0;
 
 	data_file = fopen(path_todo, "r");
 	EXIT_IF(data_file == NULL, _("failed to open todo file"));
@@ -824,6 +1760,15 @@ void io_load_todo(struct item_filter *filter)
 
 		if (!todo)
 			todo = todo_add(e_todo, id, completed, note);
+
+		/*
+		 * A limited query only prints the first items of the sorted
+		 * list, so there is no need to keep more of them around.
+		 */
+		if (filter && filter->limit >= 0 && ++n > filter->limit) {
+			todo_delete_last();
+			n--;
+		}
 	}
 	file_close(data_file, __FILE_POS__);
 }
@@ -836,6 +1781,8 @@ void io_load_todo(struct item_filter *filter)
  */
 int io_load_data(struct item_filter *filter, int force)
 {
+	int fd;
+
 	run_hook("pre-load");
 	if (force)
 		force = APTS_TODO;
@@ -845,6 +1792,7 @@ int io_load_data(struct item_filter *filter, int force)
 	if (force == NOKNOW)
 		goto exit;
 
+	fd = io_data_lock(0);
 	if (force & APTS) {
 		apoint_llist_free();
 		event_llist_free();
@@ -855,12 +1803,14 @@ int io_load_data(struct item_filter *filter, int force)
 		recur_apoint_llist_init();
 		recur_event_llist_init();
 		io_load_app(filter);
+		archive_open();
 	}
 	if (force & TODO) {
 		todo_free_list();
 		todo_init_list();
 		io_load_todo(filter);
 	}
+	io_data_unlock(fd);
 
 	io_unset_modified();
    exit:
@@ -870,13 +1820,16 @@ int io_load_data(struct item_filter *filter, int force)
 
 /*
  * The return codes reflect the user choice in case of unsaved in-memory changes.
+ * The types of the items that were reloaded are stored in loaded, as a mask of
+ * TYPE_MASK_CAL and TYPE_MASK_TODO.
  */
-int io_reload_data(void)
+int io_reload_data(int *loaded)
 {
 	char *msg_um_asktype = NULL;
 	int load = NOFORCE;
 	int ret = IO_RELOAD_LOAD;
 
+	*loaded = 0;
 	io_mutex_lock();
 	if (io_get_modified()) {
 		const char *msg_um_prefix =
@@ -912,6 +1865,9 @@ int io_reload_data(void)
 		ret = IO_RELOAD_NOOP;
 	else if (load == NOKNOW)
 		ret = IO_RELOAD_ERROR;
+	else
+		*loaded = (load & APTS ? TYPE_MASK_CAL : 0) |
+			  (load & TODO ? TYPE_MASK_TODO : 0);
 cleanup:
 	io_mutex_unlock();
 	mem_free(msg_um_asktype);
@@ -1208,6 +2164,7 @@ void io_export_data(enum export_type type, int export_uid)
 	if (stream == NULL)
 		return;
 
+	archive_load_all(NULL);
 	if (type == IO_EXPORT_ICAL)
 		ical_export_data(stream, export_uid);
 	else if (type == IO_EXPORT_PCAL)
@@ -1439,7 +2396,7 @@ static void *io_psave_thread(void *arg)
 
 	pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, NULL);
 	for (;;) {
-		sleep(delay * MININSEC);
+		psleep(delay * MININSEC);
 		pthread_mutex_lock(&io_periodic_save_mutex);
 		if (io_save_cal(periodic) == IO_SAVE_CANCEL)
 			que_ins(mesg, now(), 2);
@@ -1447,6 +2404,93 @@ static void *io_psave_thread(void *arg)
 	}
 }
 
+/* Thread used to load the data files during startup. */
+static void *io_load_thread(void *arg)
+{
+	io_load_worker_enter();
+	io_load_data(NULL, FORCE);
+
+	pthread_mutex_lock(&io_load_mutex);
+	io_loading_data = 0;
+	pthread_mutex_unlock(&io_load_mutex);
+
+	return NULL;
+}
+
+/*
+ * Load the data files in the background, so that the user interface can be
+ * drawn in the meantime. The item lists must not be accessed until
+ * io_loading() returns false and io_stop_load_thread() has been called.
+ */
+void io_start_load_thread(void)
+{
+	io_loading_data = 1;
+	pthread_create(&io_t_load, NULL, io_load_thread, NULL);
+}
+
+/* Check whether the data files are still being loaded. */
+int io_loading(void)
+{
+	int ret;
+
+	pthread_mutex_lock(&io_load_mutex);
+	ret = io_loading_data;
+	pthread_mutex_unlock(&io_load_mutex);
+
+	return ret;
+}
+
+/* Wait for the data files to be loaded. */
+void io_stop_load_thread(void)
+{
+	/* Is the thread running? */
+	if (pthread_equal(io_t_load, pthread_self()))
+		return;
+
+	pthread_join(io_t_load, NULL);
+	io_t_load = pthread_self();
+	io_load_in_worker = 0;
+}
+
+/*
+ * Return the error that stopped the background load, if any. Only valid once
+ * io_stop_load_thread() has been called.
+ */
+const char *io_load_thread_error(void)
+{
+	return io_load_errmsg;
+}
+
+static void *io_load_app_thread(void *arg)
+{
+	io_load_worker_enter();
+	io_load_app(arg);
+
+	return NULL;
+}
+
+/*
+ * Load the appointments like io_load_app(), but return errors in the
+ * appointment file instead of exiting. Returns NULL on success, or the error
+ * message, which must be freed with free().
+ */
+char *io_load_app_noexit(struct item_filter *filter)
+{
+	pthread_t thread;
+	char *msg;
+
+	pthread_create(&thread, NULL, io_load_app_thread, filter);
+	pthread_join(thread, NULL);
+
+	pthread_mutex_lock(&io_load_mutex);
+	msg = io_load_errmsg;
+	io_load_errmsg = NULL;
+	io_load_in_worker = 0;
+	pthread_mutex_unlock(&io_load_mutex);
+
+	return msg;
+}
+
 /* Launch the thread which handles periodic saves. */
 void io_start_psave_thread(void)
 {
@@ -1555,28 +2599,141 @@ unsigned io_get_pid(char *file)
 }
 
 /*
- * Check whether two files are equal.
+ * Read up to len bytes, stopping early only at the end of the file. Return the
+ * number of bytes read, or -1 on error.
  */
-int io_files_equal(const char *file1, const char *file2)
+static ssize_t io_read_full(int fd, char *buf, size_t len)
+{
+	size_t done = 0;
+	ssize_t n;
+
+	while (done < len) {
+		n = read(fd, buf + done, len - done);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0)
+			return -1;
+		if (n == 0)
+			break;
+		done += n;
+	}
+
+	return done;
+}
+
+/* Compare the contents of two open files by reading them in chunks. */
+static int io_fds_equal(int fd1, int fd2)
 {
-	FILE *fp1, *fp2;
+	char *buf1, *buf2;
+	ssize_t n1, n2;
 	int ret = 0;
 
+	buf1 = mem_malloc(IO_FILE_BUFSIZ);
+	buf2 = mem_malloc(IO_FILE_BUFSIZ);
+	for (;;) {
+		n1 = io_read_full(fd1, buf1, IO_FILE_BUFSIZ);
+		n2 = io_read_full(fd2, buf2, IO_FILE_BUFSIZ);
+		if (n1 < 0 || n1 != n2 || memcmp(buf1, buf2, n1) != 0)
+			break;
+		if (n1 == 0) {
+			ret = 1;
+			break;
+		}
+	}
+	mem_free(buf1);
+	mem_free(buf2);
+
+	return ret;
+}
+
+/*
+ * Check whether two files are equal. Files of different sizes are told apart
+ * without reading them, others are mapped into memory and compared at once.
+ */
+int io_files_equal(const char *file1, const char *file2)
+{
+	struct stat st1, st2;
+	void *map1, *map2;
+	int fd1, fd2, ret = 0;
+
 	if (!file1 || !file2)
 		return 0;
 
-	fp1 = fopen(file1, "rb");
-	fp2 = fopen(file2, "rb");
-
-	while (!feof(fp1) && !feof(fp2)) {
-		if (fgetc(fp1) != fgetc(fp2))
-			goto cleanup;
+	if ((fd1 = open(file1, O_RDONLY)) < 0)
+		return 0;
+	if ((fd2 = open(file2, O_RDONLY)) < 0) {
+		close(fd1);
+		return 0;
+	}
+	if (fstat(fd1, &st1) != 0 || fstat(fd2, &st2) != 0 ||
+	    st1.st_size != st2.st_size)
+		goto cleanup;
+	if (st1.st_size == 0) {
+		ret = 1;
+		goto cleanup;
 	}
 
-	ret = 1;
+	map1 = mmap(NULL, st1.st_size, PROT_READ, MAP_PRIVATE, fd1, 0);
+	map2 = mmap(NULL, st2.st_size, PROT_READ, MAP_PRIVATE, fd2, 0);
+	if (map1 != MAP_FAILED && map2 != MAP_FAILED)
+		ret = memcmp(map1, map2, st1.st_size) == 0;
+	else
+		ret = io_fds_equal(fd1, fd2);
+	if (map1 != MAP_FAILED)
+		munmap(map1, st1.st_size);
+	if (map2 != MAP_FAILED)
+		munmap(map2, st2.st_size);
+
 cleanup:
-	fclose(fp1);
-	fclose(fp2);
+	close(fd1);
+	close(fd2);
+	return ret;
+}
+
+/*
+ * Copy the contents of an open file. The data is shared with the copy if the
+ * file system supports it, or copied within the kernel where possible.
+ */
+static int io_fd_cp(int fd_src, int fd_dst, off_t size)
+{
+	char *buf;
+	ssize_t n, w, written;
+	int ret = 1;
+#ifdef HAVE_SYS_SENDFILE_H
+	off_t off = 0;
+#endif
+
+#if defined(HAVE_LINUX_FS_H) && defined(FICLONE)
+	if (ioctl(fd_dst, FICLONE, fd_src) == 0)
+		return 1;
+#endif
+#ifdef HAVE_SYS_SENDFILE_H
+	while (off < size && (n = sendfile(fd_dst, fd_src, NULL,
+					   size - off)) > 0)
+		off += n;
+	if (off == size)
+		return 1;
+#endif
+
+	buf = mem_malloc(IO_FILE_BUFSIZ);
+	while ((n = read(fd_src, buf, IO_FILE_BUFSIZ)) != 0) {
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			ret = 0;
+			break;
+		}
+		for (written = 0; written < n; written += w) {
+			if ((w = write(fd_dst, buf + written, n - written)) < 0)
+				break;
+		}
+		if (written < n) {
+			ret = 0;
+			break;
+		}
+	}
+	mem_free(buf);
+
 	return ret;
 }
 
@@ -1585,30 +2742,23 @@ cleanup:
  */
 int io_file_cp(const char *src, const char *dst)
 {
-	FILE *fp_src, *fp_dst;
-	char *buffer[BUFSIZ];
-	unsigned int bytes_read;
+	struct stat st;
+	int fd_src, fd_dst, ret;
 
-	if (!(fp_src = fopen(src, "rb")))
+	if ((fd_src = open(src, O_RDONLY)) < 0)
 		return 0;
-	if (!(fp_dst = fopen(dst, "wb")))
+	if (fstat(fd_src, &st) != 0 ||
+	    (fd_dst = open(dst, O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0) {
+		close(fd_src);
 		return 0;
-
-	while (!feof(fp_src)) {
-		bytes_read = fread(buffer, 1, BUFSIZ, fp_src);
-		if (bytes_read > 0) {
-			if (fwrite(buffer, 1, bytes_read, fp_dst) !=
-			    bytes_read)
-				return 0;
-		} else {
-			return 0;
-		}
 	}
 
-	fclose(fp_dst);
-	fclose(fp_src);
+	ret = io_fd_cp(fd_src, fd_dst, st.st_size);
+	if (close(fd_dst) != 0)
+		ret = 0;
+	close(fd_src);
 
-	return 1;
+	return ret;
 }
 
 void io_unset_modified(void)
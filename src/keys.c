@@ -300,12 +300,23 @@ enum vkey keys_get_action(int pressed)
 	}
 }
 
+/*
+ * Note that calcurse is about to wait for input: the current action is
+ * complete, and a scripted benchmark may supply the next keys.
+ */
+void keys_idle(void)
+{
+	latency_end();
+	bench_feed();
+}
+
 int keys_wgetch(WINDOW *win)
 {
 	int ch, i;
 	char buf[UTF8_MAXLEN];
 
-	ch = wgetch(win);
+	keys_idle();
+	ch = wins_wgetch(win);
 	if (ch == ERR)
 		return ch;
 
@@ -332,6 +343,84 @@ void keys_wait_for_any_key(WINDOW *win)
 	keys_wgetch(win);
 }
 
+/*
+ * Movements which are folded into a single move when the key is held, each
+ * paired with the movement in the opposite direction.
+ */
+static const enum vkey keys_moves[][2] = {
+	{ KEY_GENERIC_PREV_DAY, KEY_GENERIC_NEXT_DAY },
+	{ KEY_GENERIC_PREV_WEEK, KEY_GENERIC_NEXT_WEEK },
+	{ KEY_MOVE_LEFT, KEY_MOVE_RIGHT },
+	{ KEY_MOVE_UP, KEY_MOVE_DOWN }
+};
+
+/* Return the opposite movement, or KEY_UNDEF if it cannot be folded. */
+static enum vkey keys_move_opposite(enum vkey action)
+{
+	unsigned i;
+
+	for (i = 0; i < sizeof(keys_moves) / sizeof(keys_moves[0]); i++) {
+		if (keys_moves[i][0] == action)
+			return keys_moves[i][1];
+		if (keys_moves[i][1] == action)
+			return keys_moves[i][0];
+	}
+
+	return KEY_UNDEF;
+}
+
+/*
+ * Fold the input already pending into the action just read, so that a held
+ * key or a series of resize events results in a single update of the screen.
+ * Consecutive resize events are collapsed, and movements in the same or in
+ * the opposite direction are added up to a net move, whose length is stored
+ * in count. ERR is returned if the moves cancel out.
+ *
+ * Input is only consumed as long as it is available without blocking, and
+ * the first key which cannot be folded is pushed back. Afterwards, the window
+ * is in blocking mode again.
+ */
+static enum vkey keys_coalesce(WINDOW *win, enum vkey action, int *count)
+{
+	enum vkey opposite = KEY_UNDEF, next;
+	int net = *count, ch;
+
+	if (action != KEY_RESIZE &&
+	    (opposite = keys_move_opposite(action)) == KEY_UNDEF)
+		return action;
+
+	wtimeout(win, 0);
+	while ((ch = wgetch(win)) != ERR) {
+		/* Do not split multibyte characters. */
+		if (ch < KEY_MIN && UTF8_LENGTH(ch) != 1)
+			next = KEY_UNDEF;
+		else if (ch == KEY_RESIZE)
+			next = KEY_RESIZE;
+		else
+			next = keys_get_action(ch);
+
+		if (next == action) {
+			net++;
+		} else if (next == opposite && opposite != KEY_UNDEF) {
+			net--;
+		} else {
+			ungetch(ch);
+			break;
+		}
+	}
+	wtimeout(win, -1);
+
+	if (action == KEY_RESIZE)
+		return action;
+	if (net < 0) {
+		action = opposite;
+		net = -net;
+	}
+	*count = net;
+
+	return net ? action : ERR;
+}
+
 enum vkey keys_get(WINDOW *win, int *count, int *reg)
 {
 	int ch = '0';
@@ -364,8 +453,11 @@ enum vkey keys_get(WINDOW *win, int *count, int *reg)
 
 	switch (ch) {
 	case KEY_RESIZE:
-		return KEY_RESIZE;
+		return count ? keys_coalesce(win, KEY_RESIZE, count) :
+			       KEY_RESIZE;
 	default:
+		if (count && ch != ERR)
+			return keys_coalesce(win, keys_get_action(ch), count);
 		return keys_get_action(ch);
 	}
 }
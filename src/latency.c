@@ -0,0 +1,253 @@
+/*
+ * Calcurse - text-based organizer
+ *
+ * Copyright (c) 2004-2022 calcurse Development Team <misc@calcurse.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the
+ *        following disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the
+ *        following disclaimer in the documentation and/or other
+ *        materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Send your feedback or comments to : misc@calcurse.org
+ * Calcurse home page : http://calcurse.org
+ *
+ */
+
+#include <limits.h>
+#include <time.h>
+
+#include "calcurse.h"
+
+/*
+ * Keypress-to-render latency statistics.
+ *
+ * When enabled (see latency_init()), the time from the moment an action is
+ * read in the main loop to the end of the last screen update it causes is
+ * recorded per action. An action is considered complete when calcurse waits
+ * for input again, be it the next key or a prompt.
+ *
+ * Latencies are kept in microseconds in log-linear histograms in the manner of
+ * HdrHistogram: values below 2 * LATENCY_SUB have a bucket of their own, and
+ * every further power of two is split into LATENCY_SUB buckets, so that the
+ * relative error of a reported value stays below 1 / LATENCY_SUB.
+ */
+#define LATENCY_SUB_BITS	4
+#define LATENCY_SUB		(1 << LATENCY_SUB_BITS)
+#define LATENCY_BUCKETS		(2 * LATENCY_SUB + \
+				 (31 - LATENCY_SUB_BITS) * LATENCY_SUB)
+
+/* Slot of the terminal resizes, which are not actions. */
+#define LATENCY_RESIZE		NBVKEYS
+
+struct latency_hist {
+	unsigned count;
+	unsigned long long sum;
+	unsigned min, max;
+	unsigned buckets[LATENCY_BUCKETS];
+};
+
+static struct latency_hist *latency_hists[NBVKEYS + 1];
+static const char *latency_path;
+static pthread_t latency_thread;
+static int latency_pending = -1;
+static int latency_rendered;
+static struct timespec latency_start_ts, latency_render_ts;
+
+static unsigned latency_bucket(unsigned v)
+{
+	int msb;
+
+	if (v < 2 * LATENCY_SUB)
+		return v;
+	for (msb = 0; v >> (msb + 1); msb++) ;
+
+	return 2 * LATENCY_SUB + (msb - LATENCY_SUB_BITS - 1) * LATENCY_SUB +
+	       ((v >> (msb - LATENCY_SUB_BITS)) - LATENCY_SUB);
+}
+
+/* Return the highest value that falls into a bucket. */
+static unsigned latency_bucket_max(unsigned b)
+{
+	unsigned k, shift;
+
+	if (b < 2 * LATENCY_SUB)
+		return b;
+	k = b - 2 * LATENCY_SUB;
+	shift = k / LATENCY_SUB + 1;
+
+	return ((k % LATENCY_SUB + LATENCY_SUB + 1) << shift) - 1;
+}
+
+/* Microseconds elapsed between two points in time, clamped to 32 bits. */
+static unsigned latency_diff(struct timespec *from, struct timespec *to)
+{
+	long long us;
+
+	us = (long long)(to->tv_sec - from->tv_sec) * 1000000 +
+	     (to->tv_nsec - from->tv_nsec) / 1000;
+	if (us < 0)
+		return 0;
+
+	return us > UINT_MAX >> 1 ? UINT_MAX >> 1 : us;
+}
+
+static void latency_record(int slot, unsigned us)
+{
+	struct latency_hist *h = latency_hists[slot];
+
+	if (!h) {
+		h = latency_hists[slot] = mem_calloc(1,
+						     sizeof(struct latency_hist));
+		h->min = UINT_MAX;
+	}
+	h->count++;
+	h->sum += us;
+	if (us < h->min)
+		h->min = us;
+	if (us > h->max)
+		h->max = us;
+	h->buckets[latency_bucket(us)]++;
+}
+
+/* Return the value below which the given fraction of all samples lies. */
+static unsigned latency_percentile(struct latency_hist *h, double p)
+{
+	unsigned long long rank = p * h->count + 0.5, seen = 0;
+	unsigned b;
+
+	if (rank < 1)
+		rank = 1;
+	for (b = 0; b < LATENCY_BUCKETS; b++) {
+		seen += h->buckets[b];
+		if (seen >= rank)
+			break;
+	}
+
+	return latency_bucket_max(b) < h->max ? latency_bucket_max(b) : h->max;
+}
+
+/*
+ * Enable latency recording. The statistics are written to the given file when
+ * calcurse exits.
+ */
+void latency_init(const char *path)
+{
+	latency_path = path;
+	latency_thread = pthread_self();
+}
+
+/* Start timing an action that has just been read. */
+void latency_start(int action)
+{
+	if (!latency_path)
+		return;
+
+	latency_end();
+	if (action == KEY_RESIZE)
+		action = LATENCY_RESIZE;
+	else if (action < 0 || action >= NBVKEYS)
+		return;
+
+	latency_pending = action;
+	latency_rendered = 0;
+	clock_gettime(CLOCK_MONOTONIC, &latency_start_ts);
+}
+
+/* Note the end of a screen update. */
+void latency_render(void)
+{
+	if (latency_pending < 0 ||
+	    !pthread_equal(pthread_self(), latency_thread))
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &latency_render_ts);
+	latency_rendered = 1;
+}
+
+/*
+ * Record the pending action, if any, once calcurse waits for input again. An
+ * action that did not update the screen is complete at this point.
+ */
+void latency_end(void)
+{
+	struct timespec now;
+
+	if (latency_pending < 0 ||
+	    !pthread_equal(pthread_self(), latency_thread))
+		return;
+
+	if (!latency_rendered)
+		clock_gettime(CLOCK_MONOTONIC, &now);
+	latency_record(latency_pending, latency_diff(&latency_start_ts,
+			latency_rendered ? &latency_render_ts : &now));
+	latency_pending = -1;
+}
+
+/* Print a table of the recorded latencies, in milliseconds. */
+void latency_dump(FILE *fp)
+{
+	struct latency_hist *h;
+	int i;
+
+	fprintf(fp, "%-32s %8s %9s %9s %9s %9s %9s %9s\n", "action", "count",
+		"min", "mean", "p50", "p90", "p99", "max");
+	for (i = 0; i <= NBVKEYS; i++) {
+		if (!(h = latency_hists[i]))
+			continue;
+		fprintf(fp, "%-32s %8u %9.3f %9.3f %9.3f %9.3f %9.3f %9.3f\n",
+			i == LATENCY_RESIZE ? "resize" : keys_get_label(i),
+			h->count, h->min / 1000.0,
+			(double)h->sum / h->count / 1000.0,
+			latency_percentile(h, 0.5) / 1000.0,
+			latency_percentile(h, 0.9) / 1000.0,
+			latency_percentile(h, 0.99) / 1000.0,
+			h->max / 1000.0);
+	}
+}
+
+/* Write the statistics to the file given to latency_init() and free them. */
+void latency_exit(void)
+{
+	FILE *fp;
+	int i;
+
+	if (!latency_path)
+		return;
+
+	latency_end();
+	if ((fp = fopen(latency_path, "w"))) {
+		latency_dump(fp);
+		file_close(fp, __FILE_POS__);
+	} else {
+		WARN_MSG(_("Could not write latency statistics to %s"),
+			 latency_path);
+	}
+
+	for (i = 0; i <= NBVKEYS; i++) {
+		if (latency_hists[i])
+			mem_free(latency_hists[i]);
+		latency_hists[i] = NULL;
+	}
+	latency_path = NULL;
+}
@@ -69,6 +69,9 @@ struct mem_stats {
 
 static struct mem_stats mstats;
 
+/* Items are rendered and notes read by several threads at once. */
+static pthread_mutex_t mstats_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 #endif /* CALCURSE_MEMORY_DEBUG */
 
 void *xmalloc(size_t size)
@@ -134,32 +137,38 @@ static unsigned stats_add_blk(size_t size, const char *pos)
 	EXIT_IF(o == NULL,
 		_("could not allocate memory to store block info"));
 
-	mstats.ncall++;
-
 	o->pos = pos;
 	o->size = (unsigned)size;
 	o->next = 0;
 
+	pthread_mutex_lock(&mstats_mutex);
+	mstats.ncall++;
+	mstats.nalloc += size;
 	for (i = &mstats.blk; *i; i = &(*i)->next) ;
 	o->id = mstats.ncall;
 	*i = o;
+	pthread_mutex_unlock(&mstats_mutex);
 
 	return o->id;
 }
 
-static void stats_del_blk(unsigned id)
+static void stats_del_blk(unsigned id, unsigned size)
 {
 	struct mem_blk *o, **i;
 
+	pthread_mutex_lock(&mstats_mutex);
 	i = &mstats.blk;
 	for (o = mstats.blk; o; o = o->next) {
 		if (o->id == id) {
 			*i = o->next;
+			mstats.nfree += size;
+			pthread_mutex_unlock(&mstats_mutex);
 			free(o);
 			return;
 		}
 		i = &o->next;
 	}
+	pthread_mutex_unlock(&mstats_mutex);
 
 	EXIT(_("Block not found"));
 	/* NOTREACHED */
@@ -181,8 +190,6 @@ void *dbg_malloc(size_t size, const char *pos)
 	buf[BLK_ID] = stats_add_blk(size, pos);	/* identify a block by its id */
 	buf[size - 1] = buf[BLK_ID];	/* mark at end of block */
 
-	mstats.nalloc += size;
-
 	return (void *)(buf + EXTRA_SPACE_START);
 }
 
@@ -263,10 +270,9 @@ void dbg_free(void *ptr, const char *pos)
 
 	buf[0] = MAGIC_FREE;
 
-	stats_del_blk(buf[BLK_ID]);
+	stats_del_blk(buf[BLK_ID], size);
 
 	free(buf);
-	mstats.nfree += size;
 }
 
 static void dump_block_info(struct mem_blk *blk)
@@ -281,6 +287,18 @@ static void dump_block_info(struct mem_blk *blk)
 	puts(_("-----------------------------------------\n"));
 }
 
+/* Return the number of allocations made so far. */
+unsigned mem_ncalls(void)
+{
+	unsigned n;
+
+	pthread_mutex_lock(&mstats_mutex);
+	n = mstats.ncall;
+	pthread_mutex_unlock(&mstats_mutex);
+
+	return n;
+}
+
 void mem_stats(void)
 {
 	putchar('\n');
@@ -34,25 +34,414 @@
  *
  */
 
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <ctype.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <dirent.h>
 
 #include "calcurse.h"
 #include "sha1.h"
 
-struct note_gc_hash {
-	char *hash;
-	char buf[MAX_NOTESIZ + 1];
-	 HTABLE_ENTRY(note_gc_hash);
+/*
+ * Reference counts of note files.
+ *
+ * Every item holding a note accounts for one reference (see note_ref() and
+ * note_unref()). When the last reference to a note is dropped, the note is
+ * queued for deletion and note_gc() only needs to look at the queue instead of
+ * scanning the notes directory and all item lists.
+ */
+struct note_ref {
+	char hash[MAX_NOTESIZ + 1];
+	unsigned count;
+	int queued;
+	struct note_ref *gc_next;
+	 HTABLE_ENTRY(note_ref);
 };
 
-static void note_gc_extract_key(struct note_gc_hash *, const char **,
-				int *);
-static int note_gc_cmp(struct note_gc_hash *, struct note_gc_hash *);
+static void note_ref_extract_key(struct note_ref *, const char **, int *);
+static int note_ref_cmp(struct note_ref *, struct note_ref *);
+
+HTABLE_HEAD(htp, NOTE_GC_HSIZE, note_ref);
+HTABLE_PROTOTYPE(htp, note_ref)
+    HTABLE_GENERATE(htp, note_ref, note_ref_extract_key, note_ref_cmp)
+
+static struct htp note_refs = HTABLE_INITIALIZER(&note_refs);
+static struct note_ref *note_garbage;
+static pthread_mutex_t note_ref_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Note previews.
+ *
+ * The first non-empty line of a note can be shown next to the item in the
+ * appointment and todo panels (see conf.note_preview). Previews are cached by
+ * note hash so that redrawing a panel never opens a file: a row whose note is
+ * not cached yet is drawn without preview and the note is queued for a worker
+ * thread, which reads it and asks for the panels to be redrawn. Since only the
+ * visible rows are drawn, only their notes are ever read. The cache holds at
+ * most NOTE_PREVIEW_MAX entries; the least recently used one is dropped first.
+ */
+#define NOTE_PREVIEW_MAX	256
+#define NOTE_PREVIEW_LEN	128
+
+struct note_preview {
+	char hash[MAX_NOTESIZ + 1];
+	char *text;		/* NULL while the note is being read */
+	struct note_preview *lru_prev, *lru_next;
+	struct note_preview *queue_next;
+	 HTABLE_ENTRY(note_preview);
+};
+
+static void note_preview_extract_key(struct note_preview *, const char **,
+				     int *);
+static int note_preview_cmp(struct note_preview *, struct note_preview *);
+
+HTABLE_HEAD(htpv, NOTE_PREVIEW_HSIZE, note_preview);
+HTABLE_PROTOTYPE(htpv, note_preview)
+    HTABLE_GENERATE(htpv, note_preview, note_preview_extract_key,
+		    note_preview_cmp)
+
+static struct htpv note_previews = HTABLE_INITIALIZER(&note_previews);
+static struct note_preview *preview_lru_head, *preview_lru_tail;
+static struct note_preview *preview_queue, *preview_queue_tail;
+static unsigned preview_count, preview_inflight;
+static int preview_updated, preview_thread_started;
+static pthread_t note_t_preview;
+static pthread_mutex_t preview_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t preview_cond = PTHREAD_COND_INITIALIZER;
+
+/*
+ * Note packs.
+ *
+ * Notes are normally stored as loose files, named by the SHA1 digest of their
+ * contents, in the notes directory. Optionally, they can be moved into a pack
+ * (see note_pack()) consisting of two files in the same directory:
+ *
+ * - NOTES_PACK_NAME holds one entry per note: a header line "<digest> <len>"
+ *   followed by the len bytes of the note itself.
+ * - NOTES_INDEX_NAME holds one record "<digest> <offset>\n" of fixed length
+ *   per entry, sorted by digest, where offset is the entry's position in the
+ *   pack.
+ *
+ * Both files are mapped into memory when a note is looked up. A loose note
+ * file always takes precedence over the pack.
+ */
+#define NOTE_DIGEST_LEN		(SHA1_DIGESTLEN * 2)
+#define NOTE_OFFSET_LEN		12
+#define NOTE_INDEX_RECLEN	(NOTE_DIGEST_LEN + NOTE_OFFSET_LEN + 2)
+
+struct note_map {
+	char *addr;
+	size_t len;
+};
+
+static int note_map(const char *path, struct note_map *m)
+{
+	struct stat st;
+	int fd;
+
+	m->addr = NULL;
+	m->len = 0;
+
+	if ((fd = open(path, O_RDONLY)) < 0)
+		return 0;
+	if (fstat(fd, &st) < 0 || st.st_size == 0) {
+		close(fd);
+		return 0;
+	}
+	m->addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (m->addr == MAP_FAILED) {
+		m->addr = NULL;
+		return 0;
+	}
+	m->len = st.st_size;
+
+	return 1;
+}
+
+static void note_unmap(struct note_map *m)
+{
+	if (m->addr)
+		munmap(m->addr, m->len);
+	m->addr = NULL;
+}
+
+static int note_index_cmp(const void *a, const void *b)
+{
+	return strncmp(a, b, NOTE_DIGEST_LEN);
+}
+
+/*
+ * Find a note in a pack and index that are already mapped. Returns a pointer
+ * to the note contents, or NULL if the pack has no valid entry for it.
+ */
+static const char *note_pack_find(const char *note,
+				  const struct note_map *idx,
+				  const struct note_map *pack, size_t *len)
+{
+	const char *rec, *p, *end;
+	long off;
+	size_t n;
+
+	if (!idx->addr || !pack->addr || strlen(note) != NOTE_DIGEST_LEN)
+		return NULL;
+	rec = bsearch(note, idx->addr, idx->len / NOTE_INDEX_RECLEN,
+		      NOTE_INDEX_RECLEN, note_index_cmp);
+	if (!rec)
+		return NULL;
+	off = strtol(rec + NOTE_DIGEST_LEN + 1, NULL, 10);
+
+	/* Check the entry header: the pack may have been replaced meanwhile. */
+	if (off < 0 || (size_t)off + NOTE_DIGEST_LEN + 1 >= pack->len)
+		return NULL;
+	p = pack->addr + off;
+	end = pack->addr + pack->len;
+	if (strncmp(p, note, NOTE_DIGEST_LEN) || p[NOTE_DIGEST_LEN] != ' ')
+		return NULL;
+	for (p += NOTE_DIGEST_LEN + 1, n = 0; p < end && isdigit(*p); p++)
+		n = n * 10 + (*p - '0');
+	if (p >= end || *p != '\n' || n > (size_t)(end - p - 1))
+		return NULL;
+
+	*len = n;
+	return p + 1;
+}
+
+/*
+ * Look up a note in the pack. If found, the pack is left mapped in 'pack' and
+ * a pointer to the note contents is returned; the caller must unmap the pack.
+ */
+static const char *note_pack_lookup(const char *note, struct note_map *pack,
+				    size_t *len)
+{
+	struct note_map idx;
+	const char *p = NULL;
+
+	pack->addr = NULL;
+	if (strlen(note) != NOTE_DIGEST_LEN || !note_map(path_notes_idx, &idx))
+		return NULL;
+	if (note_map(path_notes_pack, pack))
+		p = note_pack_find(note, &idx, pack, len);
+	note_unmap(&idx);
+	if (!p)
+		note_unmap(pack);
+
+	return p;
+}
+
+/* Return true if the note exists, either as a loose file or in the pack. */
+int note_exists(const char *note)
+{
+	struct note_map pack;
+	char *notepath;
+	size_t len;
+	int ret;
+
+	asprintf(&notepath, "%s%s", path_notes, note);
+	ret = io_file_exists(notepath);
+	mem_free(notepath);
+
+	if (!ret && note_pack_lookup(note, &pack, &len)) {
+		note_unmap(&pack);
+		ret = 1;
+	}
+
+	return ret;
+}
+
+/* Open a note for reading. Returns NULL if the note does not exist. */
+FILE *note_fopen(const char *note)
+{
+	struct note_map pack;
+	const char *p;
+	char *notepath;
+	size_t len;
+	FILE *fp;
+
+	if (note == NULL)
+		return NULL;
+	asprintf(&notepath, "%s%s", path_notes, note);
+	fp = fopen(notepath, "r");
+	mem_free(notepath);
+	if (fp || !(p = note_pack_lookup(note, &pack, &len)))
+		return fp;
+
+	if ((fp = tmpfile())) {
+		if (fwrite(p, 1, len, fp) == len) {
+			rewind(fp);
+		} else {
+			fclose(fp);
+			fp = NULL;
+		}
+	}
+	note_unmap(&pack);
+
+	return fp;
+}
 
-HTABLE_HEAD(htp, NOTE_GC_HSIZE, note_gc_hash);
-HTABLE_PROTOTYPE(htp, note_gc_hash)
-    HTABLE_GENERATE(htp, note_gc_hash, note_gc_extract_key, note_gc_cmp)
+/* Copy the contents of a note to a file. Returns 1 on success. */
+static int note_extract(const char *note, const char *path)
+{
+	struct note_map pack;
+	const char *p;
+	char *notepath;
+	size_t len;
+	FILE *fp;
+	int ret;
+
+	asprintf(&notepath, "%s%s", path_notes, note);
+	ret = io_file_cp(notepath, path);
+	mem_free(notepath);
+	if (ret || !(p = note_pack_lookup(note, &pack, &len)))
+		return ret;
+
+	if ((fp = fopen(path, "w"))) {
+		ret = fwrite(p, 1, len, fp) == len;
+		if (fclose(fp) != 0)
+			ret = 0;
+	}
+	note_unmap(&pack);
+
+	return ret;
+}
+
+/* Read a whole file into a newly allocated buffer. */
+static char *note_slurp(const char *path, size_t *len)
+{
+	char *buf = NULL;
+	size_t size = 0, n;
+	FILE *fp;
+
+	if (!(fp = fopen(path, "r")))
+		return NULL;
+
+	*len = 0;
+	do {
+		if (*len == size) {
+			size = size ? size * 2 : BUFSIZ;
+			buf = mem_realloc(buf, size, 1);
+		}
+		n = fread(buf + *len, 1, size - *len, fp);
+		*len += n;
+	} while (n > 0);
+
+	if (ferror(fp)) {
+		mem_free(buf);
+		buf = NULL;
+	}
+	fclose(fp);
+
+	return buf;
+}
+
+static void note_pack_collect(vector_t *notes, char *note)
+{
+	if (note && strlen(note) == NOTE_DIGEST_LEN)
+		VECTOR_ADD(notes, note);
+}
+
+static int note_strcmp(const char **a, const char **b)
+{
+	return strcmp(*a, *b);
+}
+
+/*
+ * Move all notes referenced by the loaded items into a new pack. Loose files
+ * of packed notes are removed, as are pack entries that are no longer
+ * referenced.
+ */
+void note_pack(void)
+{
+	vector_t notes, packed;
+	struct note_map pack, idx;
+	llist_item_t *i;
+	char *pack_new, *idx_new, *notepath, *buf;
+	const char *p, *prev = NULL;
+	unsigned n;
+	size_t len;
+	long off = 0;
+	FILE *fpack, *fidx;
+	int ok = 1;
+
+	VECTOR_INIT(&notes, 128);
+	LLIST_TS_FOREACH(&alist_p, i)
+		note_pack_collect(&notes, ((struct apoint *)LLIST_GET_DATA(i))->note);
+	LLIST_FOREACH(&eventlist, i)
+		note_pack_collect(&notes, ((struct event *)LLIST_GET_DATA(i))->note);
+	LLIST_TS_FOREACH(&recur_alist_p, i)
+		note_pack_collect(&notes,
+			((struct recur_apoint *)LLIST_GET_DATA(i))->note);
+	LLIST_FOREACH(&recur_elist, i)
+		note_pack_collect(&notes,
+			((struct recur_event *)LLIST_GET_DATA(i))->note);
+	LLIST_FOREACH(&todolist, i)
+		note_pack_collect(&notes, ((struct todo *)LLIST_GET_DATA(i))->note);
+	VECTOR_SORT(&notes, note_strcmp);
+
+	asprintf(&pack_new, "%s.new", path_notes_pack);
+	asprintf(&idx_new, "%s.new", path_notes_idx);
+	fpack = fopen(pack_new, "w");
+	fidx = fopen(idx_new, "w");
+	EXIT_IF(fpack == NULL || fidx == NULL,
+		_("Could not create note pack in %s"), path_notes);
+
+	/* Map the old pack once; notes without a loose file are copied from it. */
+	note_map(path_notes_idx, &idx);
+	note_map(path_notes_pack, &pack);
+	VECTOR_INIT(&packed, 128);
+	VECTOR_FOREACH(&notes, n) {
+		const char *note = VECTOR_NTH(&notes, n);
+
+		if (prev && !strcmp(prev, note))
+			continue;
+		prev = note;
+
+		asprintf(&notepath, "%s%s", path_notes, note);
+		buf = note_slurp(notepath, &len);
+		mem_free(notepath);
+		if (buf) {
+			p = buf;
+		} else if (!(p = note_pack_find(note, &idx, &pack, &len))) {
+			continue;
+		}
+		VECTOR_ADD(&packed, (void *)note);
+
+		if (fprintf(fidx, "%s %0*ld\n", note, NOTE_OFFSET_LEN, off) < 0 ||
+		    fprintf(fpack, "%s %lu\n", note, (unsigned long)len) < 0 ||
+		    fwrite(p, 1, len, fpack) != len)
+			ok = 0;
+		off = ftell(fpack);
+
+		if (buf)
+			mem_free(buf);
+	}
+	note_unmap(&idx);
+	note_unmap(&pack);
+
+	if (fclose(fpack) != 0 || fclose(fidx) != 0)
+		ok = 0;
+	if (!ok || rename(pack_new, path_notes_pack) != 0 ||
+	    rename(idx_new, path_notes_idx) != 0) {
+		unlink(pack_new);
+		unlink(idx_new);
+		EXIT(_("Could not write note pack in %s"), path_notes);
+	}
+
+	/* The notes are in the pack now; remove the loose files. */
+	VECTOR_FOREACH(&packed, n) {
+		asprintf(&notepath, "%s%s", path_notes,
+			 (char *)VECTOR_NTH(&packed, n));
+		unlink(notepath);
+		mem_free(notepath);
+	}
+
+	mem_free(pack_new);
+	mem_free(idx_new);
+	VECTOR_FREE(&packed);
+	VECTOR_FREE(&notes);
+}
 
 /* Create note file from a string and return a newly allocated string that
  * contains its name. */
@@ -63,6 +452,8 @@ char *generate_note(const char *str)
 	FILE *fp;
 
 	sha1_digest(str, sha1);
+	if (note_exists(sha1))
+		return sha1;
 	asprintf(&notepath, "%s%s", path_notes, sha1);
 	fp = fopen(notepath, "w");
 	EXIT_IF(fp == NULL, _("Warning: could not open %s, Aborting..."),
@@ -86,10 +477,8 @@ void edit_note(char **note, const char *editor)
 	if ((tmppath = new_tempfile(tmpprefix)) == NULL)
 		goto cleanup;
 
-	if (*note != NULL) {
-		asprintf(&notepath, "%s%s", path_notes, *note);
-		io_file_cp(notepath, tmppath);
-	}
+	if (*note != NULL)
+		note_extract(*note, tmppath);
 
 	const char *arg[] = { editor, tmppath, NULL };
 	wins_launch_external(arg);
@@ -97,17 +486,25 @@ void edit_note(char **note, const char *editor)
 	if ((fp = fopen(tmppath, "r"))) {
 		sha1_stream(fp, sha1);
 		fclose(fp);
+		note_preview_drop(*note);
+		note_preview_drop(sha1);
+		erase_note(note);
 		*note = sha1;
+		note_ref(*note);
+		sha1 = NULL;
 
-		mem_free(notepath);
-		asprintf(&notepath, "%s%s", path_notes, *note);
-		io_file_cp(tmppath, notepath);
-		mem_free(notepath);
+		if (!note_exists(*note)) {
+			asprintf(&notepath, "%s%s", path_notes, *note);
+			io_file_cp(tmppath, notepath);
+			mem_free(notepath);
+		}
 	}
 
 	unlink(tmppath);
 
 cleanup:
+	if (sha1)
+		mem_free(sha1);
 	mem_free(tmpprefix);
 	mem_free(tmppath);
 }
@@ -115,15 +512,30 @@ cleanup:
 /* View a note in an external pager. */
 void view_note(const char *note, const char *pager)
 {
-	char *fullname;
+	char *fullname, *tmpprefix = NULL, *tmppath = NULL;
 
 	if (note == NULL)
 		return;
 	asprintf(&fullname, "%s%s", path_notes, note);
 
-	const char *arg[] = { pager, fullname, NULL };
+	/* A packed note is extracted to a temporary file first. */
+	if (!io_file_exists(fullname)) {
+		asprintf(&tmpprefix, "%s/calcurse-note", get_tempdir());
+		if ((tmppath = new_tempfile(tmpprefix)) == NULL ||
+		    !note_extract(note, tmppath))
+			goto cleanup;
+	}
+
+	const char *arg[] = { pager, tmppath ? tmppath : fullname, NULL };
 	wins_launch_external(arg);
 
+cleanup:
+	if (tmppath) {
+		unlink(tmppath);
+		mem_free(tmppath);
+	}
+	if (tmpprefix)
+		mem_free(tmpprefix);
 	mem_free(fullname);
 }
 
@@ -132,7 +544,8 @@ void erase_note(char **note)
 {
 	if (*note == NULL)
 		return;
-	mem_free(*note);
+	note_unref(*note);
+	io_data_str_free(*note);
 	*note = NULL;
 }
 
@@ -165,92 +578,369 @@ void note_read_contents(char *buffer, size_t buffer_len, FILE * fp)
 
 
 static void
-note_gc_extract_key(struct note_gc_hash *data, const char **key, int *len)
+note_ref_extract_key(struct note_ref *data, const char **key, int *len)
 {
 	*key = data->hash;
 	*len = strlen(data->hash);
 }
 
-static int note_gc_cmp(struct note_gc_hash *a, struct note_gc_hash *b)
+static int note_ref_cmp(struct note_ref *a, struct note_ref *b)
 {
 	return strcmp(a->hash, b->hash);
 }
 
-/* Spot and unlink unused note files. */
+static void note_preview_extract_key(struct note_preview *data,
+				     const char **key, int *len)
+{
+	*key = data->hash;
+	*len = strlen(data->hash);
+}
+
+static int note_preview_cmp(struct note_preview *a, struct note_preview *b)
+{
+	return strcmp(a->hash, b->hash);
+}
+
+/* Look up the reference counter of a note, optionally creating it. */
+static struct note_ref *note_ref_get(const char *note, int create)
+{
+	struct note_ref tmp, *ref;
+
+	strncpy(tmp.hash, note, MAX_NOTESIZ);
+	tmp.hash[MAX_NOTESIZ] = '\0';
+	if ((ref = HTABLE_LOOKUP(htp, &note_refs, &tmp)) || !create)
+		return ref;
+
+	ref = mem_malloc(sizeof(struct note_ref));
+	memcpy(ref->hash, tmp.hash, sizeof(ref->hash));
+	ref->count = 0;
+	ref->queued = 0;
+	ref->gc_next = NULL;
+	HTABLE_INSERT(htp, &note_refs, ref);
+
+	return ref;
+}
+
+/* Queue a note that is no longer referenced for deletion. */
+static void note_ref_queue(struct note_ref *ref)
+{
+	if (ref->queued)
+		return;
+	ref->queued = 1;
+	ref->gc_next = note_garbage;
+	note_garbage = ref;
+}
+
+/* Account for a new item referencing a note. */
+void note_ref(const char *note)
+{
+	if (note == NULL)
+		return;
+
+	pthread_mutex_lock(&note_ref_mutex);
+	note_ref_get(note, 1)->count++;
+	pthread_mutex_unlock(&note_ref_mutex);
+}
+
+/* Drop a reference to a note and queue the note if it becomes unused. */
+void note_unref(const char *note)
+{
+	struct note_ref *ref;
+
+	if (note == NULL)
+		return;
+
+	pthread_mutex_lock(&note_ref_mutex);
+	ref = note_ref_get(note, 0);
+	if (ref && ref->count > 0 && --ref->count == 0)
+		note_ref_queue(ref);
+	pthread_mutex_unlock(&note_ref_mutex);
+}
+
+/*
+ * Unlink note files that lost their last reference since the previous run.
+ * Notes that were referenced again in the meantime are kept.
+ */
 void note_gc(void)
 {
-	struct htp gc_htable = HTABLE_INITIALIZER(&gc_htable);
-	struct note_gc_hash *hp;
+	struct note_ref *ref;
+	char *notepath;
+
+	pthread_mutex_lock(&note_ref_mutex);
+	while ((ref = note_garbage)) {
+		note_garbage = ref->gc_next;
+		ref->queued = 0;
+		if (ref->count > 0)
+			continue;
+
+		asprintf(&notepath, "%s%s", path_notes, ref->hash);
+		unlink(notepath);
+		mem_free(notepath);
+
+		HTABLE_REMOVE(htp, &note_refs, ref);
+		mem_free(ref);
+	}
+	pthread_mutex_unlock(&note_ref_mutex);
+}
+
+/*
+ * Spot and unlink all unused note files, including the ones left behind by
+ * previous sessions or external modifications of the data files.
+ */
+void note_gc_scan(void)
+{
 	DIR *dirp;
 	struct dirent *dp;
-	llist_item_t *i;
-	struct note_gc_hash tmph;
-	char *notepath;
+	struct note_ref *ref;
 
 	if (!(dirp = opendir(path_notes)))
 		return;
 
-	/* Insert all note file names into a hash table. */
-	do {
-		if ((dp = readdir(dirp)) && *(dp->d_name) != '.') {
-			hp = mem_malloc(sizeof(struct note_gc_hash));
-
-			strncpy(hp->buf, dp->d_name, MAX_NOTESIZ + 1);
-			hp->buf[MAX_NOTESIZ] = '\0';
-			hp->hash = hp->buf;
-
-			HTABLE_INSERT(htp, &gc_htable, hp);
-		}
+	pthread_mutex_lock(&note_ref_mutex);
+	while ((dp = readdir(dirp))) {
+		if (*(dp->d_name) == '.')
+			continue;
+		ref = note_ref_get(dp->d_name, 1);
+		if (ref->count == 0)
+			note_ref_queue(ref);
 	}
-	while (dp);
+	pthread_mutex_unlock(&note_ref_mutex);
 
 	closedir(dirp);
 
-	/* Remove hashes that are actually in use. */
-	LLIST_TS_FOREACH(&alist_p, i) {
-		struct apoint *apt = LLIST_GET_DATA(i);
-		if (apt->note) {
-			tmph.hash = apt->note;
-			mem_free(HTABLE_REMOVE(htp, &gc_htable, &tmph));
+	note_gc();
+}
+
+/*
+ * Read the first non-empty line of a note, cut to NOTE_PREVIEW_LEN bytes
+ * without splitting a character. Control characters are replaced by spaces.
+ */
+static char *note_preview_read(const char *note)
+{
+	char buf[NOTE_PREVIEW_LEN + 1];
+	FILE *fp;
+	int i, len = 0;
+
+	buf[0] = '\0';
+	if ((fp = note_fopen(note))) {
+		while (fgets(buf, sizeof(buf), fp)) {
+			len = strcspn(buf, "\n");
+			if (buf[len] == '\n') {
+				buf[len] = '\0';
+			} else if (!feof(fp)) {
+				for (i = len - 1; i > 0 && UTF8_ISCONT(buf[i]);
+				     i--) ;
+				if (UTF8_LENGTH(buf[i]) > len - i)
+					len = i;
+				buf[len] = '\0';
+			}
+			for (i = 0; i < len; i++) {
+				if ((unsigned char)buf[i] < ' ')
+					buf[i] = ' ';
+			}
+			for (i = 0; buf[i] == ' '; i++) ;
+			if (buf[i] != '\0')
+				break;
+			buf[0] = '\0';
 		}
+		fclose(fp);
 	}
 
-	LLIST_FOREACH(&eventlist, i) {
-		struct event *ev = LLIST_GET_DATA(i);
-		if (ev->note) {
-			tmph.hash = ev->note;
-			mem_free(HTABLE_REMOVE(htp, &gc_htable, &tmph));
-		}
+	for (i = 0; buf[i] == ' '; i++) ;
+	return mem_strdup(buf + i);
+}
+
+static void note_preview_lru_unlink(struct note_preview *p)
+{
+	if (p->lru_prev)
+		p->lru_prev->lru_next = p->lru_next;
+	else
+		preview_lru_head = p->lru_next;
+	if (p->lru_next)
+		p->lru_next->lru_prev = p->lru_prev;
+	else
+		preview_lru_tail = p->lru_prev;
+	p->lru_prev = p->lru_next = NULL;
+}
+
+static void note_preview_lru_push(struct note_preview *p)
+{
+	p->lru_prev = NULL;
+	p->lru_next = preview_lru_head;
+	if (preview_lru_head)
+		preview_lru_head->lru_prev = p;
+	else
+		preview_lru_tail = p;
+	preview_lru_head = p;
+}
+
+static void note_preview_remove(struct note_preview *p)
+{
+	note_preview_lru_unlink(p);
+	HTABLE_REMOVE(htpv, &note_previews, p);
+	mem_free(p->text);
+	mem_free(p);
+	preview_count--;
+}
+
+/*
+ * Drop the least recently used previews until the cache is within bounds.
+ * Entries that are still being read are skipped. Needs preview_mutex.
+ */
+static void note_preview_evict(void)
+{
+	struct note_preview *p, *prev;
+
+	for (p = preview_lru_tail; p && preview_count > NOTE_PREVIEW_MAX;
+	     p = prev) {
+		prev = p->lru_prev;
+		if (p->text)
+			note_preview_remove(p);
 	}
+}
 
-	LLIST_TS_FOREACH(&recur_alist_p, i) {
-		struct recur_apoint *rapt = LLIST_GET_DATA(i);
-		if (rapt->note) {
-			tmph.hash = rapt->note;
-			mem_free(HTABLE_REMOVE(htp, &gc_htable, &tmph));
-		}
+/* Thread reading the notes queued by note_preview(). */
+static void *note_preview_thread(void *arg)
+{
+	struct note_preview *p;
+	char hash[MAX_NOTESIZ + 1];
+	char *text;
+
+	pthread_mutex_lock(&preview_mutex);
+	for (;;) {
+		while (!preview_queue)
+			pthread_cond_wait(&preview_cond, &preview_mutex);
+		p = preview_queue;
+		preview_queue = p->queue_next;
+		if (!preview_queue)
+			preview_queue_tail = NULL;
+		p->queue_next = NULL;
+		strncpy(hash, p->hash, MAX_NOTESIZ);
+		hash[MAX_NOTESIZ] = '\0';
+		pthread_mutex_unlock(&preview_mutex);
+
+		text = note_preview_read(hash);
+
+		pthread_mutex_lock(&preview_mutex);
+		p->text = text;
+		preview_inflight--;
+		preview_updated = 1;
+		note_preview_evict();
 	}
 
-	LLIST_FOREACH(&recur_elist, i) {
-		struct recur_event *rev = LLIST_GET_DATA(i);
-		if (rev->note) {
-			tmph.hash = rev->note;
-			mem_free(HTABLE_REMOVE(htp, &gc_htable, &tmph));
+	return NULL;
+}
+
+/*
+ * Copy the preview of a note to buf. Returns 0 if the note is not cached yet,
+ * in which case it is read in the background (see note_preview_updated()).
+ */
+int note_preview(const char *note, char *buf, size_t size)
+{
+	struct note_preview tmp, *p;
+	int ret = 0;
+
+	if (!note || strlen(note) > MAX_NOTESIZ)
+		return 0;
+
+	pthread_mutex_lock(&preview_mutex);
+	strncpy(tmp.hash, note, MAX_NOTESIZ);
+	tmp.hash[MAX_NOTESIZ] = '\0';
+	if ((p = HTABLE_LOOKUP(htpv, &note_previews, &tmp))) {
+		note_preview_lru_unlink(p);
+		note_preview_lru_push(p);
+		if (p->text) {
+			strncpy(buf, p->text, size - 1);
+			buf[size - 1] = '\0';
+			ret = 1;
 		}
+		goto done;
 	}
 
-	LLIST_FOREACH(&todolist, i) {
-		struct todo *todo = LLIST_GET_DATA(i);
-		if (todo->note) {
-			tmph.hash = todo->note;
-			mem_free(HTABLE_REMOVE(htp, &gc_htable, &tmph));
-		}
+	p = mem_malloc(sizeof(struct note_preview));
+	strncpy(p->hash, note, MAX_NOTESIZ);
+	p->hash[MAX_NOTESIZ] = '\0';
+	p->text = NULL;
+	p->queue_next = NULL;
+	HTABLE_INSERT(htpv, &note_previews, p);
+	note_preview_lru_push(p);
+	preview_count++;
+	preview_inflight++;
+
+	if (preview_queue_tail)
+		preview_queue_tail->queue_next = p;
+	else
+		preview_queue = p;
+	preview_queue_tail = p;
+
+	if (!preview_thread_started) {
+		pthread_create(&note_t_preview, NULL, note_preview_thread,
+			       NULL);
+		pthread_detach(note_t_preview);
+		preview_thread_started = 1;
 	}
+	pthread_cond_signal(&preview_cond);
 
-	/* Unlink unused note files. */
-	HTABLE_FOREACH(hp, htp, &gc_htable) {
-		asprintf(&notepath, "%s%s", path_notes, hp->hash);
-		unlink(notepath);
-		mem_free(notepath);
+done:
+	pthread_mutex_unlock(&preview_mutex);
+	return ret;
+}
+
+/* Return true if previews are still waiting to be read. */
+int note_preview_pending(void)
+{
+	int ret;
+
+	pthread_mutex_lock(&preview_mutex);
+	ret = preview_inflight > 0;
+	pthread_mutex_unlock(&preview_mutex);
+
+	return ret;
+}
+
+/*
+ * Return true if previews were read since the last call, i.e. if the panels
+ * need to be redrawn.
+ */
+int note_preview_updated(void)
+{
+	int ret;
+
+	pthread_mutex_lock(&preview_mutex);
+	ret = preview_updated;
+	preview_updated = 0;
+	pthread_mutex_unlock(&preview_mutex);
+
+	return ret;
+}
+
+/* Remove a note from the preview cache, e.g. after it has been edited. */
+void note_preview_drop(const char *note)
+{
+	struct note_preview tmp, *p;
+
+	if (!note || strlen(note) > MAX_NOTESIZ)
+		return;
+
+	pthread_mutex_lock(&preview_mutex);
+	strncpy(tmp.hash, note, MAX_NOTESIZ);
+	tmp.hash[MAX_NOTESIZ] = '\0';
+	p = HTABLE_LOOKUP(htpv, &note_previews, &tmp);
+	if (p && p->text)
+		note_preview_remove(p);
+	pthread_mutex_unlock(&preview_mutex);
+}
+
+/* Empty the preview cache, except for the notes currently being read. */
+void note_preview_free(void)
+{
+	struct note_preview *p, *prev;
+
+	pthread_mutex_lock(&preview_mutex);
+	for (p = preview_lru_tail; p; p = prev) {
+		prev = p->lru_prev;
+		if (p->text)
+			note_preview_remove(p);
 	}
+	pthread_mutex_unlock(&preview_mutex);
 }
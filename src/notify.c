@@ -35,6 +35,10 @@
  */
 
 #include <sys/wait.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <ctype.h>
+#include <fcntl.h>
 #include <time.h>
 #include <stdlib.h>
 #include <string.h>
@@ -44,6 +48,13 @@
 
 #define NOTIFY_FIELD_LENGTH	25
 
+/*
+ * The reminder spool lists the appointments starting within the next
+ * SPOOL_DAYS days, so that the daemon does not need to load the data files.
+ */
+#define SPOOL_DAYS	7
+#define SPOOL_MAGIC	"calcurse-spool 1 "
+
 struct notify_vars {
 	WINDOW *win;
 	char *apts_file;
@@ -65,7 +76,7 @@ int notify_time_left(void)
 	time_t ntimer;
 	int left;
 
-	ntimer = time(NULL);
+	ntimer = now();
 	left = notify_app.time - ntimer;
 
 	return left > 0 ? left : 0;
@@ -187,6 +198,31 @@ void notify_free_app(void)
 	notify_app.txt = 0;
 }
 
+/*
+ * Exchange the next appointment to be notified with the given one. This
+ * allows the daemon to keep track of reminders for several calendars.
+ */
+void notify_swap_app(struct notify_app *a)
+{
+	struct notify_app tmp;
+
+	pthread_mutex_lock(&notify_app.mutex);
+	tmp.time = notify_app.time;
+	tmp.got_app = notify_app.got_app;
+	tmp.txt = notify_app.txt;
+	tmp.state = notify_app.state;
+	notify_app.time = a->time;
+	notify_app.got_app = a->got_app;
+	notify_app.txt = a->txt;
+	notify_app.state = a->state;
+	pthread_mutex_unlock(&notify_app.mutex);
+
+	a->time = tmp.time;
+	a->got_app = tmp.got_app;
+	a->txt = tmp.txt;
+	a->state = tmp.state;
+}
+
 /* Stop the notify-bar main thread. */
 void notify_stop_main_thread(void)
 {
@@ -222,6 +258,7 @@ unsigned notify_launch_cmd(void)
 	notify_app.state |= APOINT_NOTIFIED;
 
 	if ((pid = shell_exec(&pin, &pout, &perr, 1, *arg, arg))) {
+		vclock_count(VCLOCK_COMMAND);
 		close(pin);
 		close(pout);
 		close(perr);
@@ -232,7 +269,8 @@ unsigned notify_launch_cmd(void)
 
 /*
  * Update the notification bar. This is useful when changing color theme
- * for example.
+ * for example. The bar is drawn by the main thread only; other threads post
+ * FLAG_NOT instead (see wins_post()).
  */
 void notify_update_bar(void)
 {
@@ -248,69 +286,77 @@ void notify_update_bar(void)
 	app_pos = file_pos + strlen(notify.apts_file) + 2 + space;
 	txt_max_len = MAX(col - (app_pos + 12 + space), 3);
 
-	WINS_NBAR_LOCK;
 	custom_apply_attr(notify.win, ATTR_HIGHEST);
 	wattron(notify.win, A_UNDERLINE | A_REVERSE);
 	mvwhline(notify.win, 0, 0, ACS_HLINE, col);
 	mvwprintw(notify.win, 0, date_pos, "[ %s | %s ]", notify.date,
 		  notify.time);
 	mvwprintw(notify.win, 0, file_pos, "(%s)", notify.apts_file);
-	WINS_NBAR_UNLOCK;
 
 	pthread_mutex_lock(&notify_app.mutex);
-	if (notify_app.got_app) {
+	if (notify_app.got_app && (time_left = notify_time_left()) > 0) {
 		char buf[txt_max_len * UTF8_MAXLEN];
+		int hours_left, minutes_left;
 
 		strncpy(buf, notify_app.txt, txt_max_len * UTF8_MAXLEN);
 		buf[sizeof(buf) - 1] = '\0';
 		utf8_chop(buf, txt_max_len);
 
-		time_left = notify_time_left();
-		if (time_left > 0) {
-			int hours_left, minutes_left;
+		/* In minutes rounded up. */
+		minutes_left = time_left / MININSEC +
+			       (time_left % MININSEC ?  1 : 0);
 
-			/* In minutes rounded up. */
-			minutes_left = time_left / MININSEC +
-				       (time_left % MININSEC ?  1 : 0);
+		hours_left = minutes_left / HOURINMIN;
+		minutes_left = minutes_left % HOURINMIN;
 
-			hours_left = minutes_left / HOURINMIN;
-			minutes_left = minutes_left % HOURINMIN;
+		pthread_mutex_lock(&nbar.mutex);
+		blinking = time_left <= nbar.cntdwn && notify_trigger();
+		pthread_mutex_unlock(&nbar.mutex);
 
-			pthread_mutex_lock(&nbar.mutex);
-			blinking = time_left <= nbar.cntdwn && notify_trigger();
-
-			WINS_NBAR_LOCK;
-			if (blinking)
-				wattron(notify.win, A_BLINK);
-			mvwprintw(notify.win, 0, app_pos,
-				  "> %02d:%02d :: %s <", hours_left,
-				  minutes_left, buf);
-			if (blinking)
-				wattroff(notify.win, A_BLINK);
-			WINS_NBAR_UNLOCK;
-
-			if (blinking)
-				notify_launch_cmd();
-			pthread_mutex_unlock(&nbar.mutex);
-		} else {
-			notify_app.got_app = 0;
-			pthread_mutex_unlock(&notify_app.mutex);
-			pthread_mutex_unlock(&notify.mutex);
-			notify_check_next_app(0);
-			return;
-		}
+		if (blinking)
+			wattron(notify.win, A_BLINK);
+		mvwprintw(notify.win, 0, app_pos, "> %02d:%02d :: %s <",
+			  hours_left, minutes_left, buf);
+		if (blinking)
+			wattroff(notify.win, A_BLINK);
 	}
 	pthread_mutex_unlock(&notify_app.mutex);
 
-	WINS_NBAR_LOCK;
 	wattroff(notify.win, A_UNDERLINE | A_REVERSE);
 	custom_remove_attr(notify.win, ATTR_HIGHEST);
-	WINS_NBAR_UNLOCK;
 	wins_wrefresh(notify.win);
 
 	pthread_mutex_unlock(&notify.mutex);
 }
 
+/*
+ * Launch the notification command when the next appointment is about to
+ * start, or look for the following appointment once it has started.
+ */
+static void notify_check_reminder(void)
+{
+	int time_left;
+
+	pthread_mutex_lock(&notify_app.mutex);
+	if (!notify_app.got_app) {
+		pthread_mutex_unlock(&notify_app.mutex);
+		return;
+	}
+
+	time_left = notify_time_left();
+	if (time_left > 0) {
+		pthread_mutex_lock(&nbar.mutex);
+		if (time_left <= nbar.cntdwn && notify_trigger())
+			notify_launch_cmd();
+		pthread_mutex_unlock(&nbar.mutex);
+		pthread_mutex_unlock(&notify_app.mutex);
+	} else {
+		notify_app.got_app = 0;
+		pthread_mutex_unlock(&notify_app.mutex);
+		notify_check_next_app(0);
+	}
+}
+
 static void
 notify_main_thread_cleanup(void *arg)
 {
@@ -336,7 +382,7 @@ static void *notify_main_thread(void *arg)
 	pthread_cleanup_push(notify_main_thread_cleanup, NULL);
 
 	for (;;) {
-		ntimer = time(NULL);
+		ntimer = now();
 		localtime_r(&ntimer, &ntime);
 		pthread_mutex_lock(&notify.mutex);
 		pthread_mutex_lock(&nbar.mutex);
@@ -346,7 +392,8 @@ static void *notify_main_thread(void *arg)
 			 &ntime);
 		pthread_mutex_unlock(&nbar.mutex);
 		pthread_mutex_unlock(&notify.mutex);
-		notify_update_bar();
+		notify_check_reminder();
+		wins_post(FLAG_NOT);
 		psleep(thread_sleep);
 		/* Reap the user-defined notifications. */
 		while (waitpid(0, NULL, WNOHANG) > 0)
@@ -374,7 +421,8 @@ unsigned notify_get_next(struct notify_app *a)
 	if (!a)
 		return 0;
 
-	current_time = time(NULL);
+	vclock_count(VCLOCK_SCAN);
+	current_time = now();
 
 	a->time = current_time + DAYINSEC;
 	a->got_app = 0;
@@ -386,6 +434,21 @@ unsigned notify_get_next(struct notify_app *a)
 	return 1;
 }
 
+/* Make the given appointment the next one to be notified by the daemon. */
+static void notify_set_next_bkgd(struct notify_app *a)
+{
+	if (!a->got_app) {
+		/* No next appointment, reset the previous notified one. */
+		notify_app.got_app = 0;
+	} else {
+		if (!notify_same_item(a->time))
+			notify_update_app(a->time, a->state, a->txt);
+	}
+
+	if (a->txt)
+		mem_free(a->txt);
+}
+
 /*
  * This is used for the daemon to check if we have an upcoming appointment or
  * not.
@@ -398,21 +461,186 @@ unsigned notify_get_next_bkgd(void)
 	if (!notify_get_next(&a))
 		return 0;
 
-	if (!a.got_app) {
-		/* No next appointment, reset the previous notified one. */
-		notify_app.got_app = 0;
-		return 1;
-	} else {
-		if (!notify_same_item(a.time))
-			notify_update_app(a.time, a.state, a.txt);
+	notify_set_next_bkgd(&a);
+
+	return 1;
+}
+
+struct spool_item {
+	time_t start;
+	char state;
+	char *mesg;
+};
+
+static void spool_add(vector_t *items, time_t start, char state, char *mesg)
+{
+	struct spool_item *item = mem_malloc(sizeof(struct spool_item));
+
+	item->start = start;
+	item->state = state;
+	item->mesg = mesg;
+	VECTOR_ADD(items, item);
+}
+
+static void spool_free(struct spool_item *item)
+{
+	mem_free(item);
+}
+
+static int spool_item_cmp(struct spool_item **a, struct spool_item **b)
+{
+	if ((*a)->start < (*b)->start)
+		return -1;
+	return (*a)->start > (*b)->start;
+}
+
+/*
+ * Write the reminder spool: a header identifying the apts file it was built
+ * from (by the given status) and the end of the period it covers, followed by
+ * the upcoming appointments in chronological order, one per line.
+ */
+int notify_write_spool(FILE *fp, const struct stat *apts_st)
+{
+	vector_t items;
+	llist_item_t *i;
+	time_t t = now(), day, until, occurrence;
+	unsigned n;
+
+	until = date_sec_change(get_today(), 0, SPOOL_DAYS);
+	VECTOR_INIT(&items, 16);
+
+	LLIST_TS_LOCK(&alist_p);
+	LLIST_TS_FOREACH(&alist_p, i) {
+		struct apoint *apt = LLIST_TS_GET_DATA(i);
+
+		if (apt->start >= until)
+			break;
+		if (apt->start > t)
+			spool_add(&items, apt->start, apt->state, apt->mesg);
+	}
+
+	LLIST_TS_LOCK(&recur_alist_p);
+	for (day = get_today(); day < until; day = NEXTDAY(day)) {
+		LLIST_TS_FOREACH(&recur_alist_p, i) {
+			struct recur_apoint *rapt = LLIST_TS_GET_DATA(i);
+
+			/* Skip occurrences which started on a previous day. */
+			if (recur_apoint_find_occurrence(rapt, day,
+							 &occurrence) &&
+			    occurrence >= day && occurrence > t)
+				spool_add(&items, occurrence, rapt->state,
+					  rapt->mesg);
+		}
+	}
+
+	VECTOR_SORT(&items, spool_item_cmp);
+	fprintf(fp, "%s%lu %lu %lu %lu %lu\n", SPOOL_MAGIC,
+		(unsigned long)apts_st->st_dev, (unsigned long)apts_st->st_ino,
+		(unsigned long)apts_st->st_size,
+		(unsigned long)apts_st->st_mtime, (unsigned long)until);
+	VECTOR_FOREACH(&items, n) {
+		struct spool_item *item = VECTOR_NTH(&items, n);
+
+		fprintf(fp, "%lu %d %s\n", (unsigned long)item->start,
+			item->state, item->mesg);
 	}
 
-	if (a.txt)
-		mem_free(a.txt);
+	LLIST_TS_UNLOCK(&recur_alist_p);
+	LLIST_TS_UNLOCK(&alist_p);
+	VECTOR_FREE_INNER(&items, spool_free);
+	VECTOR_FREE(&items);
+
+	return !ferror(fp);
+}
+
+/* Parse a number in the reminder spool, followed by a space or a newline. */
+static int spool_num(const char **p, const char *end, unsigned long *n)
+{
+	if (*p >= end || !isdigit((unsigned char)**p))
+		return 0;
+	for (*n = 0; *p < end && isdigit((unsigned char)**p); (*p)++)
+		*n = *n * 10 + (**p - '0');
+	if (*p >= end || (**p != ' ' && **p != '\n'))
+		return 0;
+	(*p)++;
 
 	return 1;
 }
 
+/*
+ * Look up the next appointment in the reminder spool written along with the
+ * data files. Return 0 if the spool is missing, was not built from the
+ * current apts file or does not cover the next 24 hours, in which case the
+ * appointments need to be loaded.
+ */
+unsigned notify_get_next_spool(void)
+{
+	struct stat st, apts_st;
+	struct notify_app a;
+	const char *map, *p, *end, *eol;
+	unsigned long dev, ino, size, mtime, until, start, state;
+	time_t t = now();
+	int fd, ret = 0;
+
+	if (stat(path_apts, &apts_st) != 0)
+		return 0;
+	if ((fd = open(path_spool, O_RDONLY)) < 0)
+		return 0;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		close(fd);
+		return 0;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return 0;
+
+	p = map;
+	end = map + st.st_size;
+	if (st.st_size < sizeof(SPOOL_MAGIC) - 1 ||
+	    strncmp(p, SPOOL_MAGIC, sizeof(SPOOL_MAGIC) - 1) != 0)
+		goto cleanup;
+	p += sizeof(SPOOL_MAGIC) - 1;
+	if (!spool_num(&p, end, &dev) || !spool_num(&p, end, &ino) ||
+	    !spool_num(&p, end, &size) || !spool_num(&p, end, &mtime) ||
+	    !spool_num(&p, end, &until))
+		goto cleanup;
+	if (dev != (unsigned long)apts_st.st_dev ||
+	    ino != (unsigned long)apts_st.st_ino ||
+	    size != (unsigned long)apts_st.st_size ||
+	    mtime != (unsigned long)apts_st.st_mtime ||
+	    t + DAYINSEC > (time_t)until)
+		goto cleanup;
+
+	a.got_app = 0;
+	a.txt = NULL;
+	while (p < end) {
+		if (!spool_num(&p, end, &start) ||
+		    !spool_num(&p, end, &state) ||
+		    !(eol = memchr(p, '\n', end - p)))
+			goto cleanup;
+		if ((time_t)start > t) {
+			if ((time_t)start < t + DAYINSEC) {
+				a.got_app = 1;
+				a.time = start;
+				a.state = state;
+				a.txt = mem_malloc(eol - p + 1);
+				memcpy(a.txt, p, eol - p);
+				a.txt[eol - p] = '\0';
+			}
+			break;
+		}
+		p = eol + 1;
+	}
+
+	notify_set_next_bkgd(&a);
+	ret = 1;
+
+cleanup:
+	munmap((void *)map, st.st_size);
+	return ret;
+}
+
 /* Return the description of next appointment to be notified. */
 char *notify_app_txt(void)
 {
@@ -447,7 +675,7 @@ static void *notify_thread_app(void *arg)
 
 	if (tmp_app.txt)
 		mem_free(tmp_app.txt);
-	notify_update_bar();
+	wins_post(FLAG_NOT);
 
 	pthread_exit(NULL);
 }
@@ -470,7 +698,7 @@ void notify_check_added(char *mesg, time_t start, char state)
 	int update_notify = 0;
 	long gap;
 
-	current_time = time(NULL);
+	current_time = now();
 	pthread_mutex_lock(&notify_app.mutex);
 	if (!notify_app.got_app) {
 		gap = start - current_time;
@@ -486,7 +714,7 @@ void notify_check_added(char *mesg, time_t start, char state)
 		notify_update_app(start, state, mesg);
 	}
 	pthread_mutex_unlock(&notify_app.mutex);
-	notify_update_bar();
+	wins_post(FLAG_NOT);
 }
 
 /* Check if the newly repeated appointment is to be notified. */
@@ -495,10 +723,9 @@ void notify_check_repeated(struct recur_apoint *i)
 	time_t current_time, real_app_time;
 	int update_notify = 0;
 
-	current_time = time(NULL);
+	current_time = now();
 	pthread_mutex_lock(&notify_app.mutex);
-	if (recur_item_find_occurrence
-	    (i->start, i->dur, i->rpt, &i->exc, get_today(), &real_app_time)) {
+	if (recur_apoint_find_occurrence(i, get_today(), &real_app_time)) {
 		if (!notify_app.got_app) {
 			if (real_app_time - current_time <= DAYINSEC)
 				update_notify = 1;
@@ -514,7 +741,7 @@ void notify_check_repeated(struct recur_apoint *i)
 		notify_update_app(real_app_time, i->state, i->mesg);
 	}
 	pthread_mutex_unlock(&notify_app.mutex);
-	notify_update_bar();
+	wins_post(FLAG_NOT);
 }
 
 int notify_same_item(time_t time)
@@ -539,11 +766,9 @@ int notify_same_recur_item(struct recur_apoint *i)
 	time_t item_start;
 
 	/* Tomorrow? */
-	recur_item_find_occurrence(i->start, i->dur, i->rpt, &i->exc,
-				   NEXTDAY(get_today()), &item_start);
+	recur_apoint_find_occurrence(i, NEXTDAY(get_today()), &item_start);
 	/* Today? */
-	recur_item_find_occurrence(i->start, i->dur, i->rpt, &i->exc,
-				   get_today(), &item_start);
+	recur_apoint_find_occurrence(i, get_today(), &item_start);
 	pthread_mutex_lock(&notify_app.mutex);
 	if (notify_app.got_app && item_start == notify_app.time)
 		same = 1;
@@ -140,164 +140,151 @@ pcal_dump_apoint(FILE * stream, long apoint_date, long apoint_dur,
 		apoint_mesg);
 }
 
-static void pcal_export_recur_events(FILE * stream)
+/* Export a recurrent event. */
+static void pcal_export_recur_event(FILE * stream, void *item, void *arg)
 {
-	llist_item_t *i;
+	struct recur_event *rev = item;
 	char pcal_date[BUFSIZ];
 
+	if (rev->rpt->until == 0 && rev->rpt->freq == 1) {
+		switch (rev->rpt->type) {
+		case RECUR_DAILY:
+			date_sec2date_fmt(rev->day, "%b %d", pcal_date);
+			fprintf(stream, "all day on_or_after %s  %s\n",
+				pcal_date, rev->mesg);
+			break;
+		case RECUR_WEEKLY:
+			date_sec2date_fmt(rev->day, "%a", pcal_date);
+			fprintf(stream, "all %s on_or_after ", pcal_date);
+			date_sec2date_fmt(rev->day, "%b %d", pcal_date);
+			fprintf(stream, "%s  %s\n", pcal_date, rev->mesg);
+			break;
+		case RECUR_MONTHLY:
+			date_sec2date_fmt(rev->day, "%d", pcal_date);
+			fprintf(stream, "day on all %s  %s\n", pcal_date,
+				rev->mesg);
+			break;
+		case RECUR_YEARLY:
+			date_sec2date_fmt(rev->day, "%b %d", pcal_date);
+			fprintf(stream, "%s  %s\n", pcal_date, rev->mesg);
+			break;
+		default:
+			EXIT(_("incoherent repetition type"));
+		}
+	} else {
+		const long YEAR_START = ui_calendar_start_of_year();
+		const long YEAR_END = ui_calendar_end_of_year();
+
+		if (rev->day < YEAR_END && rev->day > YEAR_START)
+			foreach_date_dump(YEAR_END, rev->rpt, &rev->exc,
+					  rev->day, 0, rev->mesg,
+					  (cb_dump_t) pcal_dump_event, stream);
+	}
+}
+
+static void pcal_export_recur_events(FILE * stream)
+{
 	fputs("\n# =============", stream);
 	fputs("\n# Recur. Events", stream);
 	fputs("\n# =============\n", stream);
 	fputs("# (pcal does not support from..until dates specification\n",
 	      stream);
 
-	LLIST_FOREACH(&recur_elist, i) {
-		struct recur_event *rev = LLIST_GET_DATA(i);
-		if (rev->rpt->until == 0 && rev->rpt->freq == 1) {
-			switch (rev->rpt->type) {
-			case RECUR_DAILY:
-				date_sec2date_fmt(rev->day, "%b %d",
-						  pcal_date);
-				fprintf(stream,
-					"all day on_or_after %s  %s\n",
-					pcal_date, rev->mesg);
-				break;
-			case RECUR_WEEKLY:
-				date_sec2date_fmt(rev->day, "%a",
-						  pcal_date);
-				fprintf(stream, "all %s on_or_after ",
-					pcal_date);
-				date_sec2date_fmt(rev->day, "%b %d",
-						  pcal_date);
-				fprintf(stream, "%s  %s\n", pcal_date,
-					rev->mesg);
-				break;
-			case RECUR_MONTHLY:
-				date_sec2date_fmt(rev->day, "%d",
-						  pcal_date);
-				fprintf(stream, "day on all %s  %s\n",
-					pcal_date, rev->mesg);
-				break;
-			case RECUR_YEARLY:
-				date_sec2date_fmt(rev->day, "%b %d",
-						  pcal_date);
-				fprintf(stream, "%s  %s\n", pcal_date,
-					rev->mesg);
-				break;
-			default:
-				EXIT(_("incoherent repetition type"));
-			}
-		} else {
-			const long YEAR_START =
-			    ui_calendar_start_of_year();
-			const long YEAR_END = ui_calendar_end_of_year();
-
-			if (rev->day < YEAR_END && rev->day > YEAR_START)
-				foreach_date_dump(YEAR_END, rev->rpt,
-						  &rev->exc, rev->day, 0,
-						  rev->mesg,
-						  (cb_dump_t)
-						  pcal_dump_event, stream);
-		}
-	}
+	io_render_list(stream, LLIST_FIRST(&recur_elist),
+		       pcal_export_recur_event, NULL);
 }
 
-static void pcal_export_events(FILE * stream)
+/* Export an event. */
+static void pcal_export_event(FILE * stream, void *item, void *arg)
 {
-	llist_item_t *i;
+	struct event *ev = item;
+
+	pcal_dump_event(stream, ev->day, 0, ev->mesg);
+}
 
+static void pcal_export_events(FILE * stream)
+{
 	fputs("\n# ======\n# Events\n# ======\n", stream);
-	LLIST_FOREACH(&eventlist, i) {
-		struct event *ev = LLIST_TS_GET_DATA(i);
-		pcal_dump_event(stream, ev->day, 0, ev->mesg);
-	}
+	io_render_list(stream, LLIST_FIRST(&eventlist), pcal_export_event,
+		       NULL);
 	fputc('\n', stream);
 }
 
-static void pcal_export_recur_apoints(FILE * stream)
+/* Export a recurrent appointment. */
+static void pcal_export_recur_apoint(FILE * stream, void *item, void *arg)
 {
-	llist_item_t *i;
+	struct recur_apoint *rapt = item;
 	char pcal_date[BUFSIZ], pcal_beg[BUFSIZ], pcal_end[BUFSIZ];
 
+	if (rapt->rpt->until == 0 && rapt->rpt->freq == 1) {
+		date_sec2date_fmt(rapt->start, "%R", pcal_beg);
+		date_sec2date_fmt(rapt->start + rapt->dur, "%R", pcal_end);
+		switch (rapt->rpt->type) {
+		case RECUR_DAILY:
+			date_sec2date_fmt(rapt->start, "%b %d", pcal_date);
+			fprintf(stream,
+				"all day on_or_after %s  (%s -> %s) %s\n",
+				pcal_date, pcal_beg, pcal_end, rapt->mesg);
+			break;
+		case RECUR_WEEKLY:
+			date_sec2date_fmt(rapt->start, "%a", pcal_date);
+			fprintf(stream, "all %s on_or_after ", pcal_date);
+			date_sec2date_fmt(rapt->start, "%b %d", pcal_date);
+			fprintf(stream, "%s  (%s -> %s) %s\n", pcal_date,
+				pcal_beg, pcal_end, rapt->mesg);
+			break;
+		case RECUR_MONTHLY:
+			date_sec2date_fmt(rapt->start, "%d", pcal_date);
+			fprintf(stream, "day on all %s  (%s -> %s) %s\n",
+				pcal_date, pcal_beg, pcal_end, rapt->mesg);
+			break;
+		case RECUR_YEARLY:
+			date_sec2date_fmt(rapt->start, "%b %d", pcal_date);
+			fprintf(stream, "%s  (%s -> %s) %s\n", pcal_date,
+				pcal_beg, pcal_end, rapt->mesg);
+			break;
+		default:
+			EXIT(_("incoherent repetition type"));
+		}
+	} else {
+		const long YEAR_START = ui_calendar_start_of_year();
+		const long YEAR_END = ui_calendar_end_of_year();
+
+		if (rapt->start < YEAR_END && rapt->start > YEAR_START)
+			foreach_date_dump(YEAR_END, rapt->rpt, &rapt->exc,
+					  rapt->start, rapt->dur, rapt->mesg,
+					  (cb_dump_t) pcal_dump_apoint,
+					  stream);
+	}
+}
+
+static void pcal_export_recur_apoints(FILE * stream)
+{
 	fputs("\n# ==============", stream);
 	fputs("\n# Recur. Apoints", stream);
 	fputs("\n# ==============\n", stream);
 	fputs("# (pcal does not support from..until dates specification\n",
 	      stream);
 
-	LLIST_TS_FOREACH(&recur_alist_p, i) {
-		struct recur_apoint *rapt = LLIST_TS_GET_DATA(i);
-
-		if (rapt->rpt->until == 0 && rapt->rpt->freq == 1) {
-			date_sec2date_fmt(rapt->start, "%R", pcal_beg);
-			date_sec2date_fmt(rapt->start + rapt->dur, "%R",
-					  pcal_end);
-			switch (rapt->rpt->type) {
-			case RECUR_DAILY:
-				date_sec2date_fmt(rapt->start, "%b %d",
-						  pcal_date);
-				fprintf(stream,
-					"all day on_or_after %s  (%s -> %s) %s\n",
-					pcal_date, pcal_beg, pcal_end,
-					rapt->mesg);
-				break;
-			case RECUR_WEEKLY:
-				date_sec2date_fmt(rapt->start, "%a",
-						  pcal_date);
-				fprintf(stream, "all %s on_or_after ",
-					pcal_date);
-				date_sec2date_fmt(rapt->start, "%b %d",
-						  pcal_date);
-				fprintf(stream, "%s  (%s -> %s) %s\n",
-					pcal_date, pcal_beg, pcal_end,
-					rapt->mesg);
-				break;
-			case RECUR_MONTHLY:
-				date_sec2date_fmt(rapt->start, "%d",
-						  pcal_date);
-				fprintf(stream,
-					"day on all %s  (%s -> %s) %s\n",
-					pcal_date, pcal_beg, pcal_end,
-					rapt->mesg);
-				break;
-			case RECUR_YEARLY:
-				date_sec2date_fmt(rapt->start, "%b %d",
-						  pcal_date);
-				fprintf(stream, "%s  (%s -> %s) %s\n",
-					pcal_date, pcal_beg, pcal_end,
-					rapt->mesg);
-				break;
-			default:
-				EXIT(_("incoherent repetition type"));
-			}
-		} else {
-			const long YEAR_START =
-			    ui_calendar_start_of_year();
-			const long YEAR_END = ui_calendar_end_of_year();
-
-			if (rapt->start < YEAR_END
-			    && rapt->start > YEAR_START)
-				foreach_date_dump(YEAR_END, rapt->rpt,
-						  &rapt->exc, rapt->start,
-						  rapt->dur, rapt->mesg,
-						  (cb_dump_t)
-						  pcal_dump_apoint,
-						  stream);
-		}
-	}
+	io_render_list(stream, LLIST_TS_FIRST(&recur_alist_p),
+		       pcal_export_recur_apoint, NULL);
 }
 
-static void pcal_export_apoints(FILE * stream)
+/* Export an appointment. */
+static void pcal_export_apoint(FILE * stream, void *item, void *arg)
 {
-	llist_item_t *i;
+	struct apoint *apt = item;
+
+	pcal_dump_apoint(stream, apt->start, apt->dur, apt->mesg);
+}
 
+static void pcal_export_apoints(FILE * stream)
+{
 	fputs("\n# ============\n# Appointments\n# ============\n",
 	      stream);
 	LLIST_TS_LOCK(&alist_p);
-	LLIST_TS_FOREACH(&alist_p, i) {
-		struct apoint *apt = LLIST_TS_GET_DATA(i);
-		pcal_dump_apoint(stream, apt->start, apt->dur, apt->mesg);
-	}
+	io_render_list(stream, LLIST_TS_FIRST(&alist_p), pcal_export_apoint,
+		       NULL);
 	LLIST_TS_UNLOCK(&alist_p);
 	fputc('\n', stream);
 }
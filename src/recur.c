@@ -37,6 +37,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <limits.h>
 #include <sys/types.h>
 #include <time.h>
 
@@ -135,7 +136,7 @@ char *recur_exc2str(llist_t *exc)
 		p = LLIST_GET_DATA(i);
 		localtime_r(&p->st, &tm);
 		string_catftime(&s, DATEFMT(conf.input_datefmt), &tm);
-		string_catf(&s, "%c", ' ');
+		string_append_char(&s, ' ');
 	}
 	return string_buf(&s);
 }
@@ -191,6 +192,7 @@ struct recur_event *recur_event_dup(struct recur_event *in)
 	rev->rpt->type = in->rpt->type;
 	rev->rpt->freq = in->rpt->freq;
 	rev->rpt->until = in->rpt->until;
+	rev->rpt->count = in->rpt->count;
 	LLIST_INIT(&rev->rpt->bymonth);
 	LLIST_INIT(&rev->rpt->bywday);
 	LLIST_INIT(&rev->rpt->bymonthday);
@@ -198,8 +200,10 @@ struct recur_event *recur_event_dup(struct recur_event *in)
 
 	recur_exc_dup(&rev->exc, &in->exc);
 
-	if (in->note)
+	if (in->note) {
 		rev->note = mem_strdup(in->note);
+		note_ref(rev->note);
+	}
 	else
 		rev->note = NULL;
 
@@ -223,6 +227,7 @@ struct recur_apoint *recur_apoint_dup(struct recur_apoint *in)
 	rapt->rpt->type = in->rpt->type;
 	rapt->rpt->freq = in->rpt->freq;
 	rapt->rpt->until = in->rpt->until;
+	rapt->rpt->count = in->rpt->count;
 	LLIST_INIT(&rapt->rpt->bymonth);
 	LLIST_INIT(&rapt->rpt->bywday);
 	LLIST_INIT(&rapt->rpt->bymonthday);
@@ -230,8 +235,10 @@ struct recur_apoint *recur_apoint_dup(struct recur_apoint *in)
 
 	recur_exc_dup(&rapt->exc, &in->exc);
 
-	if (in->note)
+	if (in->note) {
 		rapt->note = mem_strdup(in->note);
+		note_ref(rapt->note);
+	}
 	else
 		rapt->note = NULL;
 
@@ -250,9 +257,9 @@ void recur_event_llist_init(void)
 
 void recur_apoint_free(struct recur_apoint *rapt)
 {
-	mem_free(rapt->mesg);
-	if (rapt->note)
-		mem_free(rapt->note);
+	recur_cache_invalidate(rapt);
+	io_data_str_free(rapt->mesg);
+	erase_note(&rapt->note);
 	if (rapt->rpt)
 		mem_free(rapt->rpt);
 	recur_free_exc_list(&rapt->exc);
@@ -261,9 +268,9 @@ void recur_apoint_free(struct recur_apoint *rapt)
 
 void recur_event_free(struct recur_event *rev)
 {
-	mem_free(rev->mesg);
-	if (rev->note)
-		mem_free(rev->note);
+	recur_cache_invalidate(rev);
+	io_data_str_free(rev->mesg);
+	erase_note(&rev->note);
 	if (rev->rpt)
 		mem_free(rev->rpt);
 	recur_free_exc_list(&rev->exc);
@@ -272,12 +279,14 @@ void recur_event_free(struct recur_event *rev)
 
 void recur_apoint_llist_free(void)
 {
+	recur_cache_flush();
 	LLIST_TS_FREE_INNER(&recur_alist_p, recur_apoint_free);
 	LLIST_TS_FREE(&recur_alist_p);
 }
 
 void recur_event_llist_free(void)
 {
+	recur_cache_flush();
 	LLIST_FREE_INNER(&recur_elist, recur_event_free);
 	LLIST_FREE(&recur_elist);
 }
@@ -314,8 +323,9 @@ struct recur_apoint *recur_apoint_new(char *mesg, char *note, time_t start,
 	struct recur_apoint *rapt =
 	    mem_malloc(sizeof(struct recur_apoint));
 
-	rapt->mesg = mem_strdup(mesg);
-	rapt->note = (note != NULL) ? mem_strdup(note) : 0;
+	rapt->mesg = io_data_str(mesg);
+	rapt->note = (note != NULL) ? io_data_str(note) : 0;
+	note_ref(rapt->note);
 	rapt->start = start;
 	rapt->dur = dur;
 	rapt->state = state;
@@ -348,8 +358,9 @@ struct recur_event *recur_event_new(char *mesg, char *note, time_t day,
 {
 	struct recur_event *rev = mem_malloc(sizeof(struct recur_event));
 
-	rev->mesg = mem_strdup(mesg);
-	rev->note = (note != NULL) ? mem_strdup(note) : 0;
+	rev->mesg = io_data_str(mesg);
+	rev->note = (note != NULL) ? io_data_str(note) : 0;
+	note_ref(rev->note);
 	rev->day = day;
 	rev->id = id;
 	rev->rpt = mem_malloc(sizeof(struct rpt));
@@ -426,65 +437,84 @@ int recur_char2def(char type)
 	return recur_def;
 }
 
-/* Write the bymonthday list. */
-static void bymonthday_append(struct string *s, llist_t *l)
-{
-	llist_item_t *i;
-
-	LLIST_FOREACH(l, i) {
-		int *day = LLIST_GET_DATA(i);
-		string_catf(s, " d%d", *day);
-	}
-}
-
-/* Write the bywday list. */
-static void bywday_append(struct string *s, llist_t *l)
+/* Append an integer list with the given prefix, e.g. " w1 w3". */
+static void recur_int_list_serialize(struct string *s, llist_t *l, char c)
 {
 	llist_item_t *i;
+	char *p;
 
 	LLIST_FOREACH(l, i) {
-		int *wday = LLIST_GET_DATA(i);
-		string_catf(s, " w%d", *wday);
-	}
-}
-
-/* Write the bymonth list. */
-static void bymonth_append(struct string *s, llist_t *l)
-{
-	llist_item_t *i;
-
-	LLIST_FOREACH(l, i) {
-		int *mon = LLIST_GET_DATA(i);
-		string_catf(s, " m%d", *mon);
+		int *val = LLIST_GET_DATA(i);
+		p = string_reserve(s, 2 + FMT_INT_MAX);
+		*p++ = ' ';
+		*p++ = c;
+		p = fmt_int(p, *val);
+		string_commit(s, p);
 	}
 }
 
 /* Write days for which recurrent items should not be repeated. */
-static void recur_exc_append(struct string *s, llist_t *lexc)
+static void recur_exc_serialize(struct string *s, llist_t *lexc)
 {
 	llist_item_t *i;
 	struct tm lt;
 	time_t t;
-	int st_mon, st_day, st_year;
+	char *p;
 
 	LLIST_FOREACH(lexc, i) {
 		struct excp *exc = LLIST_GET_DATA(i);
 		t = exc->st;
 		localtime_r(&t, &lt);
-		st_mon = lt.tm_mon + 1;
-		st_day = lt.tm_mday;
-		st_year = lt.tm_year + 1900;
-		string_catf(s, " !%02u/%02u/%04u", st_mon, st_day, st_year);
+		p = string_reserve(s, 2 + FMT_DATE_MAX);
+		*p++ = ' ';
+		*p++ = '!';
+		p = fmt_date(p, &lt);
+		string_commit(s, p);
+	}
+}
+
+/*
+ * Append the repetition rule of a recurrent item, followed by its exceptions,
+ * e.g. "{1W -> 12/31/2020 w1 !01/08/2020} " or "{1W #10 w1} ".
+ */
+static void recur_rpt_serialize(struct string *s, struct rpt *rpt,
+				llist_t *exc)
+{
+	struct tm lt;
+	time_t t;
+	char *p;
+
+	p = string_reserve(s, 2 + FMT_INT_MAX + 4 + FMT_DATE_MAX);
+	*p++ = '{';
+	p = fmt_int(p, rpt->freq);
+	*p++ = recur_def2char(rpt->type);
+	t = rpt->until;
+	if (rpt->count > 0) {
+		p = fmt_str(p, " #", 2);
+		p = fmt_int(p, rpt->count);
+	} else if (t != 0) {
+		localtime_r(&t, &lt);
+		p = fmt_str(p, " -> ", 4);
+		p = fmt_date(p, &lt);
 	}
+	string_commit(s, p);
+
+	recur_int_list_serialize(s, &rpt->bymonthday, 'd');
+	recur_int_list_serialize(s, &rpt->bywday, 'w');
+	recur_int_list_serialize(s, &rpt->bymonth, 'm');
+	recur_exc_serialize(s, exc);
+
+	p = string_reserve(s, 2);
+	p = fmt_str(p, "} ", 2);
+	string_commit(s, p);
 }
 
 /* Load the recursive appointment description */
-char *recur_apoint_scan(FILE *f, struct tm start, struct tm end,
+char *recur_apoint_scan(char *mesg, struct tm start, struct tm end,
 				       char state, char *note,
 				       struct item_filter *filter,
 				       struct rpt *rpt)
 {
-	char buf[BUFSIZ], *nl;
 	time_t tstart, tend;
 	struct recur_apoint *rapt = NULL;
 	int cond;
@@ -495,14 +525,6 @@ char *recur_apoint_scan(FILE *f, struct tm start, struct tm end,
 	    !check_time(end.tm_hour, end.tm_min))
 		return _("illegal date in appointment");
 
-	/* Read the appointment description */
-	if (!fgets(buf, sizeof buf, f))
-		return _("error in appointment description");
-
-	nl = strchr(buf, '\n');
-	if (nl) {
-		*nl = '\0';
-	}
 	start.tm_sec = end.tm_sec = 0;
 	start.tm_isdst = end.tm_isdst = -1;
 	start.tm_year -= 1900;
@@ -515,6 +537,10 @@ char *recur_apoint_scan(FILE *f, struct tm start, struct tm end,
 	if (tstart == -1 || tend == -1 || tstart > tend)
 		 return _("date error in appointment");
 
+	if (rpt->count > 0 &&
+	    !recur_count_until(tstart, tend - tstart, rpt, &rpt->exc))
+		return _("recurrence error: repeat count is too big");
+
 	/* Does it occur on the start day? */
 	if (!recur_item_find_occurrence(tstart, tend - tstart, rpt, NULL,
 					DAY(tstart), NULL)) {
@@ -526,14 +552,14 @@ char *recur_apoint_scan(FILE *f, struct tm start, struct tm end,
 	if (filter) {
 		cond = (
 		    !(filter->type_mask & TYPE_MASK_RECUR_APPT) ||
-		    (filter->regex && regexec(filter->regex, buf, 0, 0, 0)) ||
+		    (filter->regex && regexec(filter->regex, mesg, 0, 0, 0)) ||
 		    (filter->start_from != -1 && tstart < filter->start_from) ||
 		    (filter->start_to != -1 && tstart > filter->start_to) ||
 		    (filter->end_from != -1 && tend < filter->end_from) ||
 		    (filter->end_to != -1 && tend > filter->end_to)
 		);
 		if (filter->hash) {
-			rapt = recur_apoint_new(buf, note, tstart,
+			rapt = recur_apoint_new(mesg, note, tstart,
 						 tend - tstart, state,
 						 rpt);
 			char *hash = recur_apoint_hash(rapt);
@@ -548,17 +574,16 @@ char *recur_apoint_scan(FILE *f, struct tm start, struct tm end,
 		}
 	}
 	if (!rapt)
-		rapt = recur_apoint_new(buf, note, tstart, tend - tstart, state,
+		rapt = recur_apoint_new(mesg, note, tstart, tend - tstart, state,
 					 rpt);
 	return NULL;
 }
 
 /* Load the recursive events from file */
-char *recur_event_scan(FILE * f, struct tm start, int id,
+char *recur_event_scan(char *mesg, struct tm start, int id,
 				     char *note, struct item_filter *filter,
 				     struct rpt *rpt)
 {
-	char buf[BUFSIZ], *nl;
 	time_t tstart, tend;
 	struct recur_event *rev = NULL;
 	int cond;
@@ -567,14 +592,6 @@ char *recur_event_scan(FILE * f, struct tm start, int id,
 	    !check_time(start.tm_hour, start.tm_min))
 		return _("illegel date in event");
 
-	/* Read the event description */
-	if (!fgets(buf, sizeof buf, f))
-		return _("error in appointment description");
-
-	nl = strchr(buf, '\n');
-	if (nl) {
-		*nl = '\0';
-	}
 	start.tm_hour = 0;
 	start.tm_min = 0;
 	start.tm_sec = 0;
@@ -587,6 +604,9 @@ char *recur_event_scan(FILE * f, struct tm start, int id,
 		return _("date error in event");
 	tend = ENDOFDAY(tstart);
 
+	if (rpt->count > 0 && !recur_count_until(tstart, -1, rpt, &rpt->exc))
+		return _("recurrence error: repeat count is too big");
+
 	/* Does it occur on the start day? */
 	if (!recur_item_find_occurrence(tstart, -1, rpt, NULL,
 					DAY(tstart), NULL)) {
@@ -598,14 +618,14 @@ char *recur_event_scan(FILE * f, struct tm start, int id,
 	if (filter) {
 		cond = (
 		    !(filter->type_mask & TYPE_MASK_RECUR_EVNT) ||
-		    (filter->regex && regexec(filter->regex, buf, 0, 0, 0)) ||
+		    (filter->regex && regexec(filter->regex, mesg, 0, 0, 0)) ||
 		    (filter->start_from != -1 && tstart < filter->start_from) ||
 		    (filter->start_to != -1 && tstart > filter->start_to) ||
 		    (filter->end_from != -1 && tend < filter->end_from) ||
 		    (filter->end_to != -1 && tend > filter->end_to)
 		);
 		if (filter->hash) {
-			rev = recur_event_new(buf, note, tstart, id,
+			rev = recur_event_new(mesg, note, tstart, id,
 					       rpt);
 			char *hash = recur_event_hash(rev);
 			cond = cond || !hash_matches(filter->hash, hash);
@@ -619,51 +639,51 @@ char *recur_event_scan(FILE * f, struct tm start, int id,
 		}
 	}
 	if (!rev)
-		rev = recur_event_new(buf, note, tstart, id, rpt);
+		rev = recur_event_new(mesg, note, tstart, id, rpt);
 	return NULL;
 }
 
-char *recur_apoint_tostr(struct recur_apoint *o)
+/* Append the serialized form of a recurrent appointment to a string. */
+void recur_apoint_serialize(struct recur_apoint *o, struct string *s)
 {
-	struct string s;
+	size_t note_len = o->note ? strlen(o->note) : 0;
+	size_t mesg_len = strlen(o->mesg);
 	struct tm lt;
 	time_t t;
+	char *p;
 
-	string_init(&s);
+	p = string_reserve(s, 2 * FMT_DATETIME_MAX + 5);
 
 	t = o->start;
 	localtime_r(&t, &lt);
-	string_catf(&s, "%02u/%02u/%04u @ %02u:%02u", lt.tm_mon + 1,
-		lt.tm_mday, 1900 + lt.tm_year, lt.tm_hour, lt.tm_min);
+	p = fmt_datetime(p, &lt);
 
 	t = o->start + o->dur;
 	localtime_r(&t, &lt);
-	string_catf(&s, " -> %02u/%02u/%04u @ %02u:%02u", lt.tm_mon + 1,
-		lt.tm_mday, 1900 + lt.tm_year, lt.tm_hour, lt.tm_min);
-
-	t = o->rpt->until;
-	if (t == 0) {
-		/* We have an endless recurrent appointment. */
-		string_catf(&s, " {%d%c", o->rpt->freq,
-			recur_def2char(o->rpt->type));
-	} else {
-		localtime_r(&t, &lt);
-		string_catf(&s, " {%d%c -> %02u/%02u/%04u", o->rpt->freq,
-			recur_def2char(o->rpt->type), lt.tm_mon + 1,
-			lt.tm_mday, 1900 + lt.tm_year);
+	p = fmt_str(p, " -> ", 4);
+	p = fmt_datetime(p, &lt);
+	*p++ = ' ';
+	string_commit(s, p);
+
+	recur_rpt_serialize(s, o->rpt, &o->exc);
+
+	p = string_reserve(s, note_len + 2 + 1 + mesg_len);
+	if (o->note) {
+		*p++ = '>';
+		p = fmt_str(p, o->note, note_len);
+		*p++ = ' ';
 	}
-	bymonthday_append(&s, &o->rpt->bymonthday);
-	bywday_append(&s, &o->rpt->bywday);
-	bymonth_append(&s, &o->rpt->bymonth);
-	recur_exc_append(&s, &o->exc);
-	string_catf(&s, "} ");
-	if (o->note)
-		string_catf(&s, ">%s ", o->note);
-	if (o->state & APOINT_NOTIFY)
-		string_catf(&s, "%c", '!');
-	else
-		string_catf(&s, "%c", '|');
-	string_catf(&s, "%s", o->mesg);
+	*p++ = (o->state & APOINT_NOTIFY) ? '!' : '|';
+	p = fmt_str(p, o->mesg, mesg_len);
+	string_commit(s, p);
+}
+
+char *recur_apoint_tostr(struct recur_apoint *o)
+{
+	struct string s;
+
+	string_init(&s);
+	recur_apoint_serialize(o, &s);
 
 	return string_buf(&s);
 }
@@ -680,50 +700,52 @@ char *recur_apoint_hash(struct recur_apoint *rapt)
 
 void recur_apoint_write(struct recur_apoint *o, FILE * f)
 {
-	char *str = recur_apoint_tostr(o);
-	fprintf(f, "%s\n", str);
-	mem_free(str);
+	struct string s;
+
+	string_init(&s);
+	recur_apoint_serialize(o, &s);
+	fwrite(string_buf(&s), 1, s.len, f);
+	fputc('\n', f);
+	mem_free(string_buf(&s));
 }
 
-char *recur_event_tostr(struct recur_event *o)
+/* Append the serialized form of a recurrent event to a string. */
+void recur_event_serialize(struct recur_event *o, struct string *s)
 {
-	struct string s;
+	size_t note_len = o->note ? strlen(o->note) : 0;
+	size_t mesg_len = strlen(o->mesg);
 	struct tm lt;
 	time_t t;
-	int st_mon, st_day, st_year;
-	int end_mon, end_day, end_year;
+	char *p;
 
-	string_init(&s);
+	p = string_reserve(s, FMT_DATE_MAX + 4 + FMT_INT_MAX);
 
 	t = o->day;
 	localtime_r(&t, &lt);
-	st_mon = lt.tm_mon + 1;
-	st_day = lt.tm_mday;
-	st_year = lt.tm_year + 1900;
-	t = o->rpt->until;
-	if (t == 0) {
-		/* We have an endless recurrent event. */
-		string_catf(&s, "%02u/%02u/%04u [%d] {%d%c", st_mon, st_day,
-			st_year, o->id, o->rpt->freq,
-			recur_def2char(o->rpt->type));
-	} else {
-		localtime_r(&t, &lt);
-		end_mon = lt.tm_mon + 1;
-		end_day = lt.tm_mday;
-		end_year = lt.tm_year + 1900;
-		string_catf(&s, "%02u/%02u/%04u [%d] {%d%c -> %02u/%02u/%04u",
-			st_mon, st_day, st_year, o->id, o->rpt->freq,
-			recur_def2char(o->rpt->type), end_mon, end_day,
-			end_year);
+	p = fmt_date(p, &lt);
+	p = fmt_str(p, " [", 2);
+	p = fmt_int(p, o->id);
+	p = fmt_str(p, "] ", 2);
+	string_commit(s, p);
+
+	recur_rpt_serialize(s, o->rpt, &o->exc);
+
+	p = string_reserve(s, note_len + 2 + mesg_len);
+	if (o->note) {
+		*p++ = '>';
+		p = fmt_str(p, o->note, note_len);
+		*p++ = ' ';
 	}
-	bymonthday_append(&s, &o->rpt->bymonthday);
-	bywday_append(&s, &o->rpt->bywday);
-	bymonth_append(&s, &o->rpt->bymonth);
-	recur_exc_append(&s, &o->exc);
-	string_catf(&s, "} ");
-	if (o->note)
-		string_catf(&s, ">%s ", o->note);
-	string_catf(&s, "%s", o->mesg);
+	p = fmt_str(p, o->mesg, mesg_len);
+	string_commit(s, p);
+}
+
+char *recur_event_tostr(struct recur_event *o)
+{
+	struct string s;
+
+	string_init(&s);
+	recur_event_serialize(o, &s);
 
 	return string_buf(&s);
 }
@@ -740,27 +762,45 @@ char *recur_event_hash(struct recur_event *rev)
 
 void recur_event_write(struct recur_event *o, FILE * f)
 {
-	char *str = recur_event_tostr(o);
-	fprintf(f, "%s\n", str);
-	mem_free(str);
+	struct string s;
+
+	string_init(&s);
+	recur_event_serialize(o, &s);
+	fwrite(string_buf(&s), 1, s.len, f);
+	fputc('\n', f);
+	mem_free(string_buf(&s));
 }
 
-/* Write recursive items to file. */
-void recur_save_data(FILE * f)
+static void recur_event_render(FILE *f, void *item, void *arg)
 {
-	llist_item_t *i;
+	struct recur_event *rev = item;
 
-	LLIST_FOREACH(&recur_elist, i) {
-		struct recur_event *rev = LLIST_GET_DATA(i);
+	if (!archive_cold(rev->day, 0, rev->rpt))
 		recur_event_write(rev, f);
-	}
+}
 
-	LLIST_TS_LOCK(&recur_alist_p);
-	LLIST_TS_FOREACH(&recur_alist_p, i) {
-		struct recur_apoint *rapt = LLIST_GET_DATA(i);
+static void recur_apoint_render(FILE *f, void *item, void *arg)
+{
+	struct recur_apoint *rapt = item;
+
+	if (!archive_cold(rapt->start, rapt->dur, rapt->rpt))
 		recur_apoint_write(rapt, f);
-	}
+}
+
+/* Write recursive items to file. Returns 0 if writing failed. */
+int recur_save_data(FILE * f)
+{
+	int ret;
+
+	ret = io_render_list(f, LLIST_FIRST(&recur_elist), recur_event_render,
+			     NULL);
+
+	LLIST_TS_LOCK(&recur_alist_p);
+	ret = io_render_list(f, LLIST_TS_FIRST(&recur_alist_p),
+			     recur_apoint_render, NULL) && ret;
 	LLIST_TS_UNLOCK(&recur_alist_p);
+
+	return ret;
 }
 
 /*
@@ -1467,6 +1507,233 @@ static int expand_yearly(time_t start, long dur, struct rpt *rpt, llist_t *exc,
 	return 0;
 }
 
+/*
+ * Day-number form of a simple rrule: DAILY or WEEKLY, possibly with BYDAY,
+ * BYMONTH and BYMONTHDAY, whose occurrences all end on the day they start.
+ * For such an rrule, membership of a day is decided by integer arithmetic on
+ * day numbers, without any calls of localtime() or mktime().
+ */
+struct rpt_days {
+	enum recur_type type;
+	int freq;
+	struct tm tm_start;	/* start of the item */
+	long start;		/* day of the first occurrence */
+	long week;		/* first day of the week of the first occurrence */
+	long until;		/* day of the last occurrence */
+	unsigned wdays;		/* weekday bit mask */
+	unsigned months;	/* month bit mask */
+	llist_t *bymonthday;
+};
+
+#define ALL_WDAYS	0x7f
+#define ALL_MONTHS	0x1ffe
+
+/* Convert the rrule (start, dur, rpt) to day-number form, if possible. */
+static int rpt_days_init(struct rpt_days *rd, time_t start, long dur,
+			 struct rpt *rpt)
+{
+	llist_item_t *i;
+	int *w;
+
+	if (rpt->type != RECUR_DAILY && rpt->type != RECUR_WEEKLY)
+		return 0;
+	if (rpt->freq < 1)
+		return 0;
+
+	localtime_r(&start, &rd->tm_start);
+
+	/*
+	 * Occurrences must not stretch into the following day, not even on a
+	 * day shortened by DST.
+	 */
+	if (dur != -1 &&
+	    rd->tm_start.tm_hour * HOURINSEC + rd->tm_start.tm_min * MININSEC +
+	    rd->tm_start.tm_sec + dur > DAYINSEC - HOURINSEC)
+		return 0;
+
+	rd->type = rpt->type;
+	rd->freq = rpt->freq;
+	rd->start = date2daynum(sec2date(start));
+	rd->week = rd->start - WDAY(rd->tm_start.tm_wday);
+	rd->until = rpt->until ? sec2daynum(rpt->until) : LONG_MAX;
+
+	if (rpt->bywday.head) {
+		rd->wdays = 0;
+		LLIST_FOREACH(&rpt->bywday, i) {
+			w = LLIST_GET_DATA(i);
+			if (*w >= 0 && *w <= 6)
+				rd->wdays |= 1 << *w;
+		}
+	} else if (rpt->type == RECUR_WEEKLY) {
+		rd->wdays = 1 << rd->tm_start.tm_wday;
+	} else {
+		rd->wdays = ALL_WDAYS;
+	}
+
+	if (rpt->bymonth.head) {
+		rd->months = 0;
+		LLIST_FOREACH(&rpt->bymonth, i) {
+			w = LLIST_GET_DATA(i);
+			if (*w >= 1 && *w <= 12)
+				rd->months |= 1 << *w;
+		}
+	} else {
+		rd->months = ALL_MONTHS;
+	}
+
+	rd->bymonthday = rpt->type == RECUR_DAILY && rpt->bymonthday.head ?
+			 &rpt->bymonthday : NULL;
+
+	return 1;
+}
+
+/*
+ * Return true if the rrule in day-number form has an occurrence on day n,
+ * disregarding exceptions.
+ */
+static int rpt_days_match(struct rpt_days *rd, long n)
+{
+	struct date d;
+	int mday;
+
+	if (n < rd->start || n > rd->until)
+		return 0;
+	if (!(rd->wdays & (1 << daynum_wday(n))))
+		return 0;
+
+	if (rd->type == RECUR_DAILY) {
+		if ((n - rd->start) % rd->freq)
+			return 0;
+	} else {
+		/* Only every freq'th week counts. */
+		if (((n - rd->week) / WEEKINDAYS) % rd->freq)
+			return 0;
+	}
+
+	if (rd->months != ALL_MONTHS || rd->bymonthday) {
+		d = daynum2date(n);
+		if (!(rd->months & (1 << d.mm)))
+			return 0;
+		mday = d.dd;
+		if (rd->bymonthday &&
+		    !LLIST_FIND_FIRST(rd->bymonthday, &mday, int_cmp)) {
+			mday = opp_mday(d.yyyy, d.mm, d.dd);
+			if (!LLIST_FIND_FIRST(rd->bymonthday, &mday, int_cmp))
+				return 0;
+		}
+	}
+
+	return 1;
+}
+
+/*
+ * The day-number counterpart of find_occurrence(), including expansion of
+ * BYDAY for WEEKLY.
+ */
+static int rpt_days_find(struct rpt_days *rd, long dur, llist_t *exc,
+			 time_t day, time_t *occurrence)
+{
+	struct tm lt_occur;
+	struct date d;
+	long n;
+	time_t t;
+
+	n = sec2daynum(day);
+	if (!rpt_days_match(rd, n))
+		return 0;
+
+	d = daynum2date(n);
+	lt_occur = rd->tm_start;
+	lt_occur.tm_mday = d.dd;
+	lt_occur.tm_mon = d.mm - 1;
+	lt_occur.tm_year = d.yyyy - 1900;
+	lt_occur.tm_isdst = -1;
+	t = mktime(&lt_occur);
+
+	/* Exception day? */
+	if (exc && LLIST_FIND_FIRST(exc, &t, exc_inday))
+		return 0;
+
+	/* Does it span the given day? */
+	if (t + (dur == -1 ? DAYLEN(t) - 1 : dur - 1) < day)
+		return 0;
+
+	if (occurrence)
+		*occurrence = t;
+
+	return 1;
+}
+
+/* Day number of the last day an occurrence limited by COUNT is looked for. */
+static long rpt_days_limit(void)
+{
+	struct date d = { 31, 12, YEAR1902_2037 ? 2037 : 9999 };
+
+	return date2daynum(d);
+}
+
+/*
+ * Return the day of the nth occurrence of an rrule in day-number form, or -1
+ * if there is none. Exceptions are not taken into account.
+ *
+ * Without BYMONTH and BYMONTHDAY, the occurrences form cycles of a fixed
+ * length: seven steps of the frequency for DAILY, a week for WEEKLY. Whole
+ * cycles are skipped by arithmetic and only the last one is stepped through.
+ */
+static long rpt_days_nth(struct rpt_days *rd, int nth)
+{
+	long n, limit = rpt_days_limit(), cycle, full;
+	int per, k;
+
+	if (rd->months != ALL_MONTHS || rd->bymonthday) {
+		for (n = rd->start; n <= limit;
+		     n += rd->type == RECUR_DAILY ? rd->freq : 1) {
+			if (rpt_days_match(rd, n) && --nth == 0)
+				return n;
+		}
+		return -1;
+	}
+
+	if (rd->type == RECUR_DAILY) {
+		/* The weekday pattern repeats after seven steps at most. */
+		cycle = rd->freq % WEEKINDAYS ? WEEKINDAYS : 1;
+		for (k = 0, per = 0; k < cycle; k++) {
+			if (rpt_days_match(rd, rd->start + k * rd->freq))
+				per++;
+		}
+		if (per == 0)
+			return -1;
+		full = (nth - 1) / per;
+		nth -= full * per;
+		n = rd->start + full * cycle * rd->freq;
+		for (; n <= limit; n += rd->freq) {
+			if (rpt_days_match(rd, n) && --nth == 0)
+				return n;
+		}
+		return -1;
+	}
+
+	/* WEEKLY: the first week may hold fewer occurrences than the others. */
+	for (n = rd->start; n < rd->week + WEEKINDAYS; n++) {
+		if (rpt_days_match(rd, n) && --nth == 0)
+			return n;
+	}
+	for (k = 0, per = 0; k < WEEKINDAYS; k++) {
+		if (rd->wdays & (1 << k))
+			per++;
+	}
+	if (per == 0)
+		return -1;
+	full = (nth - 1) / per;
+	nth -= full * per;
+	n = rd->week + (full + 1) * rd->freq * WEEKINDAYS;
+	for (; n <= limit; n++) {
+		if (rpt_days_match(rd, n) && --nth == 0)
+			return n;
+	}
+	return -1;
+}
+
 /*
  * Membership test for the recurrence set of the rrule (start, dur, rpt, exc).
  *
@@ -1485,8 +1752,12 @@ unsigned
 recur_item_find_occurrence(time_t start, long dur, struct rpt *rpt, llist_t *exc,
 			   time_t day, time_t *occurrence)
 {
+	struct rpt_days rd;
 	int res;
 
+	if (rpt_days_init(&rd, start, dur, rpt))
+		return rpt_days_find(&rd, dur, exc, day, occurrence);
+
 	/* To make it possible to set an earlier start without expanding the
 	 * recurrence set. */
 	if (date_cmp_day(day, start) < 0)
@@ -1517,20 +1788,206 @@ recur_item_find_occurrence(time_t start, long dur, struct rpt *rpt, llist_t *exc
 }
 #undef NO_EXPANSION
 
+/*
+ * Occurrence cache.
+ *
+ * The same recurrent item is often looked up several times for the same day,
+ * e.g. while storing the items of the day, drawing the calendar and looking
+ * for the next appointment. The result of recur_*_find_occurrence() is kept
+ * in a bounded cache of OCCURRENCE_CACHE_SIZE entries, keyed by item and day,
+ * from which the least recently used entry is evicted when it is full.
+ * Entries of an item must be invalidated whenever the item is changed.
+ */
+#define OCCURRENCE_CACHE_SIZE	4096
+
+struct occurrence_key {
+	const void *item;
+	time_t day;
+};
+
+struct occurrence_cache {
+	struct occurrence_key key;
+	unsigned found;
+	time_t occurrence;
+	struct occurrence_cache *prev, *lnext;
+	 HTABLE_ENTRY(occurrence_cache);
+};
+
+static void occurrence_extract_key(struct occurrence_cache *, const char **,
+				   int *);
+static int occurrence_cmp(struct occurrence_cache *,
+			  struct occurrence_cache *);
+
+HTABLE_HEAD(ocp, OCCURRENCE_CACHE_SIZE, occurrence_cache);
+HTABLE_PROTOTYPE(ocp, occurrence_cache)
+    HTABLE_GENERATE(ocp, occurrence_cache, occurrence_extract_key,
+		    occurrence_cmp)
+
+static struct ocp occurrence_htable = HTABLE_INITIALIZER(&occurrence_htable);
+static struct occurrence_cache occurrence_pool[OCCURRENCE_CACHE_SIZE];
+static int occurrence_pool_used;
+/* Least recently used entries last, unused entries in a free list. */
+static struct occurrence_cache *occurrence_lru_first, *occurrence_lru_last;
+static struct occurrence_cache *occurrence_free;
+static pthread_mutex_t occurrence_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void
+occurrence_extract_key(struct occurrence_cache *data, const char **key,
+		       int *len)
+{
+	*key = (const char *)&data->key;
+	*len = sizeof(data->key);
+}
+
+static int
+occurrence_cmp(struct occurrence_cache *a, struct occurrence_cache *b)
+{
+	return !(a->key.item == b->key.item && a->key.day == b->key.day);
+}
+
+static void occurrence_unlink(struct occurrence_cache *o)
+{
+	if (o->prev)
+		o->prev->lnext = o->lnext;
+	else
+		occurrence_lru_first = o->lnext;
+	if (o->lnext)
+		o->lnext->prev = o->prev;
+	else
+		occurrence_lru_last = o->prev;
+}
+
+static void occurrence_link_first(struct occurrence_cache *o)
+{
+	o->prev = NULL;
+	o->lnext = occurrence_lru_first;
+	if (occurrence_lru_first)
+		occurrence_lru_first->prev = o;
+	else
+		occurrence_lru_last = o;
+	occurrence_lru_first = o;
+}
+
+static void occurrence_drop(struct occurrence_cache *o)
+{
+	HTABLE_REMOVE(ocp, &occurrence_htable, o);
+	occurrence_unlink(o);
+	o->lnext = occurrence_free;
+	occurrence_free = o;
+}
+
+static int occurrence_cache_get(const void *item, time_t day,
+				unsigned *found, time_t *occurrence)
+{
+	struct occurrence_cache tmp, *o;
+
+	memset(&tmp, 0, sizeof(tmp));
+	tmp.key.item = item;
+	tmp.key.day = day;
+
+	pthread_mutex_lock(&occurrence_mutex);
+	o = HTABLE_LOOKUP(ocp, &occurrence_htable, &tmp);
+	if (o) {
+		*found = o->found;
+		*occurrence = o->occurrence;
+		occurrence_unlink(o);
+		occurrence_link_first(o);
+	}
+	pthread_mutex_unlock(&occurrence_mutex);
+
+	return o != NULL;
+}
+
+static void occurrence_cache_put(const void *item, time_t day,
+				 unsigned found, time_t occurrence)
+{
+	struct occurrence_cache *o;
+
+	pthread_mutex_lock(&occurrence_mutex);
+	if (occurrence_free) {
+		o = occurrence_free;
+		occurrence_free = o->lnext;
+	} else if (occurrence_pool_used < OCCURRENCE_CACHE_SIZE) {
+		o = &occurrence_pool[occurrence_pool_used++];
+	} else {
+		o = occurrence_lru_last;
+		HTABLE_REMOVE(ocp, &occurrence_htable, o);
+		occurrence_unlink(o);
+	}
+
+	memset(&o->key, 0, sizeof(o->key));
+	o->key.item = item;
+	o->key.day = day;
+	o->found = found;
+	o->occurrence = occurrence;
+	/* Another thread may have added the same entry meanwhile. */
+	if (HTABLE_LOOKUP(ocp, &occurrence_htable, o)) {
+		o->lnext = occurrence_free;
+		occurrence_free = o;
+	} else {
+		HTABLE_INSERT(ocp, &occurrence_htable, o);
+		occurrence_link_first(o);
+	}
+	pthread_mutex_unlock(&occurrence_mutex);
+}
+
+/* Remove all cached occurrences of a recurrent item. */
+void recur_cache_invalidate(const void *item)
+{
+	struct occurrence_cache *o, *next;
+
+	pthread_mutex_lock(&occurrence_mutex);
+	for (o = occurrence_lru_first; o; o = next) {
+		next = o->lnext;
+		if (o->key.item == item)
+			occurrence_drop(o);
+	}
+	pthread_mutex_unlock(&occurrence_mutex);
+}
+
+/* Remove all cached occurrences. */
+void recur_cache_flush(void)
+{
+	pthread_mutex_lock(&occurrence_mutex);
+	while (occurrence_lru_first)
+		occurrence_drop(occurrence_lru_first);
+	pthread_mutex_unlock(&occurrence_mutex);
+}
+
+static unsigned
+recur_cached_find_occurrence(const void *item, time_t start, long dur,
+			     struct rpt *rpt, llist_t *exc, time_t day,
+			     time_t *occurrence)
+{
+	unsigned found;
+	time_t occ;
+
+	if (!occurrence_cache_get(item, day, &found, &occ)) {
+		found = recur_item_find_occurrence(start, dur, rpt, exc, day,
+						   &occ);
+		occurrence_cache_put(item, day, found, occ);
+	}
+	if (found && occurrence)
+		*occurrence = occ;
+
+	return found;
+}
+
 unsigned
 recur_apoint_find_occurrence(struct recur_apoint *rapt, time_t day_start,
 			     time_t *occurrence)
 {
-	return recur_item_find_occurrence(rapt->start, rapt->dur, rapt->rpt,
-					  &rapt->exc, day_start, occurrence);
+	return recur_cached_find_occurrence(rapt, rapt->start, rapt->dur,
+					    rapt->rpt, &rapt->exc, day_start,
+					    occurrence);
 }
 
 unsigned
 recur_event_find_occurrence(struct recur_event *rev, time_t day_start,
 			    time_t *occurrence)
 {
-	return recur_item_find_occurrence(rev->day, -1, rev->rpt, &rev->exc,
-					  day_start, occurrence);
+	return recur_cached_find_occurrence(rev, rev->day, -1, rev->rpt,
+					    &rev->exc, day_start, occurrence);
 }
 
 /* Check if a recurrent item belongs to the selected day. */
@@ -1547,30 +2004,98 @@ recur_item_inday(time_t start, long dur,
 
 unsigned recur_apoint_inday(struct recur_apoint *rapt, time_t *day_start)
 {
-	return recur_item_inday(rapt->start, rapt->dur, rapt->rpt, &rapt->exc,
-				*day_start);
+	return recur_apoint_find_occurrence(rapt, *day_start, NULL);
 }
 
 unsigned recur_event_inday(struct recur_event *rev, time_t *day_start)
 {
-	return recur_item_inday(rev->day, -1, rev->rpt, &rev->exc,
-				*day_start);
+	return recur_event_find_occurrence(rev, *day_start, NULL);
+}
+
+/*
+ * Return a bit mask of those of the n (at most 64) consecutive days starting
+ * with day number 'first' on which the rrule (start, dur, rpt, exc) has an
+ * occurrence. Bit k is set if the rrule has an occurrence on day first + k.
+ */
+uint64_t recur_item_daymask(time_t start, long dur, struct rpt *rpt,
+			    llist_t *exc, long first, int n)
+{
+	struct rpt_days rd;
+	llist_item_t *i;
+	uint64_t mask = 0;
+	time_t day;
+	long e;
+	int k;
+
+	EXIT_IF(n < 0 || n > 64, _("too many days in day mask"));
+
+	if (!rpt_days_init(&rd, start, dur, rpt)) {
+		day = date2sec(daynum2date(first), 0, 0);
+		for (k = 0; k < n; k++, day = NEXTDAY(day)) {
+			if (recur_item_find_occurrence(start, dur, rpt, exc,
+						       day, NULL))
+				mask |= (uint64_t)1 << k;
+		}
+		return mask;
+	}
+
+	for (k = 0; k < n; k++) {
+		if (rpt_days_match(&rd, first + k))
+			mask |= (uint64_t)1 << k;
+	}
+
+	if (mask && exc) {
+		LLIST_FOREACH(exc, i) {
+			struct excp *x = LLIST_GET_DATA(i);
+
+			e = sec2daynum(x->st) - first;
+			if (e >= 0 && e < n)
+				mask &= ~((uint64_t)1 << e);
+		}
+	}
+
+	return mask;
+}
+
+uint64_t recur_apoint_daymask(struct recur_apoint *rapt, long first, int n)
+{
+	return recur_item_daymask(rapt->start, rapt->dur, rapt->rpt,
+				  &rapt->exc, first, n);
 }
 
-/* Add an exception to a recurrent event. */
+uint64_t recur_event_daymask(struct recur_event *rev, long first, int n)
+{
+	return recur_item_daymask(rev->day, -1, rev->rpt, &rev->exc, first, n);
+}
+
+/*
+ * Add an exception to a recurrent event. A rrule limited by COUNT gains an
+ * occurrence at its end, as exception days do not count.
+ */
 void recur_event_add_exc(struct recur_event *rev, time_t date)
 {
+	time_t until = rev->rpt->until;
+
 	recur_add_exc(&rev->exc, date);
+	if (rev->rpt->count > 0 &&
+	    !recur_count_until(rev->day, -1, rev->rpt, &rev->exc))
+		rev->rpt->until = until;
+	recur_cache_invalidate(rev);
 }
 
-/* Add an exception to a recurrent appointment. */
+/* Same as recur_event_add_exc(), for a recurrent appointment. */
 void recur_apoint_add_exc(struct recur_apoint *rapt, time_t date)
 {
+	time_t until = rapt->rpt->until;
 	int need_check_notify = 0;
 
 	if (notify_bar())
 		need_check_notify = notify_same_recur_item(rapt);
 	recur_add_exc(&rapt->exc, date);
+	if (rapt->rpt->count > 0 &&
+	    !recur_count_until(rapt->start, rapt->dur, rapt->rpt, &rapt->exc))
+		rapt->rpt->until = until;
+	recur_cache_invalidate(rapt);
 	if (need_check_notify)
 		notify_check_next_app(0);
 }
@@ -1750,7 +2275,11 @@ void recur_apoint_switch_notify(struct recur_apoint *rapt)
 	LLIST_TS_UNLOCK(&recur_alist_p);
 }
 
-void recur_event_paste_item(struct recur_event *rev, time_t date)
+/*
+ * Paste a recurrent event to the given day. Returns 0, without pasting it, if
+ * its last occurrence cannot be derived from the repeat count.
+ */
+int recur_event_paste_item(struct recur_event *rev, time_t date)
 {
 	long time_shift;
 	llist_item_t *i;
@@ -1765,11 +2294,18 @@ void recur_event_paste_item(struct recur_event *rev, time_t date)
 		struct excp *exc = LLIST_GET_DATA(i);
 		exc->st += time_shift;
 	}
+	if (rev->rpt->count > 0 &&
+	    !recur_count_until(rev->day, -1, rev->rpt, &rev->exc))
+		return 0;
+	recur_cache_invalidate(rev);
 
 	LLIST_ADD_SORTED(&recur_elist, rev, recur_event_cmp);
+
+	return 1;
 }
 
-void recur_apoint_paste_item(struct recur_apoint *rapt, time_t date)
+/* Same as recur_event_paste_item(), for a recurrent appointment. */
+int recur_apoint_paste_item(struct recur_apoint *rapt, time_t date)
 {
 	time_t ostart = rapt->start;
 	int days;
@@ -1789,6 +2325,10 @@ void recur_apoint_paste_item(struct recur_apoint *rapt, time_t date)
 		struct excp *exc = LLIST_GET_DATA(i);
 		exc->st = date_sec_change(exc->st, 0, days);
 	}
+	if (rapt->rpt->count > 0 &&
+	    !recur_count_until(rapt->start, rapt->dur, rapt->rpt, &rapt->exc))
+		return 0;
+	recur_cache_invalidate(rapt);
 
 	LLIST_TS_LOCK(&recur_alist_p);
 	LLIST_TS_ADD_SORTED(&recur_alist_p, rapt, recur_apoint_cmp);
@@ -1796,6 +2336,8 @@ void recur_apoint_paste_item(struct recur_apoint *rapt, time_t date)
 
 	if (notify_bar())
 		notify_check_repeated(rapt);
+
+	return 1;
 }
 
 /*
@@ -1845,6 +2387,88 @@ int recur_nth_occurrence(time_t s, long d, struct rpt *r, llist_t *e, int n,
 	return !n;
 }
 
+/*
+ * Find the day of the nth occurrence of a rrule without until, disregarding
+ * exceptions. DAILY and WEEKLY rrules are counted in day-number form, MONTHLY
+ * and YEARLY ones without BY-lists by stepping from period to period; only the
+ * remaining rrules need the walk of recur_nth_occurrence().
+ */
+static int recur_nth_day(time_t start, long dur, struct rpt *rpt, int nth,
+			 struct date *d)
+{
+	struct rpt_days rd;
+	time_t last;
+	long n;
+
+	if (rpt_days_init(&rd, start, dur, rpt)) {
+		if ((n = rpt_days_nth(&rd, nth)) < 0)
+			return 0;
+		*d = daynum2date(n);
+	} else if ((rpt->type == RECUR_MONTHLY || rpt->type == RECUR_YEARLY) &&
+		   !rpt->bymonth.head && !rpt->bywday.head &&
+		   !rpt->bymonthday.head && rpt->freq > 0) {
+		/* Impossible dates, e.g. 31 April, are no occurrences. */
+		*d = sec2date(start);
+		n = d->yyyy * 12 + d->mm - 1;
+		for (;; n += rpt->type == RECUR_MONTHLY ?
+		     rpt->freq : rpt->freq * 12) {
+			d->yyyy = n / 12;
+			d->mm = n % 12 + 1;
+			if (d->yyyy > (YEAR1902_2037 ? 2037 : 9999))
+				return 0;
+			if (check_date(d->yyyy, d->mm, d->dd) && --nth == 0)
+				break;
+		}
+	} else {
+		if (!recur_nth_occurrence(start, dur, rpt, NULL, nth, &last))
+			return 0;
+		*d = sec2date(last);
+	}
+
+	return 1;
+}
+
+/*
+ * Set the until day of a rrule limited by COUNT to the day of its last
+ * occurrence. As with a repeat count entered by the user, exception days do
+ * not count, so the count is raised by the number of exceptions that fall on
+ * occurrences until a fixed point is reached. Returns 0 if there are fewer
+ * occurrences than the count, in which case the rrule is left without until.
+ */
+int recur_count_until(time_t start, long dur, struct rpt *rpt, llist_t *exc)
+{
+	struct date d;
+	llist_item_t *i;
+	time_t last, t;
+	int nth, skipped;
+
+	rpt->until = 0;
+	if (rpt->count <= 0)
+		return 0;
+
+	for (nth = rpt->count;; nth = rpt->count + skipped) {
+		if (!recur_nth_day(start, dur, rpt, nth, &d))
+			return 0;
+		last = date2sec(d, 0, 0);
+		skipped = 0;
+		LLIST_FOREACH(exc, i) {
+			struct excp *e = LLIST_GET_DATA(i);
+			/* The start is always counted. */
+			if (DAY(e->st) <= DAY(start) || DAY(e->st) > last)
+				continue;
+			if (recur_item_find_occurrence(start, dur, rpt, NULL,
+						       DAY(e->st), &t) &&
+			    DAY(t) == DAY(e->st))
+				skipped++;
+		}
+		if (rpt->count + skipped == nth)
+			break;
+	}
+
+	rpt->until = last;
+	return 1;
+}
+
 /*
  * Finds the previous occurrence - the most recent before day - and returns it
  * in the provided buffer.
@@ -39,6 +39,7 @@
 #include "calcurse.h"
 
 #define STRING_INITIAL_BUFSIZE 128
+#define STRING_STRFTIME_EXPANSION 64
 
 void string_init(struct string *sb)
 {
@@ -55,6 +56,20 @@ void string_reset(struct string *sb)
 	string_init(sb);
 }
 
+/*
+ * Empty a string but keep its buffer, so that it can be reused to build
+ * another string without reallocating.
+ */
+void string_clear(struct string *sb)
+{
+	sb->len = 0;
+	*sb->buf = '\0';
+}
+
+/*
+ * Make sure the buffer holds at least minsize bytes. The size is doubled as
+ * needed, so that appending to a string takes amortized constant time.
+ */
 int string_grow(struct string *sb, int minsize)
 {
 	if (sb->bufsize >= minsize)
@@ -72,6 +87,11 @@ char *string_buf(struct string *sb)
 	return sb->buf;
 }
 
+/*
+ * Append formatted output. The string is only formatted a second time if it
+ * does not fit into the remaining space; since the buffer grows geometrically,
+ * that happens a logarithmic number of times when appending repeatedly.
+ */
 int string_vcatf(struct string *sb, const char *format, va_list ap)
 {
 	va_list ap2;
@@ -80,10 +100,12 @@ int string_vcatf(struct string *sb, const char *format, va_list ap)
 	va_copy(ap2, ap);
 
 	n = vsnprintf(sb->buf + sb->len, sb->bufsize - sb->len, format, ap);
-	if (string_grow(sb, sb->len + n + 1)) {
+	if (n >= sb->bufsize - sb->len) {
+		string_grow(sb, sb->len + n + 1);
 		n = vsnprintf(sb->buf + sb->len, sb->bufsize - sb->len, format,
 			      ap2);
 	}
+	va_end(ap2);
 	sb->len += n;
 
 	return n;
@@ -107,29 +129,163 @@ int string_printf(struct string *sb, const char *format, ...)
 	int n;
 
 	va_start(ap, format);
-	string_reset(sb);
+	string_clear(sb);
 	n = string_vcatf(sb, format, ap);
 	va_end(ap);
 
 	return n;
 }
 
+/*
+ * Append a date formatted with strftime(3). The buffer is only grown if the
+ * output does not fit into the remaining space. Since strftime() cannot tell
+ * an empty result from a buffer that is too small, give up once the space
+ * available is far more than any format string could reasonably expand to.
+ */
 int string_catftime(struct string *sb, const char *format, const struct tm *tm)
 {
-	int n = 0;
+	int limit = (strlen(format) + 1) * STRING_STRFTIME_EXPANSION;
+	int n;
 
-	while (!n) {
-		string_grow(sb, sb->bufsize * 2);
+	if (*format == '\0')
+		return 0;
+
+	for (;;) {
 		n = strftime(sb->buf + sb->len, sb->bufsize - sb->len, format,
 			     tm);
+		if (n > 0 || sb->bufsize - sb->len > limit)
+			break;
+		string_grow(sb, sb->bufsize * 2);
 	}
 	sb->len += n;
+	sb->buf[sb->len] = '\0';
 
 	return n;
 }
 
 int string_strftime(struct string *sb, const char *format, const struct tm *tm)
 {
-	string_reset(sb);
+	string_clear(sb);
 	return string_catftime(sb, format, tm);
 }
+
+/* Append n bytes, which must not contain a null byte. */
+void string_append_bytes(struct string *sb, const char *str, int n)
+{
+	string_commit(sb, fmt_str(string_reserve(sb, n), str, n));
+}
+
+/* Append a null-terminated string. */
+void string_append_str(struct string *sb, const char *str)
+{
+	string_append_bytes(sb, str, strlen(str));
+}
+
+/* Append a single character. */
+void string_append_char(struct string *sb, char c)
+{
+	string_grow(sb, sb->len + 2);
+	sb->buf[sb->len++] = c;
+	sb->buf[sb->len] = '\0';
+}
+
+/* Append a signed integer in decimal notation. */
+void string_append_int(struct string *sb, int n)
+{
+	string_commit(sb, fmt_int(string_reserve(sb, FMT_INT_MAX), n));
+}
+
+/*
+ * Append a date, in the format used by the data files, optionally followed by
+ * the time of day ("MM/DD/YYYY" or "MM/DD/YYYY @ HH:MM").
+ */
+void string_append_tm(struct string *sb, const struct tm *tm, int with_time)
+{
+	char *p;
+
+	if (with_time) {
+		p = string_reserve(sb, FMT_DATETIME_MAX);
+		string_commit(sb, fmt_datetime(p, tm));
+	} else {
+		p = string_reserve(sb, FMT_DATE_MAX);
+		string_commit(sb, fmt_date(p, tm));
+	}
+}
+
+/*
+ * Make sure that n more characters (and the terminating null byte) fit into
+ * the buffer and return a pointer to the end of the string, where the fmt_*()
+ * emitters below can write to directly. The string must then be terminated
+ * with string_commit().
+ */
+char *string_reserve(struct string *sb, int n)
+{
+	string_grow(sb, sb->len + n + 1);
+	return sb->buf + sb->len;
+}
+
+/* Finish a string written to directly, 'end' pointing past its last byte. */
+void string_commit(struct string *sb, char *end)
+{
+	sb->len = end - sb->buf;
+	*end = '\0';
+}
+
+/*
+ * Write an unsigned integer, padded with zeros to at least 'width' digits, and
+ * return a pointer past the last character written. No null byte is added.
+ */
+char *fmt_uint(char *p, unsigned n, int width)
+{
+	char tmp[FMT_UINT_MAX];
+	int len = 0;
+
+	do {
+		tmp[len++] = '0' + n % 10;
+		n /= 10;
+	} while (n);
+	while (len < width && len < FMT_UINT_MAX)
+		tmp[len++] = '0';
+
+	while (len > 0)
+		*p++ = tmp[--len];
+
+	return p;
+}
+
+/* Write a signed integer. */
+char *fmt_int(char *p, int n)
+{
+	if (n < 0) {
+		*p++ = '-';
+		return fmt_uint(p, -(unsigned)n, 1);
+	}
+	return fmt_uint(p, n, 1);
+}
+
+/* Write a date in the format used by the data files, "MM/DD/YYYY". */
+char *fmt_date(char *p, const struct tm *tm)
+{
+	p = fmt_uint(p, tm->tm_mon + 1, 2);
+	*p++ = '/';
+	p = fmt_uint(p, tm->tm_mday, 2);
+	*p++ = '/';
+	return fmt_uint(p, tm->tm_year + 1900, 4);
+}
+
+/* Write a date and time in the format "MM/DD/YYYY @ HH:MM". */
+char *fmt_datetime(char *p, const struct tm *tm)
+{
+	p = fmt_date(p, tm);
+	memcpy(p, " @ ", 3);
+	p = fmt_uint(p + 3, tm->tm_hour, 2);
+	*p++ = ':';
+	return fmt_uint(p, tm->tm_min, 2);
+}
+
+/* Write the first n characters of a string. */
+char *fmt_str(char *p, const char *str, size_t n)
+{
+	memcpy(p, str, n);
+	return p + n;
+}
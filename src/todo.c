@@ -94,24 +94,45 @@ struct todo *todo_add(char *mesg, int id, int completed, char *note)
 	todo->completed = completed;
 	todo->note = (note != NULL
 		      && note[0] != '\0') ? mem_strdup(note) : NULL;
+	note_ref(todo->note);
 
 	LLIST_ADD_SORTED(&todolist, todo, todo_cmp);
 
 	return todo;
 }
 
+/* Append the serialized form of a todo item to a string. */
+void todo_serialize(struct todo *todo, struct string *s)
+{
+	size_t note_len = todo->note ? strlen(todo->note) : 0;
+	size_t mesg_len = strlen(todo->mesg);
+	char *p;
+
+	p = string_reserve(s, 3 + FMT_INT_MAX + 1 + note_len + 1 + mesg_len);
+
+	*p++ = '[';
+	if (todo->completed)
+		*p++ = '-';
+	p = fmt_int(p, todo->id);
+	*p++ = ']';
+	if (todo->note) {
+		*p++ = '>';
+		p = fmt_str(p, todo->note, note_len);
+	}
+	*p++ = ' ';
+	p = fmt_str(p, todo->mesg, mesg_len);
+
+	string_commit(s, p);
+}
+
 char *todo_tostr(struct todo *todo)
 {
-	char *res;
-	const char *cstr = todo->completed ? "-" : "";
+	struct string s;
 
-	if (todo->note)
-		asprintf(&res, "[%s%d]>%s %s", cstr, todo->id, todo->note,
-			 todo->mesg);
-	else
-		asprintf(&res, "[%s%d] %s", cstr, todo->id, todo->mesg);
+	string_init(&s);
+	todo_serialize(todo, &s);
 
-	return res;
+	return string_buf(&s);
 }
 
 char *todo_hash(struct todo *todo)
@@ -126,9 +147,13 @@ char *todo_hash(struct todo *todo)
 
 void todo_write(struct todo *todo, FILE * f)
 {
-	char *str = todo_tostr(todo);
-	fprintf(f, "%s\n", str);
-	mem_free(str);
+	struct string s;
+
+	string_init(&s);
+	todo_serialize(todo, &s);
+	fwrite(string_buf(&s), 1, s.len, f);
+	fputc('\n', f);
+	mem_free(string_buf(&s));
 }
 
 /* Delete a note previously attached to a todo item. */
@@ -153,6 +178,13 @@ void todo_delete(struct todo *todo)
 	mem_free(todo);
 }
 
+/* Delete the item at the end of the sorted list. */
+void todo_delete_last(void)
+{
+	if (todolist.tail)
+		todo_delete(LLIST_TS_GET_DATA(todolist.tail));
+}
+
 /*
  * Make sure an item is located at the right position within the sorted list.
  */
@@ -94,11 +94,11 @@ static void *ui_calendar_date_thread(void *arg)
 	for (;;) {
 		tomorrow = date2sec(today, 24, 0);
 
-		while ((actual = time(NULL)) < tomorrow)
-			sleep(tomorrow - actual);
+		while ((actual = now()) < tomorrow)
+			psleep(tomorrow - actual);
 
 		ui_calendar_set_current_date();
-		ui_calendar_update_panel();
+		wins_post(FLAG_CAL);
 	}
 
 	return NULL;
@@ -129,7 +129,7 @@ void ui_calendar_set_current_date(void)
 	time_t timer;
 	struct tm tm;
 
-	timer = time(NULL);
+	timer = now();
 	localtime_r(&timer, &tm);
 
 	pthread_mutex_lock(&date_thread_mutex);
@@ -154,6 +154,8 @@ void ui_calendar_set_first_day_of_week(enum wday first_day)
 		ERROR_MSG(_("ERROR setting first day of week"));
 		wday_start = 0;
 	}
+	/* Weekly occurrences depend on the first day of the week. */
+	recur_cache_flush();
 }
 
 /* Swap first day of week in calendar. */
@@ -162,6 +164,7 @@ void ui_calendar_change_first_day_of_week(void)
 	wday_start++;
 	if(wday_start >= WEEKINDAYS)
 		wday_start = 0;
+	recur_cache_flush();
 }
 
 /* Return 1 if week begins on monday, 0 otherwise. */
@@ -322,12 +325,10 @@ static void draw_week_number(struct scrollwin *sw, struct tm t)
 {
 	int weeknum = ISO8601weeknum(&t);
 
-	WINS_CALENDAR_LOCK;
 	custom_apply_attr(sw->win, ATTR_HIGHEST);
 	mvwprintw(sw->win, conf.compact_panels ? 0 : 2, sw->w - 9,
 		  "(# %02d)", weeknum);
 	custom_remove_attr(sw->win, ATTR_HIGHEST);
-	WINS_CALENDAR_UNLOCK;
 }
 
 /* Draw the monthly view inside calendar panel. */
@@ -385,7 +386,6 @@ draw_monthly_view(struct scrollwin *sw, struct date *current_day)
 		monthly_view_cache_valid = 0;
 	}
 
-	WINS_CALENDAR_LOCK;
 	/* Print the day number. */
 	t = date2tm(slctd_day, 0, 0);
 	mktime(&t);
@@ -411,10 +411,18 @@ draw_monthly_view(struct scrollwin *sw, struct date *current_day)
 			nl_langinfo(ABDAY_1 + modify_wday(j, wday_start)));
 	}
 	custom_remove_attr(sw->inner, ATTR_HIGHEST);
-	WINS_CALENDAR_UNLOCK;
 
 	++ofs_y;
 
+	/* check which days contain an event or an appointment */
+	if (!monthly_view_cache_valid) {
+		c_day.dd = t_first.tm_mday;
+		c_day.mm = t_first.tm_mon + 1;
+		c_day.yyyy = t_first.tm_year + 1900;
+		day_check_if_items(c_day, last_day - first_day,
+				   monthly_view_cache + first_day);
+	}
+
 	/* print the dates */
 	for (j = first_day, t = t_first, w_day = 0;
 	     j < last_day;
@@ -446,12 +454,7 @@ draw_monthly_view(struct scrollwin *sw, struct date *current_day)
 		bc = slctd ? ']' : ' ';
 
 		/* check if the day contains an event or an appointment */
-		if (monthly_view_cache_valid) {
-			day_attr = monthly_view_cache[j];
-		} else {
-			day_attr = monthly_view_cache[j] =
-			    day_check_if_item(c_day);
-		}
+		day_attr = monthly_view_cache[j];
 
 		/* Set day colours. */
 		if (date_cmp(&c_day, current_day) == 0)
@@ -459,7 +462,6 @@ draw_monthly_view(struct scrollwin *sw, struct date *current_day)
 		else
 			attr = day_attr;
 
-		WINS_CALENDAR_LOCK;
 		/* Print week number. */
 		if (!w_day) {
 			custom_apply_attr(sw->inner, ATTR_HIGHEST);
@@ -482,7 +484,6 @@ draw_monthly_view(struct scrollwin *sw, struct date *current_day)
 				 1,  A_BOLD,
 				 (colorize ? (COLR_RED | A_BOLD) : 0), NULL);
 		}
-		WINS_CALENDAR_UNLOCK;
 	}
 	monthly_view_cache_valid = 1;
 }
@@ -494,7 +495,8 @@ draw_weekly_view(struct scrollwin *sw, struct date *current_day)
 #define DAYSLICESNO  6
 	const int WCALWIDTH = 28;
 	struct tm t;
-	int OFFY, OFFX, j;
+	struct date first;
+	int OFFY, OFFX, j, day_attr[WEEKINDAYS];
 
 	werase(sw->inner);
 
@@ -505,12 +507,17 @@ draw_weekly_view(struct scrollwin *sw, struct date *current_day)
 	t = get_first_weekday(MONDAY);
 	draw_week_number(sw, t);
 
+	/* Check which days of the week have an item. */
+	t = get_first_weekday(wday_start);
+	first.dd = t.tm_mday;
+	first.mm = t.tm_mon + 1;
+	first.yyyy = t.tm_year + 1900;
+	day_check_if_items(first, WEEKINDAYS, day_attr);
+
 	/* Now draw calendar view. */
 	for (j = 0; j < WEEKINDAYS; j++) {
 		/* get next day */
-		if (j == 0)
-			t = get_first_weekday(wday_start);
-		else
+		if (j > 0)
 			date_change(&t, 0, 1);
 
 		struct date date;
@@ -524,10 +531,7 @@ draw_weekly_view(struct scrollwin *sw, struct date *current_day)
 		custom_remove_attr(sw->inner, ATTR_HIGHEST);
 
 		/* Check if the day to be printed has an item or not. */
-		date.dd = t.tm_mday;
-		date.mm = t.tm_mon + 1;
-		date.yyyy = t.tm_year + 1900;
-		item_this_day = day_check_if_item(date);
+		item_this_day = day_attr[j];
 
 		/* Print the day numbers with appropriate decoration. */
 		if (t.tm_mday == current_day->dd
@@ -544,26 +548,25 @@ draw_weekly_view(struct scrollwin *sw, struct date *current_day)
 		else
 			attr = 0;
 
-		WINS_CALENDAR_LOCK;
 		if (attr)
 			custom_apply_attr(sw->inner, attr);
 		mvwprintw(sw->inner, OFFY + 1, OFFX + 1 + 4 * j, "%02d",
 			  t.tm_mday);
 		if (attr)
 			custom_remove_attr(sw->inner, attr);
-		WINS_CALENDAR_UNLOCK;
 
 		/* Draw slices indicating appointment times. */
+		date.dd = t.tm_mday;
+		date.mm = t.tm_mon + 1;
+		date.yyyy = t.tm_year + 1900;
 		memset(slices, 0, DAYSLICESNO * sizeof *slices);
 		if (day_chk_busy_slices(date, DAYSLICESNO, slices)) {
 			for (i = 0; i < DAYSLICESNO; i++) {
 				if (j != WEEKINDAYS - 1
 				    && i != DAYSLICESNO - 1) {
-					WINS_CALENDAR_LOCK;
 					mvwhline(sw->inner, OFFY + 2 + i,
 						 OFFX + 3 + 4 * j, ACS_S9,
 						 2);
-					WINS_CALENDAR_UNLOCK;
 				}
 				if (slices[i]) {
 					int highlight;
@@ -571,7 +574,6 @@ draw_weekly_view(struct scrollwin *sw, struct date *current_day)
 					highlight =
 					    (t.tm_mday ==
 					     slctd_day.dd) ? 1 : 0;
-					WINS_CALENDAR_LOCK;
 					if (highlight)
 						custom_apply_attr(sw->inner,
 								  attr);
@@ -584,20 +586,17 @@ draw_weekly_view(struct scrollwin *sw, struct date *current_day)
 					if (highlight)
 						custom_remove_attr(sw->inner,
 								   attr);
-					WINS_CALENDAR_UNLOCK;
 				}
 			}
 		}
 	}
 
 	/* Draw marks to indicate midday on the sides of the calendar. */
-	WINS_CALENDAR_LOCK;
 	custom_apply_attr(sw->inner, ATTR_HIGHEST);
 	mvwhline(sw->inner, OFFY + 1 + DAYSLICESNO / 2, OFFX, ACS_S9, 1);
 	mvwhline(sw->inner, OFFY + 1 + DAYSLICESNO / 2,
 		 OFFX + WCALWIDTH - 1, ACS_S9, 1);
 	custom_remove_attr(sw->inner, ATTR_HIGHEST);
-	WINS_CALENDAR_UNLOCK;
 
 #undef DAYSLICESNO
 }
@@ -754,7 +753,7 @@ time_t ui_calendar_start_of_year(void)
 	time_t timer;
 	struct tm tm;
 
-	timer = time(NULL);
+	timer = now();
 	localtime_r(&timer, &tm);
 	tm.tm_mon = 0;
 	tm.tm_mday = 1;
@@ -771,7 +770,7 @@ time_t ui_calendar_end_of_year(void)
 	time_t timer;
 	struct tm tm;
 
-	timer = time(NULL);
+	timer = now();
 	localtime_r(&timer, &tm);
 	tm.tm_mon = 0;
 	tm.tm_mday = 1;
@@ -162,6 +162,25 @@ static time_t day_edit_time(time_t start, long duration, int move)
 	return ret;
 }
 
+/*
+ * A different start day may move the last occurrence of a rule with a repeat
+ * count. Update it, unless it cannot be found.
+ */
+static int update_count_until(struct rpt *rpt, time_t start, long dur,
+			      llist_t *exc)
+{
+	struct rpt nrpt;
+
+	if (!rpt || rpt->count <= 0)
+		return 1;
+	nrpt = *rpt;
+	if (!recur_count_until(start, dur, &nrpt, exc))
+		return 0;
+	rpt->until = nrpt.until;
+
+	return 1;
+}
+
 /*
  * Change start time or move an item.
  * Input/output: start and dur.
@@ -170,13 +189,16 @@ static time_t day_edit_time(time_t start, long duration, int move)
  * when the new start time is known.
  * If move = 1, duration is fixed, but passed on for validation of new end time.
  */
-static void update_start_time(time_t *start, long *dur, struct rpt *rpt, int move)
+static void update_start_time(time_t *start, long *dur, struct rpt *rpt,
+			      llist_t *exc, int move)
 {
 	time_t newtime;
+	long newdur;
 	const char *msg_wrong_time =
 	    _("Invalid time: start time must come before end time!");
 	char *msg_match =
 		_("Repetition must begin on start day (%s).");
+	const char *msg_count = _("Repeat count is too big.");
 	const char *msg_enter = _("Press [Enter] to continue");
 	char *msg;
 
@@ -184,28 +206,24 @@ static void update_start_time(time_t *start, long *dur, struct rpt *rpt, int mov
 		newtime = day_edit_time(*start, *dur, move);
 		if (!newtime)
 			break;
+		newdur = move ? *dur : *dur - (newtime - *start);
 		if (rpt && !recur_item_find_occurrence(newtime, *dur, rpt, NULL,
 						       DAY(newtime),
 						       NULL)) {
 			msg = day_ins(&msg_match, newtime);
 			status_mesg(msg, msg_enter);
 			mem_free(msg);
-		} else {
-			if (move) {
-				*start = newtime;
-				break;
-			} else {
-				if (newtime <= *start + *dur) {
-					*dur -= (newtime - *start);
-					*start = newtime;
-					break;
-				}
-			}
+		} else if (newdur < 0) {
 			status_mesg(msg_wrong_time, msg_enter);
+		} else if (!update_count_until(rpt, newtime, newdur, exc)) {
+			status_mesg(msg_count, msg_enter);
+		} else {
+			*start = newtime;
+			*dur = newdur;
+			break;
 		}
 		keys_wgetch(win[KEY].p);
 	}
-	return;
 }
 
 /* Request the user to enter a new end time or duration. */
@@ -657,15 +675,15 @@ static int edit_ilist(llist_t *ilist, int_list_t list_type, int rule_type)
 static int update_rept(time_t start, long dur, struct rpt **rpt, llist_t *exc,
 			int simple)
 {
-	int updated = 0, count;
+	int updated = 0;
 	struct rpt nrpt;
-	time_t until;
 	char *types = NULL;
 	char *freqstr = NULL;
 	char *timstr = NULL;
 	char *outstr = NULL;
 	const char *msg_cont = _("Press any key to continue.");
 
+	nrpt.count = 0;
 	LLIST_INIT(&nrpt.exc);
 	LLIST_INIT(&nrpt.bywday);
 	LLIST_INIT(&nrpt.bymonth);
@@ -757,9 +775,11 @@ static int update_rept(time_t start, long dur, struct rpt **rpt, llist_t *exc,
 	const char *msg_count = _("Repeat count is too big.");
 
 	for (;;) {
-		count = 0;
+		nrpt.count = 0;
 		mem_free(timstr);
-		if ((*rpt)->until)
+		if ((*rpt)->count > 0)
+			asprintf(&timstr, "#%d", (*rpt)->count);
+		else if ((*rpt)->until)
 			timstr = date_sec2date_str((*rpt)->until, DATEFMT(conf.input_datefmt));
 		else
 			timstr = mem_strdup("");
@@ -788,17 +808,15 @@ static int update_rept(time_t start, long dur, struct rpt **rpt, llist_t *exc,
 			nrpt.until = date_sec_change(DAY(start), 0, days);
 		} else if (*timstr == '#') {
 			char *eos;
-			count = strtol(timstr + 1, &eos, 10);
-			if (*eos || !(count > 0))
+			long count = strtol(timstr + 1, &eos, 10);
+			if (*eos || !(count > 0) || count > INT_MAX)
 				continue;
-			nrpt.until = 0;
-			if (!recur_nth_occurrence(start, dur, &nrpt, exc,
-						  count, &until)) {
+			nrpt.count = count;
+			if (!recur_count_until(start, dur, &nrpt, exc)) {
 				status_mesg(msg_count, msg_cont);
 				keys_wgetch(win[KEY].p);
 				continue;
 			}
-			nrpt.until = DAY(until);
 			break;
 		} else {
 			int year, month, day;
@@ -827,6 +845,7 @@ static int update_rept(time_t start, long dur, struct rpt **rpt, llist_t *exc,
 		(*rpt)->type = nrpt.type;
 		(*rpt)->freq = nrpt.freq;
 		(*rpt)->until = nrpt.until;
+		(*rpt)->count = nrpt.count;
 		updated = 1;
 		goto cleanup;
 	}
@@ -871,16 +890,12 @@ static int update_rept(time_t start, long dur, struct rpt **rpt, llist_t *exc,
 			goto cleanup;
 	}
 
-	/* The new until may no longer be valid. */
-	if (count) {
-		nrpt.until = 0;
-		if (!recur_nth_occurrence(start, dur, &nrpt, exc,
-					  count, &until)) {
-			status_mesg(msg_count, msg_cont);
-			keys_wgetch(win[KEY].p);
-			goto cleanup;
-		}
-		nrpt.until = DAY(until);
+	/* The until day derived from the count may have changed. */
+	if (nrpt.count > 0 &&
+	    !recur_count_until(start, dur, &nrpt, &nrpt.exc)) {
+		status_mesg(msg_count, msg_cont);
+		keys_wgetch(win[KEY].p);
+		goto cleanup;
 	}
 	/*
 	 * Check whether the start occurrence matches the recurrence rule, in
@@ -904,6 +919,7 @@ static int update_rept(time_t start, long dur, struct rpt **rpt, llist_t *exc,
 	(*rpt)->type = nrpt.type;
 	(*rpt)->freq = nrpt.freq;
 	(*rpt)->until = nrpt.until;
+	(*rpt)->count = nrpt.count;
 
 	recur_free_exc_list(exc);
 	recur_exc_dup(exc, &nrpt.exc);
@@ -982,7 +998,8 @@ void ui_day_item_edit(void)
 			(_("Edit: "), choice_recur_appt, 5)) {
 		case 1:
 			need_check_notify = 1;
-			update_start_time(&ra->start, &ra->dur, ra->rpt, ra->dur == 0);
+			update_start_time(&ra->start, &ra->dur, ra->rpt, &ra->exc,
+					  ra->dur == 0);
 			break;
 		case 2:
 			update_duration(&ra->start, &ra->dur);
@@ -1000,7 +1017,7 @@ void ui_day_item_edit(void)
 			break;
 		case 5:
 			need_check_notify = 1;
-			update_start_time(&ra->start, &ra->dur, ra->rpt, 1);
+			update_start_time(&ra->start, &ra->dur, ra->rpt, &ra->exc, 1);
 			break;
 		default:
 			return;
@@ -1018,7 +1035,7 @@ void ui_day_item_edit(void)
 			(_("Edit: "), choice_appt, 4)) {
 		case 1:
 			need_check_notify = 1;
-			update_start_time(&a->start, &a->dur, NULL, a->dur == 0);
+			update_start_time(&a->start, &a->dur, NULL, NULL, a->dur == 0);
 			break;
 		case 2:
 			update_duration(&a->start, &a->dur);
@@ -1031,7 +1048,7 @@ void ui_day_item_edit(void)
 			break;
 		case 4:
 			need_check_notify = 1;
-			update_start_time(&a->start, &a->dur, NULL, 1);
+			update_start_time(&a->start, &a->dur, NULL, NULL, 1);
 			break;
 		default:
 			return;
@@ -1040,6 +1057,10 @@ void ui_day_item_edit(void)
 	default:
 		break;
 	}
+	if (p->type == RECUR_EVNT)
+		recur_cache_invalidate(p->item.rev);
+	else if (p->type == RECUR_APPT)
+		recur_cache_invalidate(p->item.rapt);
 	io_set_modified();
 	ui_calendar_monthly_view_cache_set_invalid();
 
@@ -1160,7 +1181,7 @@ void ui_day_item_add(void)
 				asprintf(&outstr, mesg_help_1, DATEFMT_DESC(conf.input_datefmt));
 				status_mesg(outstr, mesg_help_2);
 				mem_free(outstr);
-				wgetch(win[KEY].p);
+				keys_wgetch(win[KEY].p);
 				continue;
 			}
 			if (strlen(item_time) == 0) {
@@ -1354,6 +1375,7 @@ void ui_day_item_repeat(void)
 	rpt.type = -1;
 	rpt.freq = 1;
 	rpt.until = 0;
+	rpt.count = 0;
 	LLIST_INIT(&rpt.bymonth);
 	LLIST_INIT(&rpt.bywday);
 	LLIST_INIT(&rpt.bymonthday);
@@ -1394,33 +1416,38 @@ void ui_day_item_cut(unsigned reg)
 }
 
 /* Free the current cut item, if any. */
-void ui_day_item_cut_free(unsigned reg)
+static void ui_day_item_free(struct day_item *p)
 {
-	EXIT_IF(reg > REG_BLACK_HOLE, "illegal register");
-
-	if (!day_cut[reg].type) {
-		/* No previously cut item, don't free anything. */
-		return;
-	}
-
-	switch (day_cut[reg].type) {
+	switch (p->type) {
 	case APPT:
-		apoint_free(day_cut[reg].item.apt);
+		apoint_free(p->item.apt);
 		break;
 	case EVNT:
-		event_free(day_cut[reg].item.ev);
+		event_free(p->item.ev);
 		break;
 	case RECUR_APPT:
-		recur_apoint_free(day_cut[reg].item.rapt);
+		recur_apoint_free(p->item.rapt);
 		break;
 	case RECUR_EVNT:
-		recur_event_free(day_cut[reg].item.rev);
+		recur_event_free(p->item.rev);
 		break;
 	default:
 		break;
 	}
 }
 
+void ui_day_item_cut_free(unsigned reg)
+{
+	EXIT_IF(reg > REG_BLACK_HOLE, "illegal register");
+
+	if (!day_cut[reg].type) {
+		/* No previously cut item, don't free anything. */
+		return;
+	}
+
+	ui_day_item_free(&day_cut[reg]);
+}
+
 /* Copy an item, so that it can be pasted somewhere else later. */
 void ui_day_item_copy(unsigned reg)
 {
@@ -1441,7 +1468,13 @@ void ui_day_item_paste(unsigned reg)
 		return;
 
 	day_item_fork(&day_cut[reg], &day);
-	day_paste_item(&day, ui_day_sel_date());
+	if (!day_paste_item(&day, ui_day_sel_date())) {
+		ui_day_item_free(&day);
+		status_mesg(_("The item cannot be pasted on this day."),
+			    _("Press [Enter] to continue"));
+		keys_wgetch(win[KEY].p);
+		return;
+	}
 	day_set_sel_data(&day);
 	io_set_modified();
 	ui_calendar_monthly_view_cache_set_invalid();
@@ -1504,15 +1537,26 @@ void ui_day_sel_dayend(void)
 	listbox_item_in_view(&lb_apt, sel);
 }
 
+/* The heading of the day being drawn, reused for every heading. */
+static struct string day_heading;
+
 static char *fmt_day_heading(time_t date)
 {
 	struct tm tm;
-	struct string s;
 
+	if (!day_heading.buf)
+		string_init(&day_heading);
 	localtime_r(&date, &tm);
-	string_init(&s);
-	string_catftime(&s, conf.day_heading, &tm);
-	return string_buf(&s);
+	string_strftime(&day_heading, conf.day_heading, &tm);
+	return string_buf(&day_heading);
+}
+
+/* Free the buffer used to draw the day headings. */
+void ui_day_free(void)
+{
+	if (day_heading.buf)
+		mem_free(day_heading.buf);
+	day_heading.buf = NULL;
 }
 
 /* Display appointments in the corresponding panel. */
@@ -1543,7 +1587,6 @@ void ui_day_draw(int n, WINDOW *win, int y, int hilt, void *cb_data)
 			conf.heading_pos == LEFT ? 1 :
 			(width - utf8_strwidth(buf)) / 2, "%s", buf);
 		custom_remove_attr(win, is_slctd ? ATTR_MIDDLE : ATTR_HIGHEST);
-		mem_free(buf);
 	}
 }
 
@@ -176,6 +176,8 @@ void ui_todo_draw(int n, WINDOW *win, int y, int hilt, void *cb_data)
 	char mark[] = { 0, 0, 0, 0 };
 	int width = lb_todo.sw.w - 2;
 	char buf[width * UTF8_MAXLEN];
+	char line[width * UTF8_MAXLEN + 1];
+	char preview[BUFSIZ];
 	char *mesg;
 	int j;
 
@@ -210,6 +212,11 @@ void ui_todo_draw(int n, WINDOW *win, int y, int hilt, void *cb_data)
 	mesg = todo->mesg;
 	if (mesg[0] == '\0')
 		mesg = EMPTY_EVENT_DESC_DEFAULT;
+	if (conf.note_preview && todo->note &&
+	    note_preview(todo->note, preview, sizeof(preview)) && *preview) {
+		snprintf(line, sizeof(line), "%s -- %s", mesg, preview);
+		mesg = line;
+	}
 
 	if (utf8_strwidth(mesg) >= width) {
 		width -= 3;
@@ -322,14 +329,12 @@ void ui_todo_popup_item(void)
 		const char *note_heading = _("Note:");
 		size_t note_size = 3500;
 		char note[note_size];
-		char *notepath, *msg;
+		char *msg;
 		FILE *fp;
 
-		asprintf(&notepath, "%s%s", path_notes, item->note);
-		fp = fopen(notepath, "r");
+		fp = note_fopen(item->note);
 		note_read_contents(note, note_size, fp);
 		fclose(fp);
-		mem_free(notepath);
 
 		asprintf(&msg, "%s\n\n%s\n%s", item->mesg, note_heading, note);
 		item_in_popup(NULL, NULL, msg, _("TODO:"));
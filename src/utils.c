@@ -78,6 +78,7 @@ void exit_calcurse(int status)
 		notify_stop_main_thread();
 		ui_calendar_stop_date_thread();
 		io_stop_psave_thread();
+		io_stop_load_thread();
 
 		clear();
 		wins_refresh();
@@ -88,7 +89,12 @@ void exit_calcurse(int status)
 		was_interactive = 0;
 	}
 
+	latency_exit();
+	bench_exit();
+	vclock_exit();
 	free_user_data();
+	note_preview_free();
+	ui_day_free();
 	keys_free();
 	mem_stats();
 
@@ -96,7 +102,7 @@ void exit_calcurse(int status)
 		if (unlink(path_cpid) != 0)
 			EXIT(_("Could not remove calcurse lock file: %s\n"),
 			     strerror(errno));
-		if (dmon.enable)
+		if (dmon.enable && !vclock_virtual())
 			dmon_start(status);
 	}
 
@@ -116,6 +122,7 @@ void free_user_data(void)
 		ui_day_item_cut_free(i);
 	todo_free_list();
 	notify_free_app();
+	archive_free();
 }
 
 /* Function to exit on internal error. */
@@ -265,10 +272,9 @@ int
 status_ask_simplechoice(const char *prefix, const char *choice[],
 			int nb_choice)
 {
-	int i;
-	char *tmp;
+	int i, ret;
 	/* "(1) Choice1, (2) Choice2, (3) Choice3?" */
-	char choicestr[BUFSIZ];
+	struct string choicestr;
 	/* Holds the characters to choose from ('1', '2', etc) */
 	char char_choice[nb_choice + 2];
 
@@ -276,17 +282,23 @@ status_ask_simplechoice(const char *prefix, const char *choice[],
 	for (i = 1; i <= nb_choice; i++)
 		char_choice[i] = '0' + i;
 
-	strcpy(choicestr, prefix);
+	string_init(&choicestr);
+	string_append_str(&choicestr, prefix);
 
 	for (i = 0; i < nb_choice; i++) {
-		asprintf(&tmp,
-			 ((i + 1) == nb_choice) ? "(%d) %s?" : "(%d) %s, ",
-			 (i + 1), choice[i]);
-		strcat(choicestr, tmp);
-		mem_free(tmp);
+		string_append_char(&choicestr, '(');
+		string_append_int(&choicestr, i + 1);
+		string_append_bytes(&choicestr, ") ", 2);
+		string_append_str(&choicestr, choice[i]);
+		string_append_str(&choicestr,
+				  ((i + 1) == nb_choice) ? "?" : ", ");
 	}
 
-	return (status_ask_choice(choicestr, char_choice, nb_choice));
+	ret = status_ask_choice(string_buf(&choicestr), char_choice,
+				nb_choice);
+	mem_free(string_buf(&choicestr));
+
+	return ret;
 }
 
 /* Erase part of a window. */
@@ -423,6 +435,53 @@ struct date sec2date(time_t t)
 	return d;
 }
 
+/*
+ * Return the day number of a (calcurse) date, i.e. the number of days since
+ * 1 January 1970 in the proleptic Gregorian calendar. Unlike Unix time, day
+ * numbers are not affected by time zones and DST.
+ */
+long date2daynum(struct date day)
+{
+	long y = (long)day.yyyy - (day.mm <= 2);
+	long m = day.mm;
+	long era = (y >= 0 ? y : y - 399) / 400;
+	long yoe = y - era * 400;
+	long doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + day.dd - 1;
+	long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+	return era * 146097 + doe - 719468;
+}
+
+/* Return the (calcurse) date of a day number. */
+struct date daynum2date(long n)
+{
+	struct date d;
+	long z = n + 719468;
+	long era = (z >= 0 ? z : z - 146096) / 146097;
+	long doe = z - era * 146097;
+	long yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	long doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	long mp = (5 * doy + 2) / 153;
+
+	d.dd = doy - (153 * mp + 2) / 5 + 1;
+	d.mm = mp < 10 ? mp + 3 : mp - 9;
+	d.yyyy = yoe + era * 400 + (d.mm <= 2);
+	return d;
+}
+
+/* Return the day number of the local date of a (Unix) time in seconds. */
+long sec2daynum(time_t t)
+{
+	return date2daynum(sec2date(t));
+}
+
+/* Return the day of the week (0 = Sunday) of a day number. */
+int daynum_wday(long n)
+{
+	/* 1 January 1970 was a Thursday. */
+	return ((n % WEEKINDAYS) + WEEKINDAYS + THURSDAY) % WEEKINDAYS;
+}
+
 time_t tzdate2sec(struct date day, unsigned hour, unsigned min, char *tznew)
 {
 	char *tzold;
@@ -496,9 +555,15 @@ int date_cmp_day(time_t d1, time_t d2)
 void date_sec2date_fmt(time_t sec, const char *fmt, char *datef)
 {
 #if ENABLE_NLS
-	/* TODO: Find a better way to deal with localization and strftime(). */
-	char *locale_old = mem_strdup(setlocale(LC_ALL, NULL));
-	setlocale(LC_ALL, "C");
+	/*
+	 * Switch to the C locale for the calling thread only; exports may
+	 * format dates from several threads at the same time.
+	 */
+	locale_t loc = newlocale(LC_ALL_MASK, "C", (locale_t)0);
+	locale_t loc_old;
+
+	EXIT_IF(loc == (locale_t)0, _("could not create the C locale"));
+	loc_old = uselocale(loc);
 #endif
 
 	struct tm lt;
@@ -506,8 +571,8 @@ void date_sec2date_fmt(time_t sec, const char *fmt, char *datef)
 	strftime(datef, BUFSIZ, fmt, &lt);
 
 #if ENABLE_NLS
-	setlocale(LC_ALL, locale_old);
-	mem_free(locale_old);
+	uselocale(loc_old);
+	freelocale(loc);
 #endif
 }
 
@@ -608,7 +673,7 @@ time_t get_sec_date(struct date date)
 	char current_year[] = "yyyy ";
 
 	if (date.yyyy == 0 && date.mm == 0 && date.dd == 0) {
-		timer = time(NULL);
+		timer = now();
 		localtime_r(&timer, &ptrtime);
 		strftime(current_day, strlen(current_day), "%d", &ptrtime);
 		strftime(current_month, strlen(current_month), "%m", &ptrtime);
@@ -732,7 +797,7 @@ time_t get_today(void)
 	time_t current_time;
 	struct date day;
 
-	current_time = time(NULL);
+	current_time = now();
 	localtime_r(&current_time, &lt);
 	day.mm = lt.tm_mon + 1;
 	day.dd = lt.tm_mday;
@@ -747,12 +812,6 @@ time_t get_slctd_day(void)
 	return date2sec(*ui_calendar_get_slctd_day(), 0, 0);
 }
 
-/* Returns the current time in seconds. */
-time_t now(void)
-{
-	return time(NULL);
-}
-
 char *nowstr(void)
 {
 	struct tm lt;
@@ -1338,18 +1397,6 @@ void file_close(FILE * f, const char *pos)
 	EXIT_IF((fclose(f)) != 0, _("Error when closing file at %s"), pos);
 }
 
-/*
- * Sleep the given number of seconds, but make it more 'precise' than sleep(3)
- * (hence the 'p') in a way that even if a signal is caught during the sleep
- * process, this function will return to sleep afterwards.
- */
-void psleep(unsigned secs)
-{
-	unsigned unslept;
-
-	for (unslept = sleep(secs); unslept; unslept = sleep(unslept)) ;
-}
-
 /*
  * Fork and execute an external process.
  *
@@ -1523,7 +1570,6 @@ void press_any_key(void)
  */
 static void print_notefile(FILE * out, const char *filename, int nbtab)
 {
-	char *path_to_notefile;
 	FILE *notefile;
 	char linestarter[BUFSIZ];
 	char buffer[BUFSIZ];
@@ -1538,9 +1584,7 @@ static void print_notefile(FILE * out, const char *filename, int nbtab)
 		linestarter[0] = '\0';
 	}
 
-	asprintf(&path_to_notefile, "%s/%s", path_notes, filename);
-	notefile = fopen(path_to_notefile, "r");
-	mem_free(path_to_notefile);
+	notefile = note_fopen(filename);
 	if (notefile) {
 		while (fgets(buffer, BUFSIZ, notefile) != 0) {
 			if (printlinestarter) {
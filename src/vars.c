@@ -85,9 +85,14 @@ char *path_todo = NULL;
 char *path_apts = NULL;
 char *path_conf = NULL;
 char *path_notes = NULL;
+char *path_notes_pack = NULL;
+char *path_notes_idx = NULL;
 char *path_keys = NULL;
 char *path_cpid = NULL;
 char *path_dpid = NULL;
+char *path_lock = NULL;
+char *path_spool = NULL;
+char *path_archive = NULL;
 char *path_dmon_log = NULL;
 char *path_hooks = NULL;
 
@@ -110,7 +115,7 @@ struct dmon_conf dmon;
  * one of the threads is not running, the corresponding variable is assigned
  * the identifier of the main thread instead.
  */
-pthread_t notify_t_main, io_t_psave, ui_calendar_t_date;
+pthread_t notify_t_main, io_t_load, io_t_psave, ui_calendar_t_date;
 
 /*
  * Variables init
@@ -133,9 +138,11 @@ void vars_init(void)
 	conf.auto_save = 1;
 	conf.auto_gc = 0;
 	conf.periodic_save = 0;
+	conf.archive_horizon = 0;
 	conf.systemevents = 1;
 	conf.default_panel = CAL;
 	conf.compact_panels = 0;
+	conf.note_preview = 0;
 	strncpy(conf.output_datefmt, "%D", 3);
 	conf.input_datefmt = 1;
 	conf.heading_pos = RIGHT;
@@ -188,5 +195,6 @@ void vars_init(void)
 	ui_calendar_init_slctd_day();
 
 	/* Threads not yet running. */
-	notify_t_main = io_t_psave = ui_calendar_t_date = pthread_self();
+	notify_t_main = io_t_load = io_t_psave = ui_calendar_t_date =
+	    pthread_self();
 }
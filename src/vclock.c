@@ -0,0 +1,220 @@
+/*
+ * Calcurse - text-based organizer
+ *
+ * Copyright (c) 2004-2022 calcurse Development Team <misc@calcurse.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the
+ *        following disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the
+ *        following disclaimer in the documentation and/or other
+ *        materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Send your feedback or comments to : misc@calcurse.org
+ * Calcurse home page : http://calcurse.org
+ *
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "calcurse.h"
+
+/*
+ * Source of the current time and of sleeps.
+ *
+ * Normally, the wall clock is used. For replays of reminders and of the notify
+ * bar, a virtual clock can be set up instead (see vclock_init()). It either
+ * runs at a multiple of the real time, or only advances when calcurse sleeps,
+ * in which case a sleep returns immediately. The latter is deterministic but
+ * limited to a single sleeping thread, such as the daemon or --watch.
+ */
+static struct {
+	int active;
+	time_t start, end, t;
+	double rate;
+	struct timespec real_start;
+	unsigned long counts[VCLOCK_NB_EVENTS];
+	pthread_mutex_t mutex;
+} vclock = { 0, 0, 0, 0, 0.0, { 0, 0 }, { 0 },
+	     PTHREAD_MUTEX_INITIALIZER };
+
+static const char *vclock_labels[VCLOCK_NB_EVENTS] = {
+	"wakeups",
+	"scans",
+	"commands"
+};
+
+static int vclock_parse_time(const char *str, char **end, time_t *t)
+{
+	long long n;
+
+	errno = 0;
+	n = strtoll(str, end, 10);
+	if (errno || *end == str || n < 0)
+		return 0;
+	*t = n;
+
+	return 1;
+}
+
+/*
+ * Use a virtual clock, given as "<start>[,<end>[,<rate>]]". The start and the
+ * optional end are Unix times. Without a rate, the clock only advances when
+ * calcurse sleeps. The daemon and --watch stop when the end is reached.
+ */
+void vclock_init(const char *spec)
+{
+	const char *p = spec;
+	char *end;
+
+	EXIT_IF(!vclock_parse_time(p, &end, &vclock.start),
+		_("invalid virtual clock: %s"), spec);
+	p = end;
+	if (*p == ',') {
+		p++;
+		if (*p != ',' && *p != '\0') {
+			EXIT_IF(!vclock_parse_time(p, &end, &vclock.end) ||
+				vclock.end < vclock.start,
+				_("invalid virtual clock: %s"), spec);
+			p = end;
+		}
+	}
+	if (*p == ',') {
+		vclock.rate = strtod(p + 1, &end);
+		EXIT_IF(end == p + 1 || vclock.rate <= 0,
+			_("invalid virtual clock rate: %s"), spec);
+		p = end;
+	}
+	EXIT_IF(*p != '\0', _("invalid virtual clock: %s"), spec);
+
+	vclock.t = vclock.start;
+	clock_gettime(CLOCK_MONOTONIC, &vclock.real_start);
+	vclock.active = 1;
+}
+
+/* Return 1 if the virtual clock is used. */
+int vclock_virtual(void)
+{
+	return vclock.active;
+}
+
+/* Return 1 if the virtual clock only advances when sleeping. */
+int vclock_stepped(void)
+{
+	return vclock.active && vclock.rate == 0;
+}
+
+/* Returns the current time in seconds. */
+time_t now(void)
+{
+	struct timespec ts;
+	time_t t;
+
+	if (!vclock.active)
+		return time(NULL);
+
+	if (vclock.rate > 0) {
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return vclock.start + (time_t)(((ts.tv_sec -
+			vclock.real_start.tv_sec) + (ts.tv_nsec -
+			vclock.real_start.tv_nsec) / 1e9) * vclock.rate);
+	}
+
+	pthread_mutex_lock(&vclock.mutex);
+	t = vclock.t;
+	pthread_mutex_unlock(&vclock.mutex);
+
+	return t;
+}
+
+/* Return 1 if the end of the virtual clock has been reached. */
+int vclock_expired(void)
+{
+	return vclock.active && vclock.end && now() >= vclock.end;
+}
+
+/* Count an event for the statistics of the virtual clock. */
+void vclock_count(enum vclock_event ev)
+{
+	if (!vclock.active)
+		return;
+
+	pthread_mutex_lock(&vclock.mutex);
+	vclock.counts[ev]++;
+	pthread_mutex_unlock(&vclock.mutex);
+}
+
+/*
+ * Sleep the given number of seconds, but make it more 'precise' than sleep(3)
+ * (hence the 'p') in a way that even if a signal is caught during the sleep
+ * process, this function will return to sleep afterwards.
+ */
+void psleep(unsigned secs)
+{
+	unsigned unslept;
+	struct timespec req, rem;
+	double real;
+
+	if (!vclock.active) {
+		for (unslept = sleep(secs); unslept; unslept = sleep(unslept)) ;
+		return;
+	}
+
+	vclock_count(VCLOCK_WAKEUP);
+	if (vclock.rate == 0) {
+		pthread_mutex_lock(&vclock.mutex);
+		vclock.t += secs;
+		pthread_mutex_unlock(&vclock.mutex);
+		return;
+	}
+
+	real = secs / vclock.rate;
+	req.tv_sec = (time_t)real;
+	req.tv_nsec = (long)((real - req.tv_sec) * 1e9);
+	while (nanosleep(&req, &rem) != 0 && errno == EINTR)
+		req = rem;
+}
+
+/* Print the virtual time reached and the events counted so far. */
+void vclock_report(FILE *fp)
+{
+	int i;
+
+	fprintf(fp, "%-10s %lld\n", "start", (long long)vclock.start);
+	fprintf(fp, "%-10s %lld\n", "end", (long long)now());
+	for (i = 0; i < VCLOCK_NB_EVENTS; i++)
+		fprintf(fp, "%-10s %lu\n", vclock_labels[i], vclock.counts[i]);
+}
+
+/* Report the statistics of the virtual clock, if any, when exiting. */
+void vclock_exit(void)
+{
+	if (!vclock.active)
+		return;
+
+	vclock_report(stdout);
+	fflush(stdout);
+	vclock.active = 0;
+}
@@ -37,17 +37,14 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "calcurse.h"
 
-#define SCREEN_ACQUIRE \
-  pthread_cleanup_push(screen_cleanup, (void *)NULL); \
-  screen_acquire();
-
-#define SCREEN_RELEASE \
-  screen_release(); \
-  pthread_cleanup_pop(0);
-
 /* Variables to handle calcurse windows. */
 struct window win[NBWINS];
 struct scrollwin sw_cal;
@@ -61,80 +58,114 @@ static enum win slctd_win;
 static int layout;
 
 /*
- * The screen_mutex mutex and wins_refresh(), wins_wrefresh(), wins_doupdate()
- * functions are used to prevent concurrent updates of the screen.
- * It was observed that the display could get screwed up when multiple threads
- * tried to refresh the screen at the same time.
- *
- * Note (2010-03-21):
- * Since recent versions of ncurses (5.7), rudimentary support for threads are
- * available (use_screen(), use_window() for instance - see curs_threads(3)),
- * but to remain compatible with earlier versions, it was chosen to rely on a
- * screen-level mutex instead.
+ * The screen is only ever drawn by the main thread, which owns all curses
+ * state. Other threads, such as the notify-bar thread or the calendar date
+ * thread, post the panels to be redrawn with wins_post() instead. The main
+ * thread draws them in a single update whenever it waits for input (see
+ * wins_wgetch()), and the pipe below is used to wake it up.
  */
-static pthread_mutex_t screen_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t wins_post_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int wins_posted;
+static int wins_post_pipe[2] = { -1, -1 };
 
-static unsigned screen_acquire(void)
+/* Create the pipe used to wake up the main thread, if not done yet. */
+static void wins_post_init(void)
 {
-	if (pthread_mutex_lock(&screen_mutex) != 0)
-		return 0;
-	else
-		return 1;
+	if (wins_post_pipe[0] >= 0 || pipe(wins_post_pipe) != 0)
+		return;
+	fcntl(wins_post_pipe[0], F_SETFL, O_NONBLOCK);
+	fcntl(wins_post_pipe[1], F_SETFL, O_NONBLOCK);
+	fcntl(wins_post_pipe[0], F_SETFD, FD_CLOEXEC);
+	fcntl(wins_post_pipe[1], F_SETFD, FD_CLOEXEC);
 }
 
-static void screen_release(void)
+/* Request a redraw of the given panels from any thread. */
+void wins_post(int flags)
 {
-	pthread_mutex_unlock(&screen_mutex);
-}
+	pthread_mutex_lock(&wins_post_mutex);
+	wins_posted |= flags;
+	pthread_mutex_unlock(&wins_post_mutex);
 
-static void screen_cleanup(void *arg)
-{
-	screen_release();
+	if (wins_post_pipe[1] < 0)
+		return;
+	/* Nothing is lost if the pipe is full, a wakeup is pending anyway. */
+	while (write(wins_post_pipe[1], "", 1) < 0 && errno == EINTR) ;
 }
 
-/*
- * FIXME: The following functions currently lock the whole screen. Use both
- * window-level and screen-level mutexes (or use use_screen() and use_window(),
- * see curs_threads(3)) to avoid locking too much.
- */
-
-unsigned wins_nbar_lock(void)
+/* Draw the panels posted by other threads. */
+static void wins_render_posted(void)
 {
-	return screen_acquire();
-}
+	char buf[64];
+	int flags;
 
-void wins_nbar_unlock(void)
-{
-	screen_release();
-}
+	if (wins_post_pipe[0] >= 0)
+		while (read(wins_post_pipe[0], buf, sizeof(buf)) > 0) ;
 
-void wins_nbar_cleanup(void *arg)
-{
-	wins_nbar_unlock();
-}
+	/* Keep the requests until the screen is back, if need be. */
+	if (ui_mode != UI_CURSES)
+		return;
 
-unsigned wins_calendar_lock(void)
-{
-	return screen_acquire();
-}
+	pthread_mutex_lock(&wins_post_mutex);
+	flags = wins_posted;
+	wins_posted = 0;
+	pthread_mutex_unlock(&wins_post_mutex);
+	if (!flags)
+		return;
 
-void wins_calendar_unlock(void)
-{
-	screen_release();
+	if (flags & FLAG_CAL)
+		ui_calendar_update_panel();
+	if ((flags & FLAG_NOT) && notify_bar())
+		notify_update_bar();
+	wins_doupdate();
 }
 
-void wins_calendar_cleanup(void *arg)
-{
-	wins_calendar_unlock();
+/*
+ * Read a character from the given window, honoring its delay, and draw the
+ * panels posted by other threads meanwhile.
+ */
+int wins_wgetch(WINDOW *win)
+{
+	struct pollfd pfd[2];
+	struct timespec start, ts;
+	int delay = wgetdelay(win), left = delay, ch;
+
+	if (delay == 0)
+		return wgetch(win);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	pfd[0].fd = STDIN_FILENO;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = wins_post_pipe[0];
+	pfd[1].events = POLLIN;
+
+	for (;;) {
+		wins_render_posted();
+
+		/* Input might already be buffered by curses. */
+		wtimeout(win, 0);
+		ch = wgetch(win);
+		wtimeout(win, delay);
+		if (ch != ERR)
+			return ch;
+
+		if (delay > 0) {
+			clock_gettime(CLOCK_MONOTONIC, &ts);
+			left = delay - ((ts.tv_sec - start.tv_sec) * 1000 +
+					(ts.tv_nsec - start.tv_nsec) / 1000000);
+			if (left <= 0)
+				return ERR;
+		}
+		if (poll(pfd, 2, left) > 0 && pfd[0].revents)
+			return wgetch(win);
+	}
 }
 
 int wins_refresh(void)
 {
 	int rc;
 
-	SCREEN_ACQUIRE;
 	rc = refresh();
-	SCREEN_RELEASE;
+	latency_render();
 
 	return rc;
 }
@@ -145,9 +176,8 @@ int wins_wrefresh(WINDOW * win)
 
 	if (!win)
 		return ERR;
-	SCREEN_ACQUIRE;
 	rc = wrefresh(win);
-	SCREEN_RELEASE;
+	latency_render();
 
 	return rc;
 }
@@ -156,9 +186,8 @@ int wins_doupdate(void)
 {
 	int rc;
 
-	SCREEN_ACQUIRE;
 	rc = doupdate();
-	SCREEN_RELEASE;
+	latency_render();
 
 	return rc;
 }
@@ -167,9 +196,7 @@ int wins_redrawwin(WINDOW *win)
 {
 	int rc;
 
-	SCREEN_ACQUIRE;
 	rc = redrawwin(win);
-	SCREEN_RELEASE;
 
 	return rc;
 }
@@ -291,6 +318,8 @@ void wins_init(void)
 	keypad(win[STA].p, TRUE);
 	keypad(win[KEY].p, TRUE);
 
+	wins_post_init();
+
 	/* Notify that the curses mode is now launched. */
 	ui_mode = UI_CURSES;
 }
@@ -463,6 +492,8 @@ void wins_resize(void)
 	keypad(win[STA].p, TRUE);
 	keypad(win[KEY].p, TRUE);
 
+	wins_post_init();
+
 	if (notify_bar())
 		notify_reinit_bar();
 }
@@ -543,9 +574,7 @@ void wins_get_config(void)
 void wins_update_border(int flags)
 {
 	if (flags & FLAG_CAL) {
-		WINS_CALENDAR_LOCK;
 		wins_scrollwin_draw_deco(&sw_cal, (slctd_win == CAL));
-		WINS_CALENDAR_UNLOCK;
 	}
 	if (flags & FLAG_APP)
 		listbox_draw_deco(&lb_apt, (slctd_win == APP));
@@ -0,0 +1,51 @@
+#!/bin/sh
+# Archive past appointments and events.
+
+. "${TEST_INIT:-./test-init.sh}"
+
+if [ "$1" = 'actual' ]; then
+  tmpdir=$(mktemp -d)
+  cp "$DATA_DIR/conf" "$tmpdir" || exit 1
+  echo 'general.archivehorizon=3650' >>"$tmpdir/conf"
+  cp "$DATA_DIR/apts-archive-001" "$tmpdir/apts" || exit 1
+  mkdir "$tmpdir/notes" || exit 1
+  echo 'night' >"$tmpdir/notes/0123456789abcdef0123456789abcdef01234567"
+  "$CALCURSE" -D "$tmpdir" --archive
+  cat "$tmpdir/apts"
+  "$CALCURSE" -D "$tmpdir" -Q --from 06/01/1990 --to 07/31/1990
+  "$CALCURSE" -D "$tmpdir" --gc
+  ls -A "$tmpdir/notes"
+  "$CALCURSE" -D "$tmpdir" -G
+  rm -rf "$tmpdir" || exit 1
+elif [ "$1" = 'expected' ]; then
+  cat <<EOD
+01/01/2000 [1] {1Y} Forever yearly
+05/05/2099 @ 09:00 -> 05/05/2099 @ 10:00|Future meeting
+05/06/2099 [1] Future event
+06/15/90:
+ - 10:00 -> 11:00
+	Old meeting
+
+06/20/90:
+ - 23:00 -> ..:..
+	Night shift
+
+06/21/90:
+ - ..:.. -> 01:00
+	Night shift
+
+07/04/90:
+ * Independence
+0123456789abcdef0123456789abcdef01234567
+03/01/1995 [1] {1Y -> 03/01/2000} Yearly until 2000
+01/01/2000 [1] {1Y} Forever yearly
+02/02/1991 @ 08:00 -> 02/02/1991 @ 09:00 {1W -> 03/02/1991} |Weekly in 1991
+06/15/1990 @ 10:00 -> 06/15/1990 @ 11:00|Old meeting
+06/20/1990 @ 23:00 -> 06/21/1990 @ 01:00>0123456789abcdef0123456789abcdef01234567 |Night shift
+05/05/2099 @ 09:00 -> 05/05/2099 @ 10:00|Future meeting
+07/04/1990 [1] Independence
+05/06/2099 [1] Future event
+EOD
+else
+  ./run-test "$0"
+fi
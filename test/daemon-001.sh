@@ -0,0 +1,26 @@
+#!/bin/sh
+
+. "${TEST_INIT:-./test-init.sh}"
+
+if [ "$1" = 'actual' ]; then
+  tmpdir=$(mktemp -d)
+  cp "$DATA_DIR/apts-daemon-001" "$tmpdir/apts" || exit 1
+  touch "$tmpdir/todo"
+  sed "s|^notification.command=.*|notification.command=echo >>$tmpdir/log|" \
+    "$DATA_DIR/conf" >"$tmpdir/conf"
+  TZ=UTC "$CALCURSE" -D "$tmpdir" --virtual-clock 1704067200,1704672000 \
+    --daemon
+  wc -l <"$tmpdir/log"
+  rm -rf "$tmpdir" || exit 1
+elif [ "$1" = 'expected' ]; then
+  cat <<EOD
+start      1704067200
+end        1704672000
+wakeups    10080
+scans      2
+commands   8
+8
+EOD
+else
+  ./run-test "$0"
+fi
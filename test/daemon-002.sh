@@ -0,0 +1,51 @@
+#!/bin/sh
+# Reminder spool written when saving, and reloads when it is out of date.
+
+. "${TEST_INIT:-./test-init.sh}"
+
+spool() {
+  sed '1s/^\(calcurse-spool 1\) [0-9]* [0-9]* [0-9]* [0-9]*/\1/' \
+    "$tmpdir/.reminders"
+}
+
+if [ "$1" = 'actual' ]; then
+  tmpdir=$(mktemp -d)
+  cp "$DATA_DIR/apts-daemon-001" "$tmpdir/apts" || exit 1
+  cp "$DATA_DIR/conf" "$tmpdir" || exit 1
+  touch "$tmpdir/todo"
+  TZ=UTC "$CALCURSE" -D "$tmpdir" --virtual-clock 1704067200,1704067200 \
+    -P --filter-type todo >/dev/null
+  spool
+  TZ=UTC "$CALCURSE" -D "$tmpdir" --virtual-clock 1704067200,1704070800 \
+    --daemon | grep '^scans'
+  echo '01/02/2024 @ 08:00 -> 01/02/2024 @ 08:30 |Added' >>"$tmpdir/apts"
+  TZ=UTC "$CALCURSE" -D "$tmpdir" --virtual-clock 1704067200,1704070800 \
+    --daemon | grep '^scans'
+  spool | head -n 3
+  TZ=UTC "$CALCURSE" -D "$tmpdir" --virtual-clock 1704600000,1704603600 \
+    --daemon | grep '^scans'
+  spool | head -n 1
+  rm -rf "$tmpdir" || exit 1
+elif [ "$1" = 'expected' ]; then
+  cat <<EOD
+calcurse-spool 1 1704672000
+1704103200 1 |Daily standup
+1704189600 1 |Daily standup
+1704276000 1 |Daily standup
+1704294000 1 |Dentist
+1704362400 1 |Daily standup
+1704445200 0 Not flagged
+1704448800 1 |Daily standup
+1704535200 1 |Daily standup
+1704621600 1 |Daily standup
+scans      0
+scans      1
+calcurse-spool 1 1704672000
+1704103200 1 |Daily standup
+1704182400 0 Added
+scans      1
+calcurse-spool 1 1705190400
+EOD
+else
+  ./run-test "$0"
+fi
@@ -0,0 +1,34 @@
+#!/bin/sh
+# Serve several calendars from one daemon, skipping a broken one.
+
+. "${TEST_INIT:-./test-init.sh}"
+
+if [ "$1" = 'actual' ]; then
+  tmpdir=$(mktemp -d)
+  for cal in a b; do
+    mkdir "$tmpdir/$cal" || exit 1
+    cp "$DATA_DIR/apts-daemon-001" "$tmpdir/$cal/apts" || exit 1
+    touch "$tmpdir/$cal/todo"
+    sed -e "s|^notification.command=.*|notification.command=echo $cal >>$tmpdir/log|" \
+      -e 's|^daemon.log=.*|daemon.log=yes|' \
+      "$DATA_DIR/conf" >"$tmpdir/$cal/conf"
+  done
+  echo '01/02/2024 @ 10:00 -> garbage' >>"$tmpdir/b/apts"
+  TZ=UTC "$CALCURSE" --virtual-clock 1704067200,1704672000 \
+    --daemon-dirs "$tmpdir"
+  sort "$tmpdir/log" | uniq -c | sed 's/^ *//'
+  grep '^Could not' "$tmpdir/b/daemon.log" | sed "s|$tmpdir|DIR|"
+  rm -rf "$tmpdir" || exit 1
+elif [ "$1" = 'expected' ]; then
+  cat <<EOD
+start      1704067200
+end        1704672000
+wakeups    10080
+scans      2
+commands   8
+8 a
+Could not load appointments: DIR/b/apts:4: syntax error in item time or duration
+EOD
+else
+  ./run-test "$0"
+fi
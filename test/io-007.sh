@@ -0,0 +1,37 @@
+#!/bin/sh
+# Data files are replaced atomically, following symbolic links and keeping
+# their permissions.
+
+. "${TEST_INIT:-./test-init.sh}"
+
+if [ "$1" = 'actual' ]; then
+  tmpdir=$(mktemp -d)
+  mkdir "$tmpdir/data" "$tmpdir/real" || exit 1
+  cp "$DATA_DIR/conf" "$tmpdir/data" || exit 1
+  : >"$tmpdir/real/apts"
+  chmod 600 "$tmpdir/real/apts"
+  ln -s ../real/apts "$tmpdir/data/apts"
+  "$CALCURSE" -D "$tmpdir/data" -q -i "$DATA_DIR/ical-001.ical"
+  [ -h "$tmpdir/data/apts" ] && echo 'link kept'
+  ls -l "$tmpdir/real/apts" | cut -c1-10
+  cat "$tmpdir/real/apts"
+  ls -A "$tmpdir/data"
+  ls -A "$tmpdir/real"
+  rm -rf "$tmpdir" || exit 1
+elif [ "$1" = 'expected' ]; then
+  cat <<EOD
+link kept
+-rw-------
+01/01/1980 @ 00:01 -> 01/02/1980 @ 09:18|Calibrator's
+.calcurse.lock
+.reminders
+apts
+conf
+hooks
+notes
+todo
+apts
+EOD
+else
+  ./run-test "$0"
+fi
@@ -0,0 +1,35 @@
+#!/bin/sh
+# Note pack.
+
+. "${TEST_INIT:-./test-init.sh}"
+
+if [ "$1" = 'actual' ]; then
+  tmpdir=$(mktemp -d)
+  cp "$DATA_DIR/conf" "$tmpdir" || exit 1
+  "$CALCURSE" -D "$tmpdir" -q -i "$DATA_DIR/ical-003.ical"
+  "$CALCURSE" -D "$tmpdir" --pack-notes
+  ls -A "$tmpdir/notes"
+  "$CALCURSE" -D "$tmpdir" -x | grep '^DESCRIPTION'
+  "$CALCURSE" -D "$tmpdir" -G --filter-type recur-event --format-recur-event '%N'
+  rm -rf "$tmpdir" || exit 1
+elif [ "$1" = 'expected' ]; then
+  cat <<EOD
+.pack
+.pack.idx
+DESCRIPTION:The first weekend in May is a two-day event.\nNon-repeating event.
+DESCRIPTION:First weekend in May is a two-day event!\nRepeating event\, three years.
+DESCRIPTION:First weekend in May is a two-day event!\nRepeating appointment.
+	The first weekend in May is a two-day event.
+	Non-repeating event.
+	-- 
+	Import: multi-day event changed to one-day event
+
+	First weekend in May is a two-day event!
+	Repeating event, three years.
+	-- 
+	Import: multi-day event changed to one-day event
+
+EOD
+else
+  ./run-test "$0"
+fi
@@ -0,0 +1,22 @@
+#!/bin/sh
+# Garbage collection of unused notes.
+
+. "${TEST_INIT:-./test-init.sh}"
+
+if [ "$1" = 'actual' ]; then
+  tmpdir=$(mktemp -d)
+  cp "$DATA_DIR/conf" "$tmpdir" || exit 1
+  "$CALCURSE" -D "$tmpdir" -q -i "$DATA_DIR/ical-003.ical"
+  echo 'unused' >"$tmpdir/notes/0000000000000000000000000000000000000000"
+  "$CALCURSE" -D "$tmpdir" --gc
+  ls -A "$tmpdir/notes"
+  rm -rf "$tmpdir" || exit 1
+elif [ "$1" = 'expected' ]; then
+  cat <<EOD
+80ca0905ba6d331277d5bea0ef7457bb33a33c88
+84ccfba5d9a3bf774fe79dac348e8f95bf806714
+8fb44c9925743a6f83fc18c72a248adcc0047d03
+EOD
+else
+  ./run-test "$0"
+fi
@@ -0,0 +1,30 @@
+#!/bin/sh
+
+. "${TEST_INIT:-./test-init.sh}"
+
+if [ "$1" = 'actual' ]; then
+  "$CALCURSE" --read-only -D "$DATA_DIR"/ -c "$DATA_DIR/apts-range-004" \
+    -Q --from 03/10/2022 --to 03/16/2022 --filter-type cal
+elif [ "$1" = 'expected' ]; then
+  cat <<EOD
+03/10/22:
+ - ..:.. -> ..:..
+	Trip into the range
+
+03/11/22:
+ - ..:.. -> 09:00
+	Trip into the range
+
+03/14/22:
+ * Every other day, three times
+
+03/15/22:
+ - 08:00 -> 09:00
+	Weekly until the range
+
+03/16/22:
+ * Every other day, three times
+EOD
+else
+  ./run-test "$0"
+fi
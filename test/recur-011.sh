@@ -0,0 +1,66 @@
+#!/bin/sh
+
+. "${TEST_INIT:-./test-init.sh}"
+
+if [ "$1" = 'actual' ]; then
+  "$CALCURSE" --read-only -D "$DATA_DIR"/ -c "$DATA_DIR/apts-recur-count" \
+    -Q --from 01/01/2020 --to 12/31/2028 --filter-type cal
+elif [ "$1" = 'expected' ]; then
+  cat <<EOD
+02/29/20:
+ * leap day, twice
+
+01/01/21:
+ - 09:00 -> 10:00
+	every other weekday, Mon/Wed/Fri, 5 times
+
+01/05/21:
+ - 12:00 -> 13:00
+	every other week on Tue and Thu, 4 times
+
+01/07/21:
+ - 12:00 -> 13:00
+	every other week on Tue and Thu, 4 times
+
+01/11/21:
+ - 09:00 -> 10:00
+	every other weekday, Mon/Wed/Fri, 5 times
+
+01/13/21:
+ - 09:00 -> 10:00
+	every other weekday, Mon/Wed/Fri, 5 times
+
+01/15/21:
+ - 09:00 -> 10:00
+	every other weekday, Mon/Wed/Fri, 5 times
+
+01/19/21:
+ - 12:00 -> 13:00
+	every other week on Tue and Thu, 4 times
+
+01/21/21:
+ - 12:00 -> 13:00
+	every other week on Tue and Thu, 4 times
+
+01/25/21:
+ - 09:00 -> 10:00
+	every other weekday, Mon/Wed/Fri, 5 times
+
+01/31/21:
+ - 18:00 -> 19:00
+	monthly on the 31st, 3 times, not in March
+
+05/31/21:
+ - 18:00 -> 19:00
+	monthly on the 31st, 3 times, not in March
+
+07/31/21:
+ - 18:00 -> 19:00
+	monthly on the 31st, 3 times, not in March
+
+02/29/24:
+ * leap day, twice
+EOD
+else
+  ./run-test "$0"
+fi
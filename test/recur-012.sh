@@ -0,0 +1,8 @@
+#!/bin/sh
+
+. "${TEST_INIT:-./test-init.sh}"
+
+"$CALCURSE" --read-only -D "$DATA_DIR"/ -c "$DATA_DIR/apts-recur-012" \
+  -d01/01/2020 2>errors && exit 1
+grep -Fq 'repeat count is too big' errors
+rm -f errors
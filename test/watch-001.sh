@@ -0,0 +1,46 @@
+#!/bin/sh
+# Reprint query results with --watch, following a virtual clock.
+
+. "${TEST_INIT:-./test-init.sh}"
+
+if [ "$1" = 'actual' ]; then
+  tmpdir=$(mktemp -d)
+  cp "$DATA_DIR/apts-daemon-001" "$tmpdir/apts" || exit 1
+  cp "$DATA_DIR/conf" "$tmpdir" || exit 1
+  touch "$tmpdir/todo"
+  TZ=UTC "$CALCURSE" -D "$tmpdir" --virtual-clock 1704067200,1704240000 \
+    -Q --watch
+  TZ=UTC "$CALCURSE" -D "$tmpdir" --virtual-clock 1704103020,1704103320 \
+    -n --watch
+  rm -rf "$tmpdir" || exit 1
+elif [ "$1" = 'expected' ]; then
+  cat <<EOD
+01/01/24:
+ - 10:00 -> 10:30
+	|Daily standup
+01/02/24:
+ - 10:00 -> 10:30
+	|Daily standup
+start      1704067200
+end        1704240000
+wakeups    172800
+scans      0
+commands   0
+next appointment:
+   [00:03] |Daily standup
+next appointment:
+   [00:02] |Daily standup
+next appointment:
+   [00:01] |Daily standup
+
+next appointment:
+   [23:59] |Daily standup
+start      1704103020
+end        1704103320
+wakeups    300
+scans      0
+commands   0
+EOD
+else
+  ./run-test "$0"
+fi